@@ -0,0 +1,364 @@
+/*
+ * Copyright (c) 2014-2019, Nils Christopher Brause, Philipp Kerling
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/** \example replay.cpp
+ * Replays a stream of input and configure events from a stub compositor
+ * into a client over a socketpair and measures the dispatch throughput
+ * of the client. The stream is either one of the built-in, deterministic
+ * scenarios or the events of a trace recorded with wayland::tracer_t.
+ * Usage: replay [drag|resize|typing|trace-file] [events]
+ */
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <poll.h>
+
+#include <wayland-client.hpp>
+#include <wayland-trace.hpp>
+#include "stub-compositor.hpp"
+
+namespace
+{
+  struct replay_event_t
+  {
+    enum class kind_t { enter, leave, motion, button, axis, frame, key, modifiers, configure };
+    kind_t kind;
+    uint32_t args[5];
+    double x;
+    double y;
+  };
+
+  using kind_t = replay_event_t::kind_t;
+
+  replay_event_t make(kind_t kind, uint32_t a0 = 0, uint32_t a1 = 0, uint32_t a2 = 0, double x = 0, double y = 0)
+  {
+    replay_event_t e = {kind, {a0, a1, a2, 0, 0}, x, y};
+    return e;
+  }
+
+  // deterministic pseudo random numbers
+  uint32_t next_random(uint32_t &state)
+  {
+    state = state * 1664525 + 1013904223;
+    return state >> 8;
+  }
+
+  // a pointer drag: motion and frame pairs along a jittery circle
+  std::vector<replay_event_t> drag(std::size_t count)
+  {
+    std::vector<replay_event_t> events;
+    uint32_t random = 1;
+    events.push_back(make(kind_t::enter, 0, 0, 0, 100, 100));
+    events.push_back(make(kind_t::button, 0, 0x110, 1));
+    events.push_back(make(kind_t::frame));
+    for(uint32_t time = 0; events.size() + 3 < count; time += 8)
+      {
+        double x = 200 + 100 * std::cos(time / 500.0) + (next_random(random) % 100) / 50.0;
+        double y = 200 + 100 * std::sin(time / 500.0) + (next_random(random) % 100) / 50.0;
+        events.push_back(make(kind_t::motion, time, 0, 0, x, y));
+        events.push_back(make(kind_t::frame));
+      }
+    events.push_back(make(kind_t::button, 0, 0x110, 0));
+    events.push_back(make(kind_t::frame));
+    events.push_back(make(kind_t::leave));
+    return events;
+  }
+
+  // an interactive resize: configure events of changing size
+  std::vector<replay_event_t> resize(std::size_t count)
+  {
+    std::vector<replay_event_t> events;
+    for(uint32_t c = 0; events.size() < count; c++)
+      events.push_back(make(kind_t::configure, 10, 640 + c % 640, 480 + c % 360));
+    return events;
+  }
+
+  // typing: key presses and releases with modifier updates
+  std::vector<replay_event_t> typing(std::size_t count)
+  {
+    std::vector<replay_event_t> events;
+    uint32_t random = 1;
+    for(uint32_t time = 0; events.size() + 3 <= count; time += 30)
+      {
+        uint32_t key = 16 + next_random(random) % 34;
+        events.push_back(make(kind_t::key, time, key, 1));
+        events.push_back(make(kind_t::modifiers, key % 8 == 0 ? 1 : 0));
+        events.push_back(make(kind_t::key, time + 20, key, 0));
+      }
+    return events;
+  }
+
+  // the pointer, keyboard and shell surface events of a trace
+  std::vector<replay_event_t> load_trace(const std::string &file)
+  {
+    std::ifstream in(file, std::ios_base::in | std::ios_base::binary);
+    if(!in)
+      throw std::runtime_error("Could not open " + file);
+    std::vector<char> content((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    wayland::trace::file_header_t header;
+    if(content.size() < sizeof(header))
+      throw std::runtime_error(file + " is not a trace file");
+    std::memcpy(&header, content.data(), sizeof(header));
+    if(std::memcmp(header.magic, wayland::trace::magic, sizeof(header.magic)) != 0)
+      throw std::runtime_error(file + " is not a trace file");
+
+    std::map<uint16_t, std::string> interfaces;
+    std::vector<replay_event_t> events;
+    std::size_t pos = sizeof(header);
+    std::size_t end = std::min<std::size_t>(content.size(), sizeof(header) + header.size);
+    while(pos + sizeof(wayland::trace::record_t) <= end)
+      {
+        wayland::trace::record_t record;
+        std::memcpy(&record, content.data() + pos, sizeof(record));
+        if(record.size < sizeof(record) || pos + record.size > end)
+          break;
+        const char *payload = content.data() + pos + sizeof(record);
+        std::size_t words = (record.size - sizeof(record)) / 4;
+        pos += record.size;
+
+        if(record.type == wayland::trace::record_type::interface)
+          {
+            interfaces[record.interface] = payload;
+            continue;
+          }
+        if(record.type != wayland::trace::record_type::event)
+          continue;
+
+        uint32_t a[5] = {0, 0, 0, 0, 0};
+        std::memcpy(a, payload, std::min<std::size_t>(words, 5) * 4);
+        auto fixed = [] (uint32_t raw) { return static_cast<int32_t>(raw) / 256.0; };
+        const std::string &interface = interfaces[record.interface];
+        if(interface == "wl_pointer")
+          switch(record.opcode)
+            {
+            case 0: events.push_back(make(kind_t::enter, 0, 0, 0, fixed(a[2]), fixed(a[3]))); break;
+            case 1: events.push_back(make(kind_t::leave)); break;
+            case 2: events.push_back(make(kind_t::motion, a[0], 0, 0, fixed(a[1]), fixed(a[2]))); break;
+            case 3: events.push_back(make(kind_t::button, a[1], a[2], a[3])); break;
+            case 4: events.push_back(make(kind_t::axis, a[0], a[1], 0, fixed(a[2]))); break;
+            case 5: events.push_back(make(kind_t::frame)); break;
+            default: break;
+            }
+        else if(interface == "wl_keyboard")
+          switch(record.opcode)
+            {
+            case 3: events.push_back(make(kind_t::key, a[1], a[2], a[3])); break;
+            case 4:
+              events.push_back(make(kind_t::modifiers, a[1], a[2], a[3]));
+              events.back().args[3] = a[4];
+              break;
+            default: break;
+            }
+        else if(interface == "wl_shell_surface" && record.opcode == 1)
+          events.push_back(make(kind_t::configure, a[0], a[1], a[2]));
+      }
+    return events;
+  }
+
+  void send(stub_compositor_t &stub, const replay_event_t &e)
+  {
+    using namespace wayland::server;
+    switch(e.kind)
+      {
+      case kind_t::enter:
+        stub.pointer.send_enter(stub.next_serial(), stub.surface, e.x, e.y);
+        break;
+      case kind_t::leave:
+        stub.pointer.send_leave(stub.next_serial(), stub.surface);
+        break;
+      case kind_t::motion:
+        stub.pointer.send_motion(e.args[0], e.x, e.y);
+        break;
+      case kind_t::button:
+        stub.pointer.send_button(stub.next_serial(), e.args[0], e.args[1], static_cast<pointer_button_state>(e.args[2]));
+        break;
+      case kind_t::axis:
+        stub.pointer.send_axis(e.args[0], static_cast<pointer_axis>(e.args[1]), e.x);
+        break;
+      case kind_t::frame:
+        if(stub.pointer.can_send_frame())
+          stub.pointer.send_frame();
+        break;
+      case kind_t::key:
+        stub.keyboard.send_key(stub.next_serial(), e.args[0], e.args[1], static_cast<keyboard_key_state>(e.args[2]));
+        break;
+      case kind_t::modifiers:
+        stub.keyboard.send_modifiers(stub.next_serial(), e.args[0], e.args[1], e.args[2], e.args[3]);
+        break;
+      case kind_t::configure:
+        stub.shell_surface.send_configure(shell_surface_resize(e.args[0]), static_cast<int32_t>(e.args[1]),
+                                          static_cast<int32_t>(e.args[2]));
+        break;
+      }
+  }
+}
+
+namespace
+{
+  // allocations of the library on both ends of the connection
+  uint64_t library_allocations()
+  {
+    uint64_t n = 0;
+    for(std::size_t c = 0; c < wayland::allocation_category_count; c++)
+      n += wayland::get_allocation_counters(static_cast<wayland::allocation_category>(c)).allocations;
+    return n;
+  }
+
+  // Dispatch until the target number of events was received. Returns
+  // false if nothing arrives for a second, e.g. because the compositor
+  // dropped or merged an event.
+  bool dispatch_until(wayland::display_t &display, const uint64_t &received, uint64_t target)
+  {
+    while(true)
+      {
+        // dispatches the events that are already queued
+        wayland::read_intent intent = display.obtain_read_intent();
+        if(received >= target)
+          {
+            intent.cancel();
+            return true;
+          }
+        display.flush();
+        pollfd fd = {display.get_fd(), POLLIN, 0};
+        if(poll(&fd, 1, 1000) <= 0 || !(fd.revents & POLLIN))
+          {
+            intent.cancel();
+            return false;
+          }
+        intent.read();
+        display.dispatch_pending();
+      }
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  std::string scenario = argc > 1 ? argv[1] : "drag";
+  std::size_t count = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 1000000;
+
+  std::vector<replay_event_t> events;
+  if(scenario == "drag")
+    events = drag(count);
+  else if(scenario == "resize")
+    events = resize(count);
+  else if(scenario == "typing")
+    events = typing(count);
+  else
+    events = load_trace(scenario);
+
+  stub_compositor_t stub;
+  wayland::display_t display(stub.take_client_fd());
+  wayland::registry_t registry = display.get_registry();
+  wayland::compositor_t compositor;
+  wayland::shell_t shell;
+  wayland::seat_t seat;
+  registry.on_global() = [&] (uint32_t name, const std::string &interface, uint32_t version)
+    {
+      if(interface == wayland::compositor_t::interface_name)
+        registry.bind(name, compositor, version);
+      else if(interface == wayland::shell_t::interface_name)
+        registry.bind(name, shell, version);
+      else if(interface == wayland::seat_t::interface_name)
+        registry.bind(name, seat, version);
+    };
+  display.roundtrip();
+
+  wayland::surface_t surface = compositor.create_surface();
+  wayland::shell_surface_t shell_surface = shell.get_shell_surface(surface);
+  wayland::pointer_t pointer = seat.get_pointer();
+  wayland::keyboard_t keyboard = seat.get_keyboard();
+  display.roundtrip();
+
+  // every replayed event is counted once, a frame is only sent to
+  // pointers that support it
+  uint64_t received = 0;
+  uint64_t expected = 0;
+  pointer.on_enter() = [&] (uint32_t, const wayland::surface_t&, double, double) { received++; };
+  pointer.on_leave() = [&] (uint32_t, const wayland::surface_t&) { received++; };
+  pointer.on_motion() = [&] (uint32_t, double, double) { received++; };
+  pointer.on_button() = [&] (uint32_t, uint32_t, uint32_t, wayland::pointer_button_state) { received++; };
+  pointer.on_axis() = [&] (uint32_t, wayland::pointer_axis, double) { received++; };
+  pointer.on_frame() = [&] () { received++; };
+  keyboard.on_key() = [&] (uint32_t, uint32_t, uint32_t, wayland::keyboard_key_state) { received++; };
+  keyboard.on_modifiers() = [&] (uint32_t, uint32_t, uint32_t, uint32_t, uint32_t) { received++; };
+  shell_surface.on_configure() = [&] (wayland::shell_surface_resize, int32_t, int32_t) { received++; };
+  // wl_pointer.frame was added in version 5
+  bool frames = pointer.get_version() >= 5;
+  for(auto &e : events)
+    if(e.kind != kind_t::frame || frames)
+      expected++;
+
+  // Events are sent in batches small enough for the socket buffers. Only
+  // the time the client takes to read and dispatch a batch is measured.
+  const std::size_t batch = 64;
+  uint64_t target = 0;
+  uint64_t allocations = 0;
+  std::chrono::steady_clock::duration client_time{0};
+  auto start = std::chrono::steady_clock::now();
+  for(std::size_t first = 0; first < events.size(); first += batch)
+    {
+      std::size_t last = std::min(first + batch, events.size());
+      stub.run([&] ()
+        {
+          for(std::size_t c = first; c < last; c++)
+            send(stub, events[c]);
+        });
+      for(std::size_t c = first; c < last; c++)
+        if(events[c].kind != kind_t::frame || frames)
+          target++;
+
+      // the compositor is idle now, so only the client allocates
+      uint64_t allocations_before = library_allocations();
+      auto t0 = std::chrono::steady_clock::now();
+      bool complete = dispatch_until(display, received, target);
+      client_time += std::chrono::steady_clock::now() - t0;
+      allocations += library_allocations() - allocations_before;
+      if(!complete)
+        {
+          std::cerr << "Missed " << target - received << " of " << expected << " events" << std::endl;
+          break;
+        }
+    }
+  auto total = std::chrono::steady_clock::now() - start;
+
+  double seconds = std::chrono::duration<double>(total).count();
+  double client_ns = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(client_time).count());
+  std::cout << "scenario\tevents\tevents/s\tns/event\tallocations/event" << std::endl
+            << scenario << "\t" << received << "\t"
+            << static_cast<double>(received) / seconds << "\t"
+            << client_ns / static_cast<double>(received) << "\t"
+            << static_cast<double>(allocations) / static_cast<double>(received) << std::endl;
+  return received == expected ? 0 : 1;
+}
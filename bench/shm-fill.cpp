@@ -0,0 +1,127 @@
+/*
+ * Copyright (c) 2014-2019, Nils Christopher Brause, Philipp Kerling
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/** \example shm-fill.cpp
+ * Measures how fast shm pool memory can be filled with 4K pages
+ * compared to huge pages, both on first touch and afterwards.
+ * Usage: shm-fill [size in MiB] [iterations]
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include <wayland-shm.hpp>
+
+using namespace wayland;
+
+namespace
+{
+  using clock_type = std::chrono::steady_clock;
+
+  double seconds(clock_type::duration d)
+  {
+    return std::chrono::duration<double>(d).count();
+  }
+
+  // Fill the whole backing, return a checksum so the stores are not elided
+  uint32_t fill(shm_backing_t &backing, uint32_t value)
+  {
+    auto *pixels = static_cast<uint32_t*>(backing.get_mem());
+    std::size_t count = backing.get_size() / sizeof(uint32_t);
+    std::fill_n(pixels, count, value);
+    return pixels[0] ^ pixels[count / 2] ^ pixels[count - 1];
+  }
+
+  struct config_t
+  {
+    std::string name;
+    shm_backing_options_t options;
+  };
+}
+
+int main(int argc, char *argv[])
+{
+  std::size_t size = (argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 256) << 20;
+  unsigned int iterations = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 5;
+  if(size == 0 || iterations == 0)
+    {
+      std::cerr << "Usage: " << argv[0] << " [size in MiB] [iterations]" << std::endl;
+      return 1;
+    }
+
+  std::vector<config_t> configs(4);
+  configs[0].name = "4K pages";
+  configs[1].name = "4K pages, prefaulted";
+  configs[1].options.populate = true;
+  configs[2].name = "huge pages";
+  configs[2].options.huge_pages = true;
+  configs[3].name = "huge pages, prefaulted";
+  configs[3].options.huge_pages = true;
+  configs[3].options.populate = true;
+
+  std::cout << "Filling " << (size >> 20) << " MiB, " << iterations << " iterations" << std::endl
+            << std::left << std::setw(24) << "backing" << std::setw(12) << "pages"
+            << std::right << std::setw(12) << "create ms" << std::setw(16) << "first GB/s"
+            << std::setw(16) << "steady GB/s" << std::endl;
+
+  uint32_t checksum = 0;
+  for(auto &config : configs)
+    {
+      try
+        {
+          auto start = clock_type::now();
+          shm_backing_t backing(size, size, config.options);
+          auto created = clock_type::now();
+          checksum ^= fill(backing, 0xff000000);
+          auto touched = clock_type::now();
+          for(unsigned int c = 0; c < iterations; c++)
+            checksum ^= fill(backing, 0xff000000 | c);
+          auto done = clock_type::now();
+
+          double gb = static_cast<double>(backing.get_size()) / 1e9;
+          std::string pages = backing.uses_hugetlb() ? "hugetlb"
+            : config.options.huge_pages ? "THP hint" : "4K";
+          std::cout << std::left << std::setw(24) << config.name << std::setw(12) << pages
+                    << std::right << std::fixed << std::setprecision(2)
+                    << std::setw(12) << seconds(created - start) * 1000
+                    << std::setw(16) << gb / seconds(touched - created)
+                    << std::setw(16) << gb * iterations / seconds(done - touched) << std::endl;
+        }
+      catch(std::system_error &e)
+        {
+          std::cout << std::left << std::setw(24) << config.name << "failed: " << e.what() << std::endl;
+        }
+    }
+
+  // keep the fills observable
+  return checksum == 0x12345678 ? 2 : 0;
+}
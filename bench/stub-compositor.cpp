@@ -0,0 +1,244 @@
+/*
+ * Copyright (c) 2014-2019, Nils Christopher Brause, Philipp Kerling
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <cerrno>
+#include <stdexcept>
+#include <system_error>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+
+#include "stub-compositor.hpp"
+
+using namespace wayland::server;
+
+stub_compositor_t::stub_compositor_t()
+  : compositor(display), subcompositor(display), shm(display), shell(display), seat(display), output(display),
+    refresh(std::chrono::nanoseconds(1000000000) / 60), start(std::chrono::steady_clock::now())
+{
+  compositor.on_bind() = [this] (const client_t& /*unused*/, compositor_t compositor)
+    {
+      compositor.on_create_surface() = [this] (surface_t s)
+        {
+          surface = s;
+          // state of this surface, not captured by reference to avoid a
+          // cycle with the resource
+          auto attached = std::make_shared<buffer_t>();
+          auto requested = std::make_shared<std::vector<callback_t>>();
+          surface.on_attach() = [attached] (const buffer_t& b, int32_t /*unused*/, int32_t /*unused*/) { *attached = b; };
+          surface.on_frame() = [requested] (const callback_t& c) { requested->push_back(c); };
+          surface.on_commit() = [this, attached, requested] ()
+            {
+              commits++;
+              // like a compositor that copies shm buffers on commit
+              if(*attached)
+                attached->send_release();
+              *attached = buffer_t();
+              frames.insert(frames.end(), requested->begin(), requested->end());
+              requested->clear();
+              schedule_frames();
+            };
+        };
+    };
+
+  shm.on_bind() = [] (const client_t& /*unused*/, shm_t shm)
+    {
+      // buffer contents are never looked at
+      shm.on_create_pool() = [] (const shm_pool_t& /*unused*/, int fd, int32_t /*unused*/) { close(fd); };
+      shm.send_format(shm_format::argb8888);
+      shm.send_format(shm_format::xrgb8888);
+    };
+
+  shell.on_bind() = [this] (const client_t& /*unused*/, shell_t shell)
+    {
+      shell.on_get_shell_surface() = [this] (const shell_surface_t& s, const surface_t& /*unused*/)
+        {
+          shell_surface = s;
+        };
+    };
+
+  seat.on_bind() = [this] (const client_t& /*unused*/, seat_t seat)
+    {
+      seat.on_get_pointer() = [this] (const pointer_t& p) { pointer = p; };
+      seat.on_get_keyboard() = [this] (const keyboard_t& k) { keyboard = k; };
+      seat.on_get_touch() = [this] (const touch_t& t) { touch = t; };
+      seat.send_capabilities(seat_capability::pointer | seat_capability::keyboard | seat_capability::touch);
+    };
+
+  output.on_bind() = [this] (const client_t& /*unused*/, output_t o)
+    {
+      output_resource = o;
+      o.send_geometry(0, 0, 300, 200, output_subpixel::unknown, "stub", "stub", output_transform::normal);
+      o.send_mode(output_mode::current | output_mode::preferred, 1920, 1080, 60000);
+      if(o.can_send_done())
+        o.send_done();
+    };
+
+  create_client(client_fd);
+
+  wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if(wake_fd < 0)
+    throw std::system_error(errno, std::generic_category(), "eventfd");
+  timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+  if(timer_fd < 0)
+    throw std::system_error(errno, std::generic_category(), "timerfd_create");
+
+  thread = std::thread(&stub_compositor_t::loop, this);
+}
+
+stub_compositor_t::~stub_compositor_t()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    running = false;
+  }
+  uint64_t one = 1;
+  if(write(wake_fd, &one, sizeof(one)) < 0)
+    std::terminate();
+  thread.join();
+  close(wake_fd);
+  close(timer_fd);
+  if(client_fd >= 0)
+    close(client_fd);
+}
+
+void stub_compositor_t::loop()
+{
+  event_loop_t event_loop = display.get_event_loop();
+  pollfd fds[3] = {{event_loop.get_fd(), POLLIN, 0}, {wake_fd, POLLIN, 0}, {timer_fd, POLLIN, 0}};
+  while(true)
+    {
+      display.flush_clients();
+      if(poll(fds, 3, -1) < 0 && errno != EINTR)
+        throw std::system_error(errno, std::generic_category(), "poll");
+      if(fds[0].revents)
+        event_loop.dispatch(0);
+      if(fds[2].revents)
+        {
+          uint64_t expirations = 0;
+          if(read(timer_fd, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN)
+            throw std::system_error(errno, std::generic_category(), "read");
+          timer_armed = false;
+          complete_frames();
+        }
+      if(fds[1].revents)
+        {
+          uint64_t value = 0;
+          if(read(wake_fd, &value, sizeof(value)) < 0 && errno != EAGAIN)
+            throw std::system_error(errno, std::generic_category(), "read");
+
+          std::unique_lock<std::mutex> lock(mutex);
+          if(!running)
+            return;
+          if(task)
+            {
+              task();
+              display.flush_clients();
+              task = nullptr;
+              cond.notify_all();
+            }
+        }
+    }
+}
+
+void stub_compositor_t::create_client(int &fd)
+{
+  int fds[2];
+  if(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) < 0)
+    throw std::system_error(errno, std::generic_category(), "socketpair");
+  client = client_t(display, fds[0]);
+  fd = fds[1];
+}
+
+void stub_compositor_t::schedule_frames()
+{
+  if(frames.empty() || timer_armed)
+    return;
+  if(refresh.count() == 0)
+    {
+      complete_frames();
+      return;
+    }
+
+  // the next refresh, counted from the start of the compositor
+  auto now = std::chrono::steady_clock::now();
+  auto next = start + ((now - start) / refresh + 1) * refresh;
+  auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(next.time_since_epoch()).count();
+  itimerspec its = {};
+  its.it_value.tv_sec = static_cast<time_t>(ns / 1000000000);
+  its.it_value.tv_nsec = static_cast<long>(ns % 1000000000);
+  if(timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &its, nullptr) < 0)
+    throw std::system_error(errno, std::generic_category(), "timerfd_settime");
+  timer_armed = true;
+}
+
+void stub_compositor_t::complete_frames()
+{
+  auto time = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+  for(auto &frame : frames)
+    if(frame)
+      {
+        frame.send_done(static_cast<uint32_t>(time.count()));
+        frame.destroy();
+        frames_done++;
+      }
+  frames.clear();
+}
+
+int stub_compositor_t::take_client_fd()
+{
+  int fd = client_fd;
+  client_fd = -1;
+  return fd;
+}
+
+void stub_compositor_t::run(const std::function<void()> &func)
+{
+  std::unique_lock<std::mutex> lock(mutex);
+  task = func;
+  uint64_t one = 1;
+  if(write(wake_fd, &one, sizeof(one)) < 0)
+    throw std::system_error(errno, std::generic_category(), "write");
+  cond.wait(lock, [this] { return !task; });
+}
+
+int stub_compositor_t::add_client()
+{
+  int fd = -1;
+  run([&] () { create_client(fd); });
+  return fd;
+}
+
+void stub_compositor_t::set_refresh(std::chrono::nanoseconds interval)
+{
+  run([&] () { refresh = interval; });
+}
+
+uint32_t stub_compositor_t::next_serial()
+{
+  return display.next_serial();
+}
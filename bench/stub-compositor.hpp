@@ -0,0 +1,129 @@
+/*
+ * Copyright (c) 2014-2019, Nils Christopher Brause, Philipp Kerling
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef STUB_COMPOSITOR_HPP
+#define STUB_COMPOSITOR_HPP
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <wayland-server.hpp>
+#include <wayland-server-protocol.hpp>
+
+/** \brief Minimal in-process compositor for benchmarks
+
+    Offers wl_compositor, wl_subcompositor, wl_shm, wl_shell, wl_seat
+    (with pointer, keyboard and touch) and wl_output to clients connected
+    through socketpairs. The server runs its event loop on its own
+    thread. Events are sent by passing a function to run(), which
+    executes it on the server thread and flushes the client afterwards.
+
+    Buffers are released as soon as they are committed. Frame callbacks
+    are completed on the next refresh after the commit of their surface.
+*/
+class stub_compositor_t
+{
+private:
+  wayland::server::display_t display;
+  wayland::server::global_compositor_t compositor;
+  wayland::server::global_subcompositor_t subcompositor;
+  wayland::server::global_shm_t shm;
+  wayland::server::global_shell_t shell;
+  wayland::server::global_seat_t seat;
+  wayland::server::global_output_t output;
+
+  int client_fd = -1;
+  int wake_fd = -1;
+  int timer_fd = -1;
+  std::chrono::nanoseconds refresh;
+  std::chrono::steady_clock::time_point start;
+  // frame callbacks of committed surfaces
+  std::vector<wayland::server::callback_t> frames;
+  bool timer_armed = false;
+  std::thread thread;
+  std::mutex mutex;
+  std::condition_variable cond;
+  std::function<void()> task;
+  bool running = true;
+
+  void loop();
+  void create_client(int &fd);
+  void schedule_frames();
+  void complete_frames();
+
+public:
+  // Resources of the client, last one created of each kind. They may
+  // only be used on the server thread, i.e. in functions passed to run().
+  wayland::server::client_t client;
+  wayland::server::surface_t surface;
+  wayland::server::shell_surface_t shell_surface;
+  wayland::server::pointer_t pointer;
+  wayland::server::keyboard_t keyboard;
+  wayland::server::touch_t touch;
+  wayland::server::output_t output_resource;
+
+  // Number of wl_surface.commit requests received
+  unsigned long commits = 0;
+  // Number of frame callbacks completed
+  unsigned long frames_done = 0;
+
+  stub_compositor_t();
+  ~stub_compositor_t();
+  stub_compositor_t(const stub_compositor_t&) = delete;
+  stub_compositor_t &operator=(const stub_compositor_t&) = delete;
+
+  /** \brief Get the client end of the socketpair
+      To be passed to wayland::display_t::display_t(int), which takes
+      ownership of it.
+  */
+  int take_client_fd();
+
+  /** \brief Connect another client
+      \return The client end of its socketpair, to be passed to
+              wayland::display_t::display_t(int)
+  */
+  int add_client();
+
+  /** \brief Set the refresh interval of the output
+      Frame callbacks are completed on the next multiple of it. Zero
+      completes them right after the commit. The default is 60 Hz.
+  */
+  void set_refresh(std::chrono::nanoseconds interval);
+
+  /** \brief Execute a function on the server thread and wait for it
+      The client is flushed afterwards.
+  */
+  void run(const std::function<void()> &func);
+
+  /** \brief Get a new serial number, only on the server thread
+   */
+  uint32_t next_serial();
+};
+
+#endif
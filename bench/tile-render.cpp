@@ -0,0 +1,112 @@
+/*
+ * Copyright (c) 2014-2019, Nils Christopher Brause, Philipp Kerling
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/** \example tile-render.cpp
+ * Measures the frame time of tile parallel rendering into a 1080p and a
+ * 4K buffer with 1 to 16 threads.
+ * Usage: tile-render [frames]
+ */
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include <wayland-tile.hpp>
+
+using namespace wayland;
+
+namespace
+{
+  // A few floating point operations per pixel, roughly what a simple
+  // software renderer spends on gradients and antialiased shapes.
+  void shade(const tile_t &tile, float t)
+  {
+    for(int32_t y = 0; y < tile.rect.height; y++)
+      {
+        uint32_t *row = tile.row(y);
+        float fy = static_cast<float>(tile.rect.y + y) * 0.01f;
+        for(int32_t x = 0; x < tile.rect.width; x++)
+          {
+            float fx = static_cast<float>(tile.rect.x + x) * 0.01f;
+            float v = std::sin(fx + t) + std::sin(fy - t) + std::sin((fx + fy) * 0.5f);
+            auto c = static_cast<uint32_t>((v + 3.0f) * 42.0f);
+            row[x] = 0xff000000u | (c << 16) | ((255 - c) << 8) | (c >> 1);
+          }
+      }
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  unsigned int frames = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 20;
+  if(frames == 0)
+    {
+      std::cerr << "Usage: " << argv[0] << " [frames]" << std::endl;
+      return 1;
+    }
+
+  struct frame_size_t
+  {
+    const char *name;
+    int32_t width;
+    int32_t height;
+  };
+  const frame_size_t sizes[] = { { "1080p", 1920, 1080 }, { "4K", 3840, 2160 } };
+  const unsigned int thread_counts[] = { 1, 2, 4, 8, 16 };
+
+  std::cout << std::left << std::setw(8) << "size" << std::right << std::setw(8) << "threads"
+            << std::setw(12) << "ms/frame" << std::setw(10) << "speedup" << std::endl;
+  for(auto &size : sizes)
+    {
+      std::vector<uint32_t> pixels(static_cast<std::size_t>(size.width) * static_cast<std::size_t>(size.height));
+      double single = 0;
+      for(unsigned int threads : thread_counts)
+        {
+          tile_renderer_t renderer(threads);
+          float t = 0;
+          auto func = [&t] (const tile_t &tile) { shade(tile, t); };
+
+          auto start = std::chrono::steady_clock::now();
+          for(unsigned int c = 0; c < frames; c++)
+            {
+              t = static_cast<float>(c) * 0.1f;
+              renderer.invalidate_all();
+              renderer.render(pixels.data(), size.width, size.height, size.width * 4, shm_format::argb8888, func);
+            }
+          double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / frames;
+          if(threads == 1)
+            single = ms;
+
+          std::cout << std::left << std::setw(8) << size.name << std::right << std::setw(8) << threads
+                    << std::fixed << std::setprecision(2) << std::setw(12) << ms
+                    << std::setw(10) << single / ms << std::endl;
+        }
+    }
+  return 0;
+}
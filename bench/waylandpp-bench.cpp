@@ -0,0 +1,299 @@
+/*
+ * Copyright (c) 2014-2019, Nils Christopher Brause, Philipp Kerling
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/** \example waylandpp-bench.cpp
+ * Microbenchmarks of the client library against an in-process stub
+ * compositor: request marshalling by argument kind, event dispatch by
+ * signature, proxy lifecycle, roundtrips and event queues. Results are
+ * printed as tab separated values with one benchmark per line, so runs
+ * of different releases can be compared with diff or a spreadsheet.
+ * Usage: waylandpp-bench [filter] [scale]
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <stdexcept>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include <wayland-client.hpp>
+#include "stub-compositor.hpp"
+
+using namespace wayland;
+
+namespace
+{
+  class bench_t
+  {
+  private:
+    std::string filter;
+    double scale;
+
+    stub_compositor_t stub;
+    display_t display;
+    registry_t registry;
+    compositor_t compositor;
+    shell_t shell;
+    seat_t seat;
+    output_t output;
+    surface_t surface;
+    shell_surface_t shell_surface;
+    pointer_t pointer;
+    keyboard_t keyboard;
+    region_t region;
+    uint64_t received = 0;
+
+    bool selected(const std::string &group, const std::string &name) const
+    {
+      return filter.empty() || (group + "/" + name).find(filter) != std::string::npos;
+    }
+
+    std::size_t iterations(std::size_t n) const
+    {
+      return std::max<std::size_t>(1, static_cast<std::size_t>(static_cast<double>(n) * scale));
+    }
+
+    // allocations of the library on both ends of the connection since
+    // the counters were reset at the start of the benchmark
+    static void report(const std::string &group, const std::string &name, std::size_t n, std::chrono::steady_clock::duration time)
+    {
+      double ns = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(time).count());
+      uint64_t allocations = 0;
+      for(std::size_t c = 0; c < allocation_category_count; c++)
+        allocations += get_allocation_counters(static_cast<allocation_category>(c)).allocations;
+      std::cout << group << "\t" << name << "\t" << n << "\t" << ns / static_cast<double>(n)
+                << "\t" << static_cast<double>(allocations) / static_cast<double>(n) << std::endl;
+    }
+
+    // time n requests, flushing the connection now and then like a
+    // client with a main loop would
+    void marshal(const std::string &name, const std::function<void()> &request)
+    {
+      if(!selected("marshal", name))
+        return;
+      std::size_t n = iterations(200000);
+      reset_allocation_counters();
+      auto start = std::chrono::steady_clock::now();
+      for(std::size_t c = 0; c < n; c++)
+        {
+          request();
+          if(c % 256 == 255)
+            display.flush();
+        }
+      display.flush();
+      report("marshal", name, n, std::chrono::steady_clock::now() - start);
+      display.roundtrip();
+    }
+
+    // time the dispatch of n events, sent in batches that fit the socket
+    // buffers
+    void dispatch(const std::string &name, const std::function<void()> &event, const event_queue_t &queue = event_queue_t())
+    {
+      if(!selected(queue ? "queue" : "dispatch", name))
+        return;
+      std::size_t n = iterations(200000);
+      const std::size_t batch = 64;
+      std::chrono::steady_clock::duration time{0};
+      uint64_t target = received;
+      reset_allocation_counters();
+      for(std::size_t c = 0; c < n; c += batch)
+        {
+          std::size_t count = std::min(batch, n - c);
+          stub.run([&] ()
+            {
+              for(std::size_t i = 0; i < count; i++)
+                event();
+            });
+          target += count;
+          auto start = std::chrono::steady_clock::now();
+          while(received < target)
+            if(queue)
+              display.dispatch_queue(queue);
+            else
+              display.dispatch();
+          time += std::chrono::steady_clock::now() - start;
+        }
+      report(queue ? "queue" : "dispatch", name, n, time);
+    }
+
+    void roundtrip(const std::string &name, const std::function<void()> &func)
+    {
+      if(!selected("roundtrip", name))
+        return;
+      std::size_t n = iterations(10000);
+      reset_allocation_counters();
+      auto start = std::chrono::steady_clock::now();
+      for(std::size_t c = 0; c < n; c++)
+        func();
+      report("roundtrip", name, n, std::chrono::steady_clock::now() - start);
+    }
+
+  public:
+    bench_t(std::string f, double s)
+      : filter(std::move(f)), scale(s), display(stub.take_client_fd())
+    {
+      registry = display.get_registry();
+      registry.on_global() = [&] (uint32_t name, const std::string &interface, uint32_t version)
+        {
+          if(interface == compositor_t::interface_name)
+            registry.bind(name, compositor, version);
+          else if(interface == shell_t::interface_name)
+            registry.bind(name, shell, version);
+          else if(interface == seat_t::interface_name)
+            registry.bind(name, seat, version);
+          else if(interface == output_t::interface_name)
+            registry.bind(name, output, version);
+        };
+      display.roundtrip();
+
+      surface = compositor.create_surface();
+      shell_surface = shell.get_shell_surface(surface);
+      pointer = seat.get_pointer();
+      keyboard = seat.get_keyboard();
+      region = compositor.create_region();
+      display.roundtrip();
+
+      pointer.on_enter() = [&] (uint32_t, const surface_t&, double, double) { received++; };
+      pointer.on_motion() = [&] (uint32_t, double, double) { received++; };
+      pointer.on_frame() = [&] () { received++; };
+      keyboard.on_key() = [&] (uint32_t, uint32_t, uint32_t, keyboard_key_state) { received++; };
+      keyboard.on_enter() = [&] (uint32_t, const surface_t&, const array_t&) { received++; };
+      keyboard.on_keymap() = [&] (keyboard_keymap_format, int fd, uint32_t)
+        {
+          close(fd);
+          received++;
+        };
+      output.on_geometry() = [&] (int32_t, int32_t, int32_t, int32_t, output_subpixel, const std::string&, const std::string&, output_transform)
+        {
+          received++;
+        };
+    }
+
+    void run()
+    {
+      std::cout << "group\tname\titerations\tns/op\tallocations/op" << std::endl;
+
+      marshal("none", [&] () { surface.commit(); });
+      marshal("int", [&] () { surface.set_buffer_scale(1); });
+      marshal("4 int", [&] () { surface.damage(0, 0, 64, 64); });
+      marshal("object", [&] () { surface.set_input_region(region); });
+      marshal("string", [&] () { shell_surface.set_title("waylandpp benchmark"); });
+
+      // copy and destroy need the regions of create, so these always
+      // run together and are only reported when selected
+      bool create = selected("lifecycle", "create");
+      bool copy = selected("lifecycle", "copy");
+      bool destroy = selected("lifecycle", "destroy");
+      if(create || copy || destroy)
+        {
+          std::size_t n = iterations(100000);
+          std::vector<region_t> regions;
+          std::vector<region_t> copies;
+          regions.reserve(n);
+          copies.reserve(n);
+          reset_allocation_counters();
+          auto start = std::chrono::steady_clock::now();
+          for(std::size_t c = 0; c < n; c++)
+            {
+              regions.push_back(compositor.create_region());
+              if(c % 256 == 255)
+                display.flush();
+            }
+          if(create)
+            report("lifecycle", "create", n, std::chrono::steady_clock::now() - start);
+          display.roundtrip();
+
+          if(copy)
+            {
+              reset_allocation_counters();
+              start = std::chrono::steady_clock::now();
+              for(auto &r : regions)
+                copies.push_back(r);
+              report("lifecycle", "copy", n, std::chrono::steady_clock::now() - start);
+              // the last copy destroys the proxy
+              copies.clear();
+            }
+
+          reset_allocation_counters();
+          start = std::chrono::steady_clock::now();
+          for(std::size_t c = 0; c < n; c++)
+            {
+              regions[c] = region_t();
+              if(c % 256 == 255)
+                display.flush();
+            }
+          if(destroy)
+            report("lifecycle", "destroy", n, std::chrono::steady_clock::now() - start);
+          display.roundtrip();
+        }
+
+      dispatch("frame ()", [&] () { stub.pointer.send_frame(); });
+      dispatch("motion (uff)", [&] () { stub.pointer.send_motion(0, 10.5, 20.25); });
+      dispatch("key (uuuu)", [&] () { stub.keyboard.send_key(1, 0, 30, server::keyboard_key_state::pressed); });
+      dispatch("enter (uoff)", [&] () { stub.pointer.send_enter(1, stub.surface, 1.0, 2.0); });
+      dispatch("enter (uoa)", [&] ()
+        {
+          stub.keyboard.send_enter(1, stub.surface, array_t(std::vector<uint32_t>{30, 31, 32, 33}));
+        });
+      dispatch("geometry (iiiiissi)", [&] ()
+        {
+          stub.output_resource.send_geometry(0, 0, 300, 200, server::output_subpixel::unknown, "make", "model",
+                                             server::output_transform::normal);
+        });
+      if(selected("dispatch", "keymap (uhu)"))
+        {
+          int fd = memfd_create("keymap", MFD_CLOEXEC);
+          if(fd < 0 || ftruncate(fd, 4096) < 0)
+            throw std::runtime_error("memfd_create failed");
+          dispatch("keymap (uhu)", [&] () { stub.keyboard.send_keymap(server::keyboard_keymap_format::xkb_v1, fd, 4096); });
+          close(fd);
+        }
+
+      roundtrip("display", [&] () { display.roundtrip(); });
+      event_queue_t queue = display.create_queue();
+      roundtrip("queue", [&] () { display.roundtrip_queue(queue); });
+
+      // the same events as above, dispatched from a separate event queue
+      keyboard.set_queue(queue);
+      dispatch("key (uuuu)", [&] () { stub.keyboard.send_key(1, 0, 30, server::keyboard_key_state::pressed); }, queue);
+      keyboard.set_queue(event_queue_t());
+    }
+  };
+}
+
+int main(int argc, char *argv[])
+{
+  std::string filter = argc > 1 ? argv[1] : "";
+  double scale = argc > 2 ? std::atof(argv[2]) : 1.0;
+  bench_t bench(filter, scale);
+  bench.run();
+  return 0;
+}
@@ -0,0 +1,411 @@
+/*
+ * Copyright (c) 2014-2019, Nils Christopher Brause, Philipp Kerling
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/** \example waylandpp-load.cpp
+ * Load generator: opens a number of connections, each with a number of
+ * surfaces that have subsurfaces, and redraws every surface at a fixed
+ * rate or as fast as its frame callbacks allow. Reports the achieved
+ * frame rate, the distribution of the time from commit to frame
+ * callback and the CPU time of the client threads.
+ * Runs against the compositor in WAYLAND_DISPLAY, e.g. a headless one,
+ * or with -S against an in-process stub compositor.
+ * Usage: waylandpp-load [-c connections] [-s surfaces] [-u subsurfaces]
+ *                       [-r fps] [-d seconds] [-w size] [-S] [-R refresh]
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <getopt.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/resource.h>
+
+#include <wayland-client.hpp>
+#include <wayland-client-protocol-extra.hpp>
+#include <wayland-shm.hpp>
+#ifdef HAVE_STUB_COMPOSITOR
+#include "stub-compositor.hpp"
+#endif
+
+using namespace wayland;
+
+namespace
+{
+  using clock_type = std::chrono::steady_clock;
+
+  struct options_t
+  {
+    unsigned int connections = 4;
+    unsigned int surfaces = 8;
+    unsigned int subsurfaces = 2;
+    // frames per second of every surface, 0 for as fast as possible
+    double rate = 0;
+    double duration = 5;
+    int32_t size = 64;
+    bool stub = false;
+    double refresh = 60;
+  };
+
+  // results of all connections
+  struct results_t
+  {
+    latency_histogram_t latency;
+    std::atomic<uint64_t> frames{0};
+    std::atomic<uint64_t> starved{0};
+    std::atomic<uint64_t> cpu_ns{0};
+  };
+
+  uint64_t thread_cpu_ns()
+  {
+    timespec ts = {};
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + static_cast<uint64_t>(ts.tv_nsec);
+  }
+
+  double process_cpu_seconds()
+  {
+    rusage usage = {};
+    getrusage(RUSAGE_SELF, &usage);
+    return static_cast<double>(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec)
+      + static_cast<double>(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+  }
+
+  // a surface with its subsurfaces
+  struct window_t
+  {
+    surface_t surface;
+    shell_surface_t shell_surface;
+    xdg_surface_t xdg_surface;
+    xdg_toplevel_t xdg_toplevel;
+    swapchain_t swapchain;
+    std::vector<surface_t> children;
+    std::vector<subsurface_t> subsurfaces;
+    std::vector<swapchain_t> child_swapchains;
+    clock_type::time_point due;
+    clock_type::time_point committed;
+    uint32_t frame = 0;
+  };
+
+  // one client connection, driven by its own thread
+  class connection_t
+  {
+  private:
+    const options_t &options;
+    results_t &results;
+    display_t display;
+    registry_t registry;
+    compositor_t compositor;
+    subcompositor_t subcompositor;
+    shm_t shm;
+    shell_t shell;
+    xdg_wm_base_t xdg_wm_base;
+    shm_allocator_t allocator;
+    std::vector<std::unique_ptr<window_t>> windows;
+
+    void draw(window_t &window, clock_type::time_point now)
+    {
+      // subsurfaces are synchronized, their commits are applied together
+      // with the one of the parent
+      for(auto &chain : window.child_swapchains)
+        {
+          shm_buffer_t buffer = chain.acquire();
+          std::memset(buffer.pixels(), static_cast<int>(window.frame), static_cast<std::size_t>(buffer.stride()));
+          chain.present(buffer, false);
+        }
+      shm_buffer_t buffer = window.swapchain.acquire();
+      auto *pixels = static_cast<uint32_t*>(buffer.pixels());
+      std::fill_n(pixels, buffer.width(), 0xff000000 | window.frame);
+      window.committed = clock_type::now();
+      window.swapchain.present(buffer);
+      window.frame++;
+
+      if(options.rate > 0)
+        {
+          auto interval = std::chrono::duration_cast<clock_type::duration>(std::chrono::duration<double>(1.0 / options.rate));
+          window.due += interval;
+          // do not try to catch up after falling behind
+          if(window.due < now)
+            window.due = now + interval;
+        }
+    }
+
+  public:
+    connection_t(const options_t &o, results_t &r, display_t &&d)
+      : options(o), results(r), display(std::move(d))
+    {
+      registry = display.get_registry();
+      registry.on_global() = [&] (uint32_t name, const std::string &interface, uint32_t version)
+        {
+          if(interface == compositor_t::interface_name)
+            registry.bind(name, compositor, std::min(version, 4U));
+          else if(interface == subcompositor_t::interface_name)
+            registry.bind(name, subcompositor, 1);
+          else if(interface == shm_t::interface_name)
+            registry.bind(name, shm, 1);
+          else if(interface == shell_t::interface_name)
+            registry.bind(name, shell, 1);
+          else if(interface == xdg_wm_base_t::interface_name)
+            registry.bind(name, xdg_wm_base, 1);
+        };
+      display.roundtrip();
+      if(!compositor || !shm || (!shell && !xdg_wm_base))
+        throw std::runtime_error("Compositor, shm or shell missing.");
+      if(options.subsurfaces && !subcompositor)
+        throw std::runtime_error("Subcompositor missing.");
+      if(xdg_wm_base)
+        xdg_wm_base.on_ping() = [&] (uint32_t serial) { xdg_wm_base.pong(serial); };
+
+      allocator = shm_allocator_t(shm);
+      int32_t child_size = std::max(options.size / 4, 1);
+      for(unsigned int c = 0; c < options.surfaces; c++)
+        {
+          std::unique_ptr<window_t> window(new window_t);
+          window->surface = compositor.create_surface();
+          if(xdg_wm_base)
+            {
+              window->xdg_surface = xdg_wm_base.get_xdg_surface(window->surface);
+              xdg_surface_t &xdg_surface = window->xdg_surface;
+              xdg_surface.on_configure() = [&xdg_surface] (uint32_t serial) { xdg_surface.ack_configure(serial); };
+              window->xdg_toplevel = window->xdg_surface.get_toplevel();
+              window->xdg_toplevel.set_title("waylandpp-load");
+            }
+          else
+            {
+              window->shell_surface = shell.get_shell_surface(window->surface);
+              shell_surface_t &shell_surface = window->shell_surface;
+              shell_surface.on_ping() = [&shell_surface] (uint32_t serial) { shell_surface.pong(serial); };
+              window->shell_surface.set_title("waylandpp-load");
+              window->shell_surface.set_toplevel();
+            }
+
+          window->swapchain = swapchain_t(display, window->surface, allocator);
+          window->swapchain.resize(options.size, options.size, shm_format::xrgb8888);
+          window_t &w = *window;
+          window->swapchain.on_frame() = [this, &w] (uint32_t /*unused*/)
+            {
+              results.latency.record(clock_type::now() - w.committed);
+              results.frames.fetch_add(1, std::memory_order_relaxed);
+            };
+
+          for(unsigned int i = 0; i < options.subsurfaces; i++)
+            {
+              surface_t child = compositor.create_surface();
+              subsurface_t subsurface = subcompositor.get_subsurface(child, window->surface);
+              subsurface.set_position(static_cast<int32_t>(i) * child_size, 0);
+              swapchain_t chain(display, child, allocator);
+              chain.resize(child_size, child_size, shm_format::argb8888);
+              window->children.push_back(child);
+              window->subsurfaces.push_back(subsurface);
+              window->child_swapchains.push_back(chain);
+            }
+
+          // xdg surfaces must not be drawn before the first configure
+          window->surface.commit();
+          windows.push_back(std::move(window));
+        }
+      display.roundtrip();
+    }
+
+    void run(clock_type::time_point end)
+    {
+      uint64_t cpu_start = thread_cpu_ns();
+      for(auto &window : windows)
+        window->due = clock_type::now();
+
+      while(true)
+        {
+          auto now = clock_type::now();
+          if(now >= end)
+            break;
+
+          // draw all surfaces that are due and not waiting for a frame
+          // callback, then sleep until the next one is due
+          auto wake = end;
+          for(auto &window : windows)
+            if(!window->swapchain.frame_pending())
+              {
+                if(window->due <= now)
+                  draw(*window, now);
+                if(!window->swapchain.frame_pending())
+                  wake = std::min(wake, window->due);
+              }
+
+          read_intent intent = display.obtain_read_intent();
+          display.flush();
+          auto timeout = std::chrono::duration_cast<std::chrono::milliseconds>(wake - clock_type::now()).count();
+          pollfd fd = {display.get_fd(), POLLIN, 0};
+          if(poll(&fd, 1, static_cast<int>(std::max<int64_t>(timeout, 0))) > 0 && (fd.revents & POLLIN))
+            intent.read();
+          else
+            intent.cancel();
+          display.dispatch_pending();
+        }
+
+      for(auto &window : windows)
+        {
+          uint64_t starved = window->swapchain.stats().starved;
+          for(auto &chain : window->child_swapchains)
+            starved += chain.stats().starved;
+          results.starved.fetch_add(starved, std::memory_order_relaxed);
+        }
+      results.cpu_ns.fetch_add(thread_cpu_ns() - cpu_start, std::memory_order_relaxed);
+    }
+  };
+
+  double ms(std::chrono::nanoseconds ns)
+  {
+    return static_cast<double>(ns.count()) / 1e6;
+  }
+
+  void usage(const char *name)
+  {
+    std::cerr << "Usage: " << name << " [-c connections] [-s surfaces] [-u subsurfaces] [-r fps] [-d seconds] [-w size] [-S] [-R refresh]" << std::endl
+              << "  -c  Number of connections (default: 4)" << std::endl
+              << "  -s  Surfaces per connection (default: 8)" << std::endl
+              << "  -u  Subsurfaces per surface (default: 2)" << std::endl
+              << "  -r  Frames per second of every surface, 0 for as fast as frame callbacks allow (default: 0)" << std::endl
+              << "  -d  Duration in seconds (default: 5)" << std::endl
+              << "  -w  Width and height of the surfaces in pixels (default: 64)" << std::endl
+              << "  -S  Use an in-process stub compositor instead of WAYLAND_DISPLAY" << std::endl
+              << "  -R  Refresh rate of the stub compositor in Hz, 0 to complete frames at once (default: 60)" << std::endl;
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  options_t options;
+  int opt = 0;
+  while((opt = getopt(argc, argv, "c:s:u:r:d:w:SR:h")) != -1)
+    switch(opt)
+      {
+      case 'c': options.connections = std::strtoul(optarg, nullptr, 10); break;
+      case 's': options.surfaces = std::strtoul(optarg, nullptr, 10); break;
+      case 'u': options.subsurfaces = std::strtoul(optarg, nullptr, 10); break;
+      case 'r': options.rate = std::strtod(optarg, nullptr); break;
+      case 'd': options.duration = std::strtod(optarg, nullptr); break;
+      case 'w': options.size = static_cast<int32_t>(std::strtol(optarg, nullptr, 10)); break;
+      case 'S': options.stub = true; break;
+      case 'R': options.refresh = std::strtod(optarg, nullptr); break;
+      default:
+        usage(argv[0]);
+        return 1;
+      }
+  if(options.connections == 0 || options.size <= 0 || options.duration <= 0 || optind != argc)
+    {
+      usage(argv[0]);
+      return 1;
+    }
+
+#ifdef HAVE_STUB_COMPOSITOR
+  std::unique_ptr<stub_compositor_t> stub;
+  if(options.stub)
+    {
+      stub.reset(new stub_compositor_t);
+      std::chrono::duration<double> refresh(options.refresh > 0 ? 1.0 / options.refresh : 0.0);
+      stub->set_refresh(std::chrono::duration_cast<std::chrono::nanoseconds>(refresh));
+    }
+#else
+  if(options.stub)
+    {
+      std::cerr << "Built without the stub compositor." << std::endl;
+      return 1;
+    }
+#endif
+
+  results_t results;
+  std::vector<std::unique_ptr<connection_t>> connections;
+  for(unsigned int c = 0; c < options.connections; c++)
+    {
+#ifdef HAVE_STUB_COMPOSITOR
+      if(stub)
+        {
+          int fd = c == 0 ? stub->take_client_fd() : stub->add_client();
+          connections.emplace_back(new connection_t(options, results, display_t(fd)));
+          continue;
+        }
+#endif
+      connections.emplace_back(new connection_t(options, results, display_t()));
+    }
+
+  double cpu_start = process_cpu_seconds();
+  auto start = clock_type::now();
+  auto end = start + std::chrono::duration_cast<clock_type::duration>(std::chrono::duration<double>(options.duration));
+  std::vector<std::thread> threads;
+  std::exception_ptr error;
+  std::atomic<bool> failed{false};
+  for(auto &connection : connections)
+    threads.emplace_back([&, end] ()
+      {
+        try
+          {
+            connection->run(end);
+          }
+        catch(...)
+          {
+            if(!failed.exchange(true))
+              error = std::current_exception();
+          }
+      });
+  for(auto &thread : threads)
+    thread.join();
+  double seconds = std::chrono::duration<double>(clock_type::now() - start).count();
+  double process_cpu = process_cpu_seconds() - cpu_start;
+  if(error)
+    std::rethrow_exception(error);
+
+  uint64_t frames = results.frames;
+  std::size_t surfaces = options.connections * options.surfaces;
+  double client_cpu = static_cast<double>(results.cpu_ns.load()) / 1e9;
+  std::cout << std::fixed << std::setprecision(3)
+            << "connections\t" << options.connections << std::endl
+            << "surfaces\t" << surfaces << std::endl
+            << "subsurfaces\t" << surfaces * options.subsurfaces << std::endl
+            << "frames\t" << frames << std::endl
+            << "fps\t" << static_cast<double>(frames) / seconds << std::endl
+            << "fps/surface\t" << static_cast<double>(frames) / seconds / static_cast<double>(surfaces) << std::endl
+            << "latency_ms_mean\t" << ms(results.latency.mean()) << std::endl
+            << "latency_ms_p50\t" << ms(results.latency.percentile(50)) << std::endl
+            << "latency_ms_p90\t" << ms(results.latency.percentile(90)) << std::endl
+            << "latency_ms_p99\t" << ms(results.latency.percentile(99)) << std::endl
+            << "latency_ms_p99.9\t" << ms(results.latency.percentile(99.9)) << std::endl
+            << "latency_ms_max\t" << ms(results.latency.max()) << std::endl
+            << "starved_acquires\t" << results.starved << std::endl
+            << "client_cpu_s\t" << client_cpu << std::endl
+            << "client_cpu_%\t" << 100.0 * client_cpu / seconds << std::endl
+            << "process_cpu_s\t" << process_cpu << std::endl;
+  return 0;
+}
@@ -247,7 +247,7 @@ public:
     keyboard = seat.get_keyboard();
 
     // load cursor theme
-    cursor_theme_t cursor_theme = cursor_theme_t("default", 16, shm);
+    shared_cursor_theme_t cursor_theme = cursor_theme_cache_t::get("default", 16, shm);
     cursor_t cursor = cursor_theme.get_cursor("cross");
     cursor_image = cursor.image(0);
     cursor_buffer = cursor_image.get_buffer();
@@ -29,22 +29,16 @@
 
 #include <stdexcept>
 #include <iostream>
-#include <array>
 #include <memory>
-#include <sstream>
 #include <ctime>
 #include <algorithm>
-#include <random>
 
 #include <wayland-client.hpp>
 #include <wayland-client-protocol-extra.hpp>
 #include <linux/input.h>
 #include <wayland-cursor.hpp>
-
-#include <sys/mman.h>
-#include <sys/stat.h>
-#include <fcntl.h>
-#include <unistd.h>
+#include <wayland-shm.hpp>
+#include <wayland-pixel.hpp>
 
 using namespace wayland;
 
@@ -58,72 +52,6 @@ std::function<R(Args...)> bind_mem_fn(R(T::* func)(Args...), T *t)
     };
 }
 
-// shared memory helper class
-class shared_mem_t
-{
-private:
-  std::string name;
-  int fd = 0;
-  size_t len = 0;
-  void *mem = nullptr;
-
-public:
-  shared_mem_t() = default;
-  shared_mem_t(const shared_mem_t&) = delete;
-  shared_mem_t(shared_mem_t&&) noexcept = delete;
-  shared_mem_t& operator=(const shared_mem_t&) = delete;
-  shared_mem_t& operator=(shared_mem_t&&) noexcept = delete;
-
-  shared_mem_t(size_t size)
-  : len(size)
-  {
-    // create random filename
-    std::stringstream ss;
-    std::random_device device;
-    std::default_random_engine engine(device());
-    std::uniform_int_distribution<unsigned int> distribution(0, std::numeric_limits<unsigned int>::max());
-    ss << distribution(engine);
-    name = ss.str();
-
-    // open shared memory file
-    fd = memfd_create(name.c_str(), 0);
-    if(fd < 0)
-      throw std::runtime_error("shm_open failed.");
-
-    // set size
-    if(ftruncate(fd, size) < 0)
-      throw std::runtime_error("ftruncate failed.");
-
-    // map memory
-    mem = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
-    if(mem == MAP_FAILED) // NOLINT
-      throw std::runtime_error("mmap failed.");
-  }
-
-  ~shared_mem_t() noexcept
-  {
-    if(fd)
-      {
-        if(munmap(mem, len) < 0)
-          std::cerr << "munmap failed.";
-        if(close(fd) < 0)
-          std::cerr << "close failed.";
-        if(shm_unlink(name.c_str()) < 0)
-          std::cerr << "shm_unlink failed";
-      }
-  }
-
-  int get_fd() const
-  {
-    return fd;
-  }
-
-  void *get_mem()
-  {
-    return mem;
-  }
-};
-
 // example Wayland client
 class example
 {
@@ -144,14 +72,12 @@ private:
   xdg_toplevel_t xdg_toplevel;
   pointer_t pointer;
   keyboard_t keyboard;
-  callback_t frame_cb;
   cursor_image_t cursor_image;
   buffer_t cursor_buffer;
   surface_t cursor_surface;
 
-  std::shared_ptr<shared_mem_t> shared_mem;
-  std::array<buffer_t, 2> buffer;
-  int cur_buf;
+  shm_allocator_t allocator;
+  swapchain_t swapchain;
 
   bool running;
   bool has_pointer;
@@ -195,23 +121,17 @@ private:
       }
 
     // draw stuff
-    uint32_t pixel = (0x80 << 24)
+    uint32_t color = (0x80 << 24)
       | (static_cast<uint32_t>(r * 255.0) << 16)
       | (static_cast<uint32_t>(g * 255.0) << 8)
       | static_cast<uint32_t>(b * 255.0);
 
-    std::fill_n(static_cast<uint32_t*>(shared_mem->get_mem())+cur_buf*320*240, 320*240, pixel);
-    surface.attach(buffer.at(cur_buf), 0, 0);
-    surface.damage(0, 0, 320, 240);
-    if(!cur_buf)
-      cur_buf = 1;
-    else
-      cur_buf = 0;
+    // wait for a buffer the compositor is done with
+    shm_buffer_t buffer = swapchain.acquire();
+    pixel::fill(buffer, color);
 
-    // schedule next draw
-    frame_cb = surface.frame();
-    frame_cb.on_done() = bind_mem_fn(&example::draw, this);
-    surface.commit();
+    // attach, damage and commit, the next draw is scheduled by on_frame
+    swapchain.present(buffer);
   }
 
 public:
@@ -280,14 +200,13 @@ public:
     keyboard = seat.get_keyboard();
 
     // create shared memory
-    shared_mem = std::make_shared<shared_mem_t>(2*320*240*4);
-    auto pool = shm.create_pool(shared_mem->get_fd(), 2*320*240*4);
-    for(unsigned int c = 0; c < 2; c++)
-      buffer.at(c) = pool.create_buffer(c*320*240*4, 320, 240, 320*4, shm_format::argb8888);
-    cur_buf = 0;
+    allocator = shm_allocator_t(shm, 2*320*240*4);
+    swapchain = swapchain_t(display, surface, allocator, 2);
+    swapchain.resize(320, 240, shm_format::argb8888);
+    swapchain.on_frame() = bind_mem_fn(&example::draw, this);
 
     // load cursor theme
-    cursor_theme_t cursor_theme = cursor_theme_t("default", 16, shm);
+    shared_cursor_theme_t cursor_theme = cursor_theme_cache_t::get("default", 16, shm);
     cursor_t cursor = cursor_theme.get_cursor("cross");
     cursor_image = cursor.image(0);
     cursor_buffer = cursor_image.get_buffer();
@@ -333,6 +252,10 @@ public:
     running = true;
     while(running)
       display.dispatch();
+
+    swapchain_stats_t stats = swapchain.stats();
+    std::cout << stats.presented << " frames presented, waited for a free buffer "
+              << stats.starved << " times." << std::endl;
   }
 };
 
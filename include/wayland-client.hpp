@@ -28,7 +28,10 @@
 
 /** \file */
 
+#include <array>
 #include <atomic>
+#include <chrono>
+#include <cstdint>
 #include <functional>
 #include <memory>
 #include <string>
@@ -55,6 +58,55 @@ namespace wayland
    */
   void set_log_handler(log_handler handler);
 
+  /** \brief Log message of the C library, see set_async_log_handler()
+   */
+  struct log_record_t
+  {
+    /// Maximum length of a message, longer ones are truncated
+    static constexpr std::size_t max_length = 480;
+
+    /// Time the message was logged
+    std::chrono::system_clock::time_point time;
+    /// Length of the message without the terminating NUL
+    uint32_t length = 0;
+    /// Whether the message was longer than max_length
+    bool truncated = false;
+    /// NUL terminated message
+    char message[max_length + 1] = {};
+  };
+
+  /** \brief Log C library messages asynchronously
+   *
+   * Instead of calling a handler on the thread that logs, while the C
+   * library may hold locks, every message is formatted into a thread
+   * local buffer and pushed into a lock free queue without allocating.
+   * The application drains the queue with read_log_record() whenever it
+   * suits it. If the queue is full, e.g. during a storm of protocol
+   * errors, messages are dropped and counted instead of stalling the
+   * thread that logs.
+   *
+   * Calling set_log_handler() switches back to synchronous logging.
+   *
+   * \param capacity Number of records the queue holds, rounded up to a
+   *                 power of two. The queue is created by the first call,
+   *                 later calls keep its capacity.
+   */
+  void set_async_log_handler(std::size_t capacity = 1024);
+
+  /** \brief Take the oldest record from the asynchronous log queue
+   *
+   * May be called from any thread.
+   *
+   * \param record Receives the record
+   * \return Whether there was a record
+   */
+  bool read_log_record(log_record_t &record);
+
+  /** \brief Number of asynchronous log records dropped because the queue
+   *         was full
+   */
+  uint64_t dropped_log_records();
+
   /** \brief A queue for proxy_t object events.
 
       Event queues allows the events on a display to be handled in a
@@ -78,16 +130,7 @@ namespace wayland
   namespace detail
   {
     struct proxy_data_t;
-    // base class for event listener storage.
-    struct events_base_t
-    {
-      events_base_t() = default;
-      events_base_t(const events_base_t&) = default;
-      events_base_t(events_base_t&&) noexcept = default;
-      events_base_t& operator=(const events_base_t&) = default;
-      events_base_t& operator=(events_base_t&&) noexcept = default;
-      virtual ~events_base_t() noexcept = default;
-    };
+    struct display_stats_t;
   }
 
   /** \brief Represents a protocol object on the client side.
@@ -150,6 +193,7 @@ namespace wayland
     wrapper_type type = wrapper_type::standard;
     friend class detail::argument_t;
     friend struct detail::proxy_data_t;
+    friend class display_t;
 
     // Interface desctiption filled in by the each interface class
     const wl_interface *interface = nullptr;
@@ -164,7 +208,25 @@ namespace wayland
 
     // marshal request
     proxy_t marshal_single(uint32_t opcode, const wl_interface *interface,
-                           const std::vector<detail::argument_t>& args, std::uint32_t version = 0);
+                           const detail::argument_vector& args, std::uint32_t version = 0);
+    proxy_t marshal_single(uint32_t opcode, const wl_interface *interface,
+                           wl_argument *args, std::uint32_t version = 0);
+
+    // record a request with the tracer
+    void trace_request(uint32_t opcode, wl_argument *args);
+
+    // marshal a request described by interface traits with arguments on the stack
+    template <typename message, typename...T>
+    proxy_t marshal_message(const wl_interface *interface, std::uint32_t version, const T& ...args)
+    {
+      static_assert(detail::signature_matcher<T...>::matches(message::signature),
+                    "Argument types do not match the signature of the request.");
+      std::array<detail::argument_t, sizeof...(T)> a = {{ detail::argument_t(args)... }};
+      std::array<wl_argument, sizeof...(T)> v;
+      for(std::size_t c = 0; c < a.size(); c++)
+        v[c] = a[c].get_c_argument();
+      return marshal_single(message::opcode, interface, v.data(), version);
+    }
 
   protected:
     void set_interface(const wl_interface *iface);
@@ -181,7 +243,7 @@ namespace wayland
     template <typename...T>
     void marshal(uint32_t opcode, const T& ...args)
     {
-      std::vector<detail::argument_t> v = { detail::argument_t(args)... };
+      detail::argument_vector v({ detail::argument_t(args)... }, detail::allocator<detail::argument_t>(allocation_category::arguments));
       marshal_single(opcode, nullptr, v);
     }
 
@@ -190,7 +252,7 @@ namespace wayland
     proxy_t marshal_constructor(uint32_t opcode, const wl_interface *interface,
                                 const T& ...args)
     {
-      std::vector<detail::argument_t> v = { detail::argument_t(args)... };
+      detail::argument_vector v({ detail::argument_t(args)... }, detail::allocator<detail::argument_t>(allocation_category::arguments));
       return marshal_single(opcode, interface, v);
     }
 
@@ -199,17 +261,51 @@ namespace wayland
     proxy_t marshal_constructor_versioned(uint32_t opcode, const wl_interface *interface,
                                           uint32_t version, const T& ...args)
     {
-      std::vector<detail::argument_t> v = { detail::argument_t(args)... };
+      detail::argument_vector v({ detail::argument_t(args)... }, detail::allocator<detail::argument_t>(allocation_category::arguments));
       return marshal_single(opcode, interface, v, version);
     }
 
+    // The following variants take the request as a message of
+    // detail::interface_traits. The argument types are checked against
+    // the signature of the request at compile time.
+
+    // marshal a request, that doesn't lead a new proxy
+    template <typename message, typename...T>
+    void marshal(const T& ...args)
+    {
+      marshal_message<message>(nullptr, 0, args...);
+    }
+
+    // marshal a request that leads to a new proxy with inherited version
+    template <typename message, typename...T>
+    proxy_t marshal_constructor(const wl_interface *interface, const T& ...args)
+    {
+      return marshal_message<message>(interface, 0, args...);
+    }
+
+    // marshal a request that leads to a new proxy with specific version
+    template <typename message, typename...T>
+    proxy_t marshal_constructor_versioned(const wl_interface *interface, uint32_t version, const T& ...args)
+    {
+      return marshal_message<message>(interface, version, args...);
+    }
+
     // Set the opcode for destruction of the proxy
     void set_destroy_opcode(uint32_t destroy_opcode);
 
     /*
       Sets the dispatcher and its user data. User data must be an
       instance of a class derived from events_base_t, allocated with
-      new. Will automatically be deleted upon destruction.
+      a detail::allocator of allocation_category::events. Will
+      automatically be deleted upon destruction.
+    */
+    void set_events(std::shared_ptr<detail::events_base_t> events,
+                    int(*dispatcher)(uint32_t, const detail::any_vector&, const std::shared_ptr<detail::events_base_t>&));
+
+    /*
+      Same for dispatchers written before the arguments were passed as
+      detail::any_vector. The arguments are copied into a std::vector for
+      every event, so generated code uses the overload above.
     */
     void set_events(std::shared_ptr<detail::events_base_t> events,
                     int(*dispatcher)(uint32_t, const std::vector<detail::any>&, const std::shared_ptr<detail::events_base_t>&));
@@ -313,6 +409,12 @@ namespace wayland
     */
     void set_queue(event_queue_t queue);
 
+    /** \brief Get the event queue of a proxy
+        \return The queue assigned with set_queue() or inherited from the
+                factory proxy, an empty event_queue_t for the main queue
+    */
+    event_queue_t get_queue() const;
+
     /** \brief Get a pointer to the underlying C struct.
      *  \return The underlying wl_proxy wrapped by this proxy_t if it exists,
      *          otherwise an exception is thrown
@@ -414,6 +516,62 @@ namespace wayland
   class callback_t;
   class registry_t;
 
+  /** \brief Statistics of one request or event of an interface
+
+      See display_t::stats().
+  */
+  struct message_stats_t
+  {
+    /// Name of the interface, e.g. "wl_surface"
+    std::string interface;
+    /// Name of the request or event, empty if unknown
+    std::string message;
+    uint32_t opcode = 0;
+    /// Whether this is an event, otherwise a request
+    bool event = false;
+    /// Number of requests sent or events received
+    uint64_t count = 0;
+    /// Size on the wire in bytes, without file descriptors
+    uint64_t bytes = 0;
+    /// Time spent in the event handlers
+    std::chrono::nanoseconds handler_time{0};
+  };
+
+  /** \brief Memory used by the live proxies of one interface
+
+      See display_t::memory_report().
+  */
+  struct interface_memory_t
+  {
+    /// Name of the interface, e.g. "wl_surface", empty for the total
+    std::string interface;
+    /// Number of live proxies, including proxy wrappers
+    uint64_t proxies = 0;
+    /// Bytes of the per proxy bookkeeping of the library
+    uint64_t proxy_data_bytes = 0;
+    /// Bytes of the event handler storage, including the inline storage
+    /// of the std::function objects
+    uint64_t events_bytes = 0;
+    /// Number of event handlers that are set
+    uint64_t handlers = 0;
+    /// Size of the shm pools in bytes, only for wl_shm_pool
+    uint64_t shm_pool_bytes = 0;
+  };
+
+  /** \brief Memory used by the live proxies of a display
+   */
+  struct memory_report_t
+  {
+    /// One entry per interface with live proxies, sorted by name
+    std::vector<interface_memory_t> interfaces;
+    /// Sum of all interfaces
+    interface_memory_t total;
+
+    /** \brief Format the report as a tab separated table with a header
+     */
+    std::string to_string() const;
+  };
+
   /** \brief Represents a connection to the compositor and acts as a
       proxy to the display singleton object.
 
@@ -762,6 +920,69 @@ namespace wayland
     /** \brief create proxy wrapper for this display
     */
     display_t proxy_create_wrapper();
+
+    /** \brief Enable or disable collecting message statistics
+
+        Statistics are disabled by default. While enabled, every request
+        sent and every event received on this display, including its
+        proxy wrappers and all objects created from it, is counted per
+        interface and opcode, together with its size and the time spent in
+        the event handler. Counters are kept per thread, so sending and
+        dispatching from several threads does not contend.
+    */
+    void set_stats_enabled(bool enabled);
+
+    /** \brief Check whether message statistics are collected
+     */
+    bool stats_enabled() const;
+
+    /** \brief Get a snapshot of the message statistics
+        \return Statistics of every message that was sent or received at
+                least once, summed over all threads and sorted by
+                interface, direction and opcode
+    */
+    std::vector<message_stats_t> stats() const;
+
+    /** \brief Reset all message statistics to zero
+     */
+    void reset_stats();
+
+    /** \brief Get the roundtrip latency histogram
+
+        Records the time every roundtrip() and roundtrip_queue() took and
+        the time from every sync() request to the done event of its
+        callback. Latencies are recorded permanently, the returned
+        histogram is updated in place.
+    */
+    latency_histogram_t roundtrip_latency() const;
+
+    /** \brief Get the frame latency histogram of all surfaces
+
+        Records the time from committing a surface to the done event of the
+        frame callbacks requested before that commit.
+    */
+    latency_histogram_t frame_latency() const;
+
+    /** \brief Get the frame latency histogram of one surface
+        \param surface Surface created from this display
+        \return Histogram updated in place, or an empty one if the surface
+                has not requested a frame callback yet
+    */
+    latency_histogram_t frame_latency(const proxy_t &surface) const;
+
+    /** \brief Report the memory used by the live proxies of this display
+        \return Counts and sizes per interface
+
+        Walks all proxies created from this display, including proxy
+        wrappers and objects created by events. Captures of handlers that
+        do not fit into the inline storage of std::function are allocated
+        separately and not included. The sizes of shm pools are taken from
+        wl_shm.create_pool and wl_shm_pool.resize, so they cover pools of
+        shm_allocator_t and of any other code. Like setting handlers, this
+        must not run concurrently with threads that modify the proxies.
+        Returns an empty report for foreign displays.
+    */
+    memory_report_t memory_report() const;
   };
 }
 
@@ -26,6 +26,7 @@
 #ifndef CURSOR_HPP
 #define CURSOR_HPP
 
+#include <cstddef>
 #include <memory>
 #include <string>
 #include <wayland-cursor.h>
@@ -34,6 +35,12 @@
 
 namespace wayland
 {
+  namespace detail
+  {
+    struct shared_cursor_theme_data_t;
+    struct cursor_animator_data_t;
+  }
+
   class cursor_image_t : public detail::basic_wrapper<wl_cursor_image>
   {
   private:
@@ -76,6 +83,167 @@ namespace wayland
     cursor_theme_t(const std::string& name, int size, const shm_t& shm);
     cursor_t get_cursor(const std::string& name) const;
   };
+
+  /** \brief Cursor theme shared through the cursor_theme_cache_t
+
+      Loading a cursor theme rasterizes all of its cursors into a new shm
+      pool. A shared_cursor_theme_t defers this until a cursor is actually
+      requested with get_cursor(), so themes obtained for outputs or seats
+      that never show a cursor cost nothing. Cursors that have been looked
+      up once are remembered.
+
+      All handles obtained from the cache for the same theme name, pixel
+      size and shm_t refer to the same theme, which is destroyed when the
+      last handle and the last cursor_t or cursor_image_t taken from it
+      are gone.
+  */
+  class shared_cursor_theme_t
+  {
+  private:
+    std::shared_ptr<detail::shared_cursor_theme_data_t> data;
+
+    shared_cursor_theme_t(std::shared_ptr<detail::shared_cursor_theme_data_t> d);
+    friend class cursor_theme_cache_t;
+
+  public:
+    shared_cursor_theme_t() = default;
+
+    /** \brief Get a cursor, loading the theme if necessary
+        \param name Name of the cursor, e.g. "left_ptr"
+        \exception std::runtime_error if the theme can not be loaded or
+                   does not contain the cursor
+    */
+    cursor_t get_cursor(const std::string& name) const;
+
+    /** \brief Get the underlying theme, loading it if necessary
+     */
+    cursor_theme_t get_theme() const;
+
+    /** \brief Check whether the theme has been loaded
+     */
+    bool is_loaded() const;
+
+    /** \brief Name of the theme, empty for the default theme
+     */
+    std::string name() const;
+
+    /** \brief Size of the cursors in pixels
+     */
+    int size() const;
+
+    /** \brief Check whether this handle refers to a theme
+     */
+    operator bool() const;
+  };
+
+  /** \brief Process wide cache of cursor themes
+
+      Clients with several seats or outputs would otherwise load the same
+      cursor theme once per seat and output scale. The cache hands out
+      shared handles instead, keyed by theme name, pixel size and shm_t.
+      It only keeps weak references, so a theme that is no longer used is
+      unloaded. The cache may be used from several threads.
+  */
+  class cursor_theme_cache_t
+  {
+  public:
+    /** \brief Get a theme
+        \param name Name of the theme, empty for the default theme
+        \param size Size of the cursors in logical pixels
+        \param shm The wl_shm global used to create the buffers
+        \param scale Output scale, the theme is loaded with size * scale
+                     pixels
+    */
+    static shared_cursor_theme_t get(const std::string& name, int size, const shm_t& shm, int scale = 1);
+
+    /** \brief Number of themes currently in use
+     */
+    static std::size_t size();
+  };
+
+  /** \brief Animates a cursor on a surface owned by the animator
+
+      wl_cursor animations are a list of images, each shown for
+      cursor_image_t::delay() milliseconds. The animator precomputes the
+      timeline of a cursor once in set_cursor(), attaches the image for the
+      current point of the timeline to its cursor surface and arms a
+      timerfd for the next image change. Cursors with a single image or no
+      delay never arm the timer.
+
+      The pointer focus has to be forwarded with enter() and leave() from
+      the pointer_t event handlers. While the pointer is not over one of
+      our surfaces the timer is disarmed, so an animated cursor costs no
+      CPU time while it is not visible.
+
+      The timer is integrated into the main loop by polling get_fd() next
+      to the display fd and calling dispatch() when it becomes readable.
+  */
+  class cursor_animator_t
+  {
+  private:
+    std::shared_ptr<detail::cursor_animator_data_t> data;
+
+  public:
+    cursor_animator_t() = default;
+
+    /** \brief Create an animator
+        \param compositor Compositor used to create the cursor surface
+        \param pointer Pointer whose cursor is set
+        \exception std::system_error if the timerfd can not be created
+    */
+    cursor_animator_t(compositor_t &compositor, const pointer_t &pointer);
+
+    /** \brief Set the cursor to animate
+        The animation restarts with the first image. If the pointer is over
+        one of our surfaces, the cursor is shown immediately.
+    */
+    void set_cursor(const cursor_t &cursor);
+
+    /** \brief Get the current cursor
+     */
+    cursor_t get_cursor() const;
+
+    /** \brief Set the buffer scale of the cursor surface
+        For cursors loaded with size * scale pixels on a HiDPI output.
+    */
+    void set_scale(int32_t scale);
+
+    /** \brief The pointer entered one of our surfaces
+        \param serial Serial of the wl_pointer.enter event
+    */
+    void enter(uint32_t serial);
+
+    /** \brief The pointer left our surfaces
+        Stops the animation until the next enter().
+    */
+    void leave();
+
+    /** \brief Check whether the pointer is over one of our surfaces
+     */
+    bool is_entered() const;
+
+    /** \brief Check whether the timer is armed
+     */
+    bool is_animating() const;
+
+    /** \brief Get the file descriptor of the animation timer
+        The fd becomes readable when the next image is due.
+    */
+    int get_fd() const;
+
+    /** \brief Show the image that is due and rearm the timer
+        Does nothing if the timer has not expired yet.
+    */
+    void dispatch();
+
+    /** \brief Get the cursor surface
+     */
+    surface_t get_surface() const;
+
+    /** \brief Check whether this handle refers to an animator
+     */
+    operator bool() const;
+  };
 }
 
 #endif
@@ -0,0 +1,207 @@
+/*
+ * Copyright (c) 2014-2019, Nils Christopher Brause, Philipp Kerling
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef WAYLAND_DAMAGE_HPP
+#define WAYLAND_DAMAGE_HPP
+
+/** \file */
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <wayland-client.hpp>
+
+namespace wayland
+{
+  /** \brief Axis aligned rectangle in buffer coordinates
+   */
+  struct rect_t
+  {
+    int32_t x = 0;
+    int32_t y = 0;
+    int32_t width = 0;
+    int32_t height = 0;
+
+    rect_t() = default;
+    rect_t(int32_t x, int32_t y, int32_t width, int32_t height)
+      : x(x), y(y), width(width), height(height)
+    {
+    }
+
+    /** \brief Check whether the rectangle covers no pixels
+     */
+    bool empty() const
+    {
+      return width <= 0 || height <= 0;
+    }
+
+    /** \brief Number of pixels covered by the rectangle
+     */
+    int64_t area() const
+    {
+      return empty() ? 0 : static_cast<int64_t>(width) * height;
+    }
+
+    /** \brief Intersection of two rectangles, empty if they do not overlap
+     */
+    rect_t intersected(const rect_t &r) const;
+
+    /** \brief Smallest rectangle containing both rectangles
+     */
+    rect_t united(const rect_t &r) const;
+
+    /** \brief Check whether r lies completely inside this rectangle
+     */
+    bool contains(const rect_t &r) const;
+
+    bool operator==(const rect_t &r) const
+    {
+      return x == r.x && y == r.y && width == r.width && height == r.height;
+    }
+
+    bool operator!=(const rect_t &r) const
+    {
+      return !(*this == r);
+    }
+  };
+
+  /** \brief Accumulates damaged rectangles of a surface
+
+      Damage is collected with add() while drawing and turned into
+      wl_surface.damage_buffer requests with apply() right before the
+      surface is committed. Instead of sending one request per rectangle,
+      the tracker keeps a small set of rectangles. A new rectangle is
+      merged with an existing one if the pixels the merged rectangle
+      covers in addition cost less than the request it saves, as weighed
+      by the request cost. If there are still more rectangles than the
+      limit, the pair whose merge adds the fewest pixels is merged until
+      the limit is met. The number of requests per commit is thus
+      bounded, while the damaged area stays close to what was actually
+      drawn.
+
+      With a request cost of 0 and no rectangle limit, merging is
+      lossless, i.e. the rectangles describe exactly the area that was
+      added. Such a tracker can describe an opaque region, see
+      create_region().
+  */
+  class damage_tracker_t
+  {
+  private:
+    std::vector<rect_t> rects;
+    rect_t bounds;
+    std::size_t max_rects = 0;
+    int64_t request_cost = 0;
+    int32_t scale = 1;
+
+    // Number of pixels a merge of a and b covers that neither of them does
+    static int64_t merge_cost(const rect_t &a, const rect_t &b);
+    void merge(rect_t r);
+    void limit();
+
+  public:
+    /** \brief Default maximum number of rectangles per commit
+     */
+    static constexpr std::size_t default_max_rects = 16;
+
+    /** \brief Default cost of a request, in pixels
+     */
+    static constexpr int64_t default_request_cost = 64 * 64;
+
+    /** \brief Create a damage tracker
+        \param max_rects Maximum number of rectangles, 0 for no limit
+        \param request_cost Cost of a damage request in pixels. Two
+                            rectangles are merged if that covers at most
+                            this many additional pixels.
+    */
+    damage_tracker_t(std::size_t max_rects = default_max_rects,
+                     int64_t request_cost = default_request_cost);
+
+    /** \brief Clip all damage to a buffer of the given size
+        \param width Buffer width, 0 for no clipping
+        \param height Buffer height, 0 for no clipping
+    */
+    void set_bounds(int32_t width, int32_t height);
+
+    /** \brief Set the buffer scale of the surface
+
+        Only needed for surfaces that do not support damage_buffer, whose
+        damage has to be posted in surface coordinates.
+    */
+    void set_buffer_scale(int32_t buffer_scale);
+
+    /** \brief Add a damaged rectangle in buffer coordinates
+     */
+    void add(const rect_t &rect);
+
+    /** \brief Add a damaged rectangle in buffer coordinates
+     */
+    void add(int32_t x, int32_t y, int32_t width, int32_t height);
+
+    /** \brief Damage everything inside the bounds
+
+        \exception std::logic_error if no bounds are set
+    */
+    void add_all();
+
+    /** \brief Forget all damage
+     */
+    void clear();
+
+    /** \brief Check whether there is any damage
+     */
+    bool empty() const;
+
+    /** \brief Get the current set of rectangles
+     */
+    const std::vector<rect_t> &get_rects() const;
+
+    /** \brief Number of damaged pixels, counting overlaps once per
+               rectangle
+     */
+    int64_t area() const;
+
+    /** \brief Post the damage to a surface and clear it
+        \param surface Surface whose next commit is damaged
+        \return Number of damage requests sent
+
+        Uses wl_surface.damage_buffer if the surface supports it and
+        wl_surface.damage with coordinates divided by the buffer scale
+        otherwise. Has to be called before surface.commit().
+    */
+    std::size_t apply(surface_t &surface);
+
+    /** \brief Create a region covering the current rectangles
+        \param compositor Compositor to create the region with
+
+        Useful for wl_surface.set_opaque_region and set_input_region.
+        The rectangles are converted to surface coordinates with the
+        buffer scale, rounding inwards so that a region never claims more
+        than was added.
+    */
+    region_t create_region(compositor_t &compositor) const;
+  };
+}
+
+#endif
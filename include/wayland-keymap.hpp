@@ -0,0 +1,145 @@
+/*
+ * Copyright (c) 2014-2019, Nils Christopher Brause, Philipp Kerling
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef WAYLAND_KEYMAP_HPP
+#define WAYLAND_KEYMAP_HPP
+
+/** \file */
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <typeindex>
+#include <typeinfo>
+#include <wayland-client-protocol.hpp>
+
+namespace wayland
+{
+  namespace detail
+  {
+    struct keymap_data_t;
+  }
+
+  /** \brief Immutable view of a keymap received with keyboard_t::on_keymap()
+
+      The keymap is mapped read-only and shared by all handles obtained from
+      the keymap_cache_t for the same content. It is unmapped when the last
+      handle is gone.
+  */
+  class keymap_t
+  {
+  private:
+    std::shared_ptr<detail::keymap_data_t> data;
+
+    keymap_t(std::shared_ptr<detail::keymap_data_t> d);
+    friend class keymap_cache_t;
+
+    std::shared_ptr<void> compiled(const std::type_index &type, const std::function<std::shared_ptr<void>()> &compile) const;
+
+  public:
+    keymap_t() = default;
+
+    /** \brief Format of the keymap
+     */
+    keyboard_keymap_format format() const;
+
+    /** \brief Keymap text
+        For xkb_v1 keymaps, this is a NUL terminated string.
+    */
+    const char *get_data() const;
+
+    /** \brief Size of the keymap in bytes, including the terminating NUL
+     */
+    std::size_t size() const;
+
+    /** \brief Hash of the keymap contents
+     */
+    uint64_t hash() const;
+
+    /** \brief Get the compiled form of the keymap
+        The result of compile is stored with the keymap, so the keymap is
+        compiled only once per type no matter how many seats use it.
+        Concurrent callers wait for the first one to finish compiling.
+
+        E.g. with libxkbcommon:
+        \code
+        std::shared_ptr<xkb_keymap> xkb = keymap.compile<xkb_keymap>([ctx] (const keymap_t& k)
+          {
+            return std::shared_ptr<xkb_keymap>(xkb_keymap_new_from_buffer(ctx, k.get_data(), k.size() - 1,
+                                                                          XKB_KEYMAP_FORMAT_TEXT_V1,
+                                                                          XKB_KEYMAP_COMPILE_NO_FLAGS),
+                                               xkb_keymap_unref);
+          });
+        \endcode
+        \param func Function creating the compiled keymap
+    */
+    template <typename T, typename F>
+    std::shared_ptr<T> compile(F func) const
+    {
+      return std::static_pointer_cast<T>(compiled(typeid(T), [this, &func] () -> std::shared_ptr<void>
+        {
+          return func(*this);
+        }));
+    }
+
+    /** \brief Check whether two handles refer to the same keymap
+     */
+    bool operator==(const keymap_t &k) const;
+    bool operator!=(const keymap_t &k) const;
+
+    /** \brief Check whether this handle refers to a keymap
+     */
+    operator bool() const;
+  };
+
+  /** \brief Process wide cache of keymaps
+
+      Each seat, and each reconnect, sends its own keymap fd, although the
+      keymaps are usually identical. The cache maps the fd and hands out a
+      shared keymap_t for keymaps with the same content, so they are kept
+      in memory and compiled only once. It only keeps weak references, so
+      a keymap that is no longer used is unmapped. The cache may be used
+      from several threads.
+  */
+  class keymap_cache_t
+  {
+  public:
+    /** \brief Get a keymap
+        Arguments are the ones of keyboard_t::on_keymap(). The fd is not
+        closed and may be closed right after the call.
+        \return The keymap, or an empty handle for
+                keyboard_keymap_format::no_keymap
+        \exception std::system_error if the fd can not be mapped
+    */
+    static keymap_t get(keyboard_keymap_format format, int fd, uint32_t size);
+
+    /** \brief Number of distinct keymaps currently in use
+     */
+    static std::size_t size();
+  };
+}
+
+#endif
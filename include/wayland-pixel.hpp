@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) 2014-2019, Nils Christopher Brause, Philipp Kerling
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef WAYLAND_PIXEL_HPP
+#define WAYLAND_PIXEL_HPP
+
+/** \file */
+
+#include <cstdint>
+#include <wayland-shm.hpp>
+
+namespace wayland
+{
+  /** \brief Pixel kernels for shm buffers
+
+      The functions in this namespace fill, copy, premultiply and convert
+      pixels of shm buffers. Fill, premultiply and conversion support
+      the formats argb8888, xrgb8888, abgr8888 and rgb565; copy_rect
+      supports every format with a whole number of bytes per pixel.
+
+      The kernels have SSE2, AVX2 and NEON implementations. The fastest
+      one supported by the CPU is selected at runtime, once per process.
+      All implementations produce bit identical results.
+
+      Strides are given in bytes. Colors are always given as argb8888
+      values, i.e. 0xAARRGGBB, and converted to the destination format.
+  */
+  namespace pixel
+  {
+    /** \brief Instruction set used by the kernels
+     */
+    enum class isa_t
+    {
+      generic,
+      sse2,
+      avx2,
+      neon
+    };
+
+    /** \brief Get the instruction set the kernels currently use
+     */
+    isa_t get_isa();
+
+    /** \brief Select the instruction set of the kernels
+        \param isa Instruction set to use
+        \return false if the CPU or the build does not support it, in which
+                case the selection is left unchanged
+
+        Mainly useful for benchmarks and for comparing the results of the
+        different implementations.
+    */
+    bool set_isa(isa_t isa);
+
+    /** \brief Check whether a format is supported by fill, premultiply
+               and convert
+     */
+    bool is_supported(shm_format format);
+
+    /** \brief Fill a rectangle with a color
+        \param dst First pixel of the rectangle
+        \param stride Stride of the destination
+        \param width Width of the rectangle in pixels
+        \param height Height of the rectangle in pixels
+        \param format Format of the destination
+        \param argb Color as argb8888
+        \exception std::invalid_argument if the format is not supported
+    */
+    void fill(void *dst, int32_t stride, int32_t width, int32_t height, shm_format format, uint32_t argb);
+
+    /** \brief Fill a whole buffer with a color
+     */
+    void fill(const shm_buffer_t &buffer, uint32_t argb);
+
+    /** \brief Copy a rectangle of pixels between buffers of the same format
+        \exception std::invalid_argument if the format does not have a
+                   whole number of bytes per pixel
+    */
+    void copy_rect(void *dst, int32_t dst_stride, const void *src, int32_t src_stride,
+                   int32_t width, int32_t height, shm_format format);
+
+    /** \brief Copy a rectangle between two buffers of the same format
+        \param dst Destination buffer
+        \param dst_x Destination x coordinate
+        \param dst_y Destination y coordinate
+        \param src Source buffer
+        \param src_rect Rectangle to copy from the source, clipped to both
+                        buffers
+    */
+    void copy_rect(const shm_buffer_t &dst, int32_t dst_x, int32_t dst_y,
+                   const shm_buffer_t &src, const rect_t &src_rect);
+
+    /** \brief Multiply the color channels with the alpha channel
+        \exception std::invalid_argument if the format has no alpha channel
+    */
+    void premultiply(void *pixels, int32_t stride, int32_t width, int32_t height, shm_format format);
+
+    /** \brief Convert pixels between formats
+
+        Converting from a format without alpha to one with alpha sets
+        alpha to opaque. Converting to rgb565 truncates the channels.
+        \exception std::invalid_argument if a format is not supported
+    */
+    void convert(void *dst, int32_t dst_stride, shm_format dst_format,
+                 const void *src, int32_t src_stride, shm_format src_format,
+                 int32_t width, int32_t height);
+  }
+}
+
+#endif
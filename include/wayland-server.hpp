@@ -0,0 +1,407 @@
+/*
+ * Copyright (c) 2014-2019, Nils Christopher Brause, Philipp Kerling
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef WAYLAND_SERVER_HPP
+#define WAYLAND_SERVER_HPP
+
+/** \file */
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+#include <wayland-version.hpp>
+#include <wayland-server-core.h>
+#include <wayland-util.hpp>
+
+namespace wayland
+{
+  /** \brief Server side bindings
+
+      The classes in this namespace wrap libwayland-server. Together with
+      the resource classes generated by wayland-scanner++ when run with
+      "-s on", they allow implementing (small) compositors in C++, e.g. an
+      in-process test compositor that clients connect to through a
+      socketpair() passed to wayland::display_t(int fd).
+  */
+  namespace server
+  {
+    class client_t;
+    class resource_t;
+
+    namespace detail
+    {
+      struct client_data_t;
+      struct resource_data_t;
+      struct global_data_t;
+    }
+
+    /** \brief Event loop of a server display
+
+        The event loop is owned by the display_t it was obtained from and
+        must not be used after that display has been destroyed.
+    */
+    class event_loop_t : public wayland::detail::basic_wrapper<wl_event_loop>
+    {
+      event_loop_t(wl_event_loop *loop);
+      friend class display_t;
+
+    public:
+      event_loop_t() = default;
+
+      /** \brief Get the file descriptor of the event loop
+          \return File descriptor that becomes readable when there are events
+          to be dispatched
+
+          This can be used to integrate the event loop into another main loop.
+      */
+      int get_fd() const;
+
+      /** \brief Wait for events and dispatch them
+          \param timeout Timeout in milliseconds, -1 waits indefinitely
+          \return Non-negative on success
+          \exception std::system_error on failure
+      */
+      int dispatch(int timeout = -1);
+
+      /** \brief Dispatch idle sources
+       */
+      void dispatch_idle();
+    };
+
+    /** \brief Represents the server side of a Wayland display.
+
+        A display_t is created with display_t::display_t(). Clients
+        connect to it either through a listening socket created with
+        add_socket() or add_socket_auto() or through an already connected
+        file descriptor passed to client_t::client_t(display_t&, int).
+
+        Copies of a display_t refer to the same display. The display is
+        destroyed together with all its clients once the last copy is gone.
+        Globals keep a reference to the display they were created on.
+    */
+    class display_t : public wayland::detail::refcounted_wrapper<wl_display>
+    {
+    public:
+      /** \brief Create a new server display
+       */
+      display_t();
+
+      /** \brief Get the event loop of the display
+       */
+      event_loop_t get_event_loop() const;
+
+      /** \brief Add a listening socket with a given name
+          \param name Name of the socket (relative to XDG_RUNTIME_DIR)
+          \exception std::runtime_error on failure
+      */
+      void add_socket(const std::string &name);
+
+      /** \brief Add a listening socket with an automatically chosen name
+          \return Name of the socket (e.g. "wayland-1")
+          \exception std::runtime_error on failure
+      */
+      std::string add_socket_auto();
+
+      /** \brief Run the event loop of the display until terminate() is
+          called
+      */
+      void run();
+
+      /** \brief Stop a running run()
+       */
+      void terminate();
+
+      /** \brief Send all queued events to the clients
+       */
+      void flush_clients();
+
+      /** \brief Get the last serial number
+       */
+      uint32_t get_serial() const;
+
+      /** \brief Get a new serial number
+       */
+      uint32_t next_serial();
+    };
+
+    /** \brief Represents a client connected to a server display
+
+        client_t objects are handles. The connection itself is owned by the
+        display and ends when the client disconnects, when it is destroyed
+        with destroy() or when the display is destroyed. Afterwards, all
+        copies of the handle are empty.
+    */
+    class client_t
+    {
+    private:
+      wl_client *client = nullptr;
+      detail::client_data_t *data = nullptr;
+
+      static void destroy_func(wl_listener *listener, void *data);
+
+    public:
+      client_t() = default;
+
+      /** \brief Create a client for an already connected file descriptor
+          \param display The display the client connects to
+          \param fd File descriptor of the connection, e.g. one end of a
+                    socketpair()
+
+          The display takes ownership of the file descriptor.
+      */
+      client_t(display_t &display, int fd);
+
+      /** \brief Wrap an existing wl_client
+       */
+      explicit client_t(wl_client *c);
+
+      client_t(const client_t &c);
+      client_t(client_t &&c) noexcept;
+      client_t &operator=(const client_t &c);
+      client_t &operator=(client_t &&c) noexcept;
+      ~client_t();
+
+      /** \brief Disconnect the client and destroy all its resources
+       */
+      void destroy();
+
+      /** \brief Send all queued events to the client
+       */
+      void flush();
+
+      /** \brief Get the credentials of the connected process
+       */
+      void get_credentials(pid_t &pid, uid_t &uid, gid_t &gid) const;
+
+      /** \brief Get the file descriptor of the connection
+       */
+      int get_fd() const;
+
+      /** \brief Report an out of memory condition to the client
+       */
+      void post_no_memory() const;
+
+      /** \brief Handler that is called when the client is destroyed
+       */
+      std::function<void()> &on_destroy();
+
+      /** \brief Get a pointer to the underlying C struct.
+       *  \return The underlying wl_client wrapped by this client_t if it
+       *          exists, otherwise an exception is thrown
+       */
+      wl_client *c_ptr() const;
+
+      /** \brief Check whether this handle refers to a connected client
+       */
+      bool client_has_object() const;
+
+      /** \brief Check whether this handle refers to a connected client
+       */
+      operator bool() const;
+
+      bool operator==(const client_t &right) const;
+      bool operator!=(const client_t &right) const;
+    };
+
+    /** \brief Represents a protocol object on the server side.
+
+        A resource_t is the server side counterpart of a client's
+        wayland::proxy_t. Requests of the client are delivered to the
+        handlers set with the on_XXX() functions of the generated resource
+        classes, events are sent with their send_XXX() functions.
+
+        Copies of a resource_t refer to the same resource. Resources are
+        destroyed when the client sends a destructor request, when destroy()
+        is called or when the client disconnects. Afterwards, all copies of
+        the handle are empty.
+    */
+    class resource_t
+    {
+    private:
+      wl_resource *resource = nullptr;
+      detail::resource_data_t *data = nullptr;
+
+      // universal dispatcher
+      static int c_dispatcher(const void *implementation, void *target,
+                              uint32_t opcode, const wl_message *message,
+                              wl_argument *args);
+
+      static void destroy_func(wl_listener *listener, void *data);
+
+      void init(wl_resource *r);
+
+    protected:
+      // Send an event
+      void send_event_array(bool post, uint32_t opcode, const std::vector<wayland::detail::argument_t>& args);
+
+      // send an event
+      // Valid types for args are the same as for proxy_t::marshal()
+      template <typename...T>
+      void send_event(bool post, uint32_t opcode, const T& ...args)
+      {
+        std::vector<wayland::detail::argument_t> v = { wayland::detail::argument_t(args)... };
+        send_event_array(post, opcode, v);
+      }
+
+      // Set the opcode of the destructor request of the resource
+      void set_destroy_opcode(uint32_t destroy_opcode);
+
+      /*
+        Sets the dispatcher and its user data. User data must be an
+        instance of a class derived from events_base_t. The resource keeps
+        it until it is destroyed.
+      */
+      void set_events(std::shared_ptr<wayland::detail::events_base_t> events,
+                      int(*dispatcher)(uint32_t, const wayland::detail::any_vector&, const std::shared_ptr<wayland::detail::events_base_t>&));
+
+      // Retrieve the previously set user data
+      std::shared_ptr<wayland::detail::events_base_t> get_events();
+
+    public:
+      /** \brief Construct an empty resource_t
+       */
+      resource_t() = default;
+
+      /** \brief Create a new resource
+          \param client Client that owns the resource
+          \param interface Interface of the resource
+          \param version Version of the interface
+          \param id Object id, 0 to allocate a new server side id
+      */
+      resource_t(const client_t &client, const wl_interface *interface, int version, uint32_t id);
+
+      /** \brief Wrap an existing wl_resource
+       */
+      explicit resource_t(wl_resource *r);
+
+      resource_t(const resource_t &r);
+      resource_t(resource_t &&r) noexcept;
+      resource_t &operator=(const resource_t &r);
+      resource_t &operator=(resource_t &&r) noexcept;
+      ~resource_t();
+
+      /** \brief Destroy the resource
+       */
+      void destroy();
+
+      /** \brief Post a protocol error to the client
+          \param code Error code, usually an entry of the error enum of the
+                      interface
+          \param msg Human readable error message
+
+          Protocol errors are fatal, the client will be disconnected.
+      */
+      void post_error(uint32_t code, const std::string &msg) const;
+
+      /** \brief Report an out of memory condition to the client
+       */
+      void post_no_memory() const;
+
+      /** \brief Get the id of the resource
+       */
+      uint32_t get_id() const;
+
+      /** \brief Get the client owning the resource
+       */
+      client_t get_client() const;
+
+      /** \brief Get the interface version of the resource
+       */
+      unsigned int get_version() const;
+
+      /** \brief Get the interface name of the resource
+       */
+      std::string get_class() const;
+
+      /** \brief Handler that is called when the resource is destroyed
+       */
+      std::function<void()> &on_destroy();
+
+      /** \brief Get a pointer to the underlying C struct.
+       *  \return The underlying wl_resource wrapped by this resource_t if it
+       *          exists, otherwise an exception is thrown
+       */
+      wl_resource *c_ptr() const;
+
+      /** \brief Check whether this handle refers to an existing resource
+       */
+      bool resource_has_object() const;
+
+      /** \brief Check whether this handle refers to an existing resource
+       */
+      operator bool() const;
+
+      bool operator==(const resource_t &right) const;
+      bool operator!=(const resource_t &right) const;
+    };
+
+    /** \brief Base class of the global classes generated by the scanner
+
+        A global is announced to all clients of a display until the last
+        copy of the global_base_t is destroyed. Clients binding it are
+        reported through the on_bind() handler of the generated
+        global_XXX_t classes.
+    */
+    class global_base_t
+    {
+    private:
+      std::shared_ptr<detail::global_data_t> data;
+
+      static void bind_func(wl_client *client, void *data, uint32_t version, uint32_t id);
+
+    public:
+      using binder_t = void(*)(const std::shared_ptr<wayland::detail::events_base_t>&, client_t, uint32_t, uint32_t);
+
+    protected:
+      global_base_t(display_t &display, const wl_interface *interface, int version,
+                    std::shared_ptr<wayland::detail::events_base_t> events, binder_t binder);
+
+      // Retrieve the user data
+      std::shared_ptr<wayland::detail::events_base_t> get_events();
+
+    public:
+      global_base_t() = default;
+
+      /** \brief Get a pointer to the underlying C struct.
+       */
+      wl_global *c_ptr() const;
+
+      /** \brief Check whether this handle refers to a global
+       */
+      bool global_has_object() const;
+
+      /** \brief Check whether this handle refers to a global
+       */
+      operator bool() const;
+    };
+  }
+}
+
+#include <wayland-server-protocol.hpp>
+
+#endif
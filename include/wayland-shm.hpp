@@ -0,0 +1,492 @@
+/*
+ * Copyright (c) 2014-2019, Nils Christopher Brause, Philipp Kerling
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef WAYLAND_SHM_HPP
+#define WAYLAND_SHM_HPP
+
+/** \file */
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <wayland-client.hpp>
+#include <wayland-damage.hpp>
+
+namespace wayland
+{
+  namespace detail
+  {
+    struct shm_allocator_data_t;
+    struct shm_buffer_data_t;
+    struct swapchain_data_t;
+  }
+
+  /** \brief Options of the memory backing shm pools
+   */
+  struct shm_backing_options_t
+  {
+    /** \brief Back the memory with huge pages
+
+        The memory file is created with MFD_HUGETLB. If no huge pages are
+        available, a regular memory file is used instead and transparent
+        huge pages are requested with madvise(MADV_HUGEPAGE).
+    */
+    bool huge_pages = false;
+
+    /** \brief Prefault the memory with MAP_POPULATE
+
+        This moves the cost of the page faults from the first access to
+        the allocation.
+    */
+    bool populate = false;
+
+    /** \brief Seal the memory file against shrinking
+
+        With F_SEAL_SHRINK, the compositor can rely on the file never
+        shrinking underneath its mapping. Ignored if the kernel does not
+        support sealing.
+    */
+    bool seal = false;
+  };
+
+  /** \brief Memory file for shm pools
+
+      A shm_backing_t is an anonymous memory file (memfd) together with a
+      mapping of it. The address range for the mapping is reserved up
+      front, so the backing can grow in place without moving or
+      remapping the memory that is already in use. The file descriptor can
+      be passed to shm_t::create_pool.
+  */
+  class shm_backing_t
+  {
+  private:
+    int fd = -1;
+    void *reservation = nullptr;
+    std::size_t reservation_len = 0;
+    uint8_t *mem = nullptr;
+    std::size_t len = 0;
+    std::size_t reserved_len = 0;
+    std::size_t granule = 0;
+    bool hugetlb = false;
+    shm_backing_options_t options;
+
+    bool create(std::size_t size, std::size_t reserve_size, bool use_hugetlb);
+    void map(std::size_t offset, std::size_t length);
+    void release();
+
+  public:
+    shm_backing_t() = default;
+    shm_backing_t(const shm_backing_t&) = delete;
+    shm_backing_t(shm_backing_t&&) noexcept;
+    shm_backing_t &operator=(const shm_backing_t&) = delete;
+    shm_backing_t &operator=(shm_backing_t&&) noexcept;
+    ~shm_backing_t() noexcept;
+
+    /** \brief Create a backing
+        \param size Initial size in bytes
+        \param reserve_size Size of the address range to reserve, i.e.
+                            the maximum size the backing can grow to
+        \param options Backing options
+        \exception std::system_error if the file can not be created or
+                   mapped
+    */
+    shm_backing_t(std::size_t size, std::size_t reserve_size = 0,
+                  const shm_backing_options_t &options = shm_backing_options_t());
+
+    /** \brief Grow the backing in place
+        \param size New minimum size in bytes, rounded up to get_page_size()
+        \return false if the size exceeds the reserved range
+        \exception std::system_error if the memory can not be mapped
+    */
+    bool grow(std::size_t size);
+
+    /** \brief Seal the file against any further size changes
+     */
+    void seal_size();
+
+    /** \brief Get the file descriptor of the memory file
+     */
+    int get_fd() const;
+
+    /** \brief Get a pointer to the mapped memory
+     */
+    void *get_mem() const;
+
+    /** \brief Get the current size in bytes
+     */
+    std::size_t get_size() const;
+
+    /** \brief Get the size of the reserved address range in bytes
+     */
+    std::size_t get_reserved_size() const;
+
+    /** \brief Get the page size of the backing
+     */
+    std::size_t get_page_size() const;
+
+    /** \brief Check whether the backing uses MFD_HUGETLB pages
+     */
+    bool uses_hugetlb() const;
+
+    /** \brief Check whether this object holds a memory file
+     */
+    operator bool() const;
+  };
+
+  /** \brief Buffer sub-allocated from the pools of a shm_allocator_t
+
+      shm_buffer_t objects are handles. When the last handle of a buffer is
+      destroyed, the buffer is handed back to its allocator, which keeps
+      it for reuse by a later allocation with the same geometry. Buffers
+      that are still in use by the compositor (see busy()) are only handed
+      back once their release event arrives, so their memory is never
+      reused while the compositor may still read from it.
+  */
+  class shm_buffer_t
+  {
+  private:
+    std::shared_ptr<detail::shm_buffer_data_t> data;
+
+    shm_buffer_t(std::shared_ptr<detail::shm_buffer_data_t> d);
+    friend class shm_allocator_t;
+
+  public:
+    shm_buffer_t() = default;
+
+    /** \brief Get the wl_buffer of this buffer
+     */
+    buffer_t &buffer() const;
+
+    /** \brief Get a pointer to the pixel data
+     */
+    void *pixels() const;
+
+    /** \brief Width of the buffer in pixels
+     */
+    int32_t width() const;
+
+    /** \brief Height of the buffer in pixels
+     */
+    int32_t height() const;
+
+    /** \brief Number of bytes between the beginning of two rows
+     */
+    int32_t stride() const;
+
+    /** \brief Pixel format of the buffer
+     */
+    shm_format format() const;
+
+    /** \brief Size of the pixel data in bytes
+     */
+    std::size_t size() const;
+
+    /** \brief Attach the buffer to a surface and mark it as busy
+        \param surface Surface to attach to
+        \param x Surface local x coordinate
+        \param y Surface local y coordinate
+
+        This is surface.attach(buffer(), x, y) plus mark_busy().
+    */
+    void attach(surface_t &surface, int32_t x = 0, int32_t y = 0);
+
+    /** \brief Mark the buffer as being used by the compositor
+
+        Needs to be called when the buffer is attached to a surface by
+        other means than attach(). The buffer stays busy until the
+        compositor sends the release event.
+    */
+    void mark_busy();
+
+    /** \brief Check whether the compositor may still read the buffer
+
+        The contents of a busy buffer must not be modified.
+    */
+    bool busy() const;
+
+    /** \brief Handler that is called when the compositor releases the
+               buffer
+
+        The release event itself is handled by the allocator, this handler
+        is called afterwards.
+    */
+    std::function<void()> &on_release();
+
+    /** \brief Check whether this handle refers to a buffer
+     */
+    operator bool() const;
+
+    bool operator==(const shm_buffer_t &right) const;
+    bool operator!=(const shm_buffer_t &right) const;
+  };
+
+  /** \brief Shared memory buffer allocator
+
+      The allocator sub-allocates buffers of arbitrary size from a small
+      number of wl_shm_pool objects. Each pool is backed by an anonymous
+      memory file whose mapping lives in a reserved range of the address
+      space. Pools grow in place with wl_shm_pool.resize, so neither the
+      existing memory nor the existing buffers are ever mapped again or
+      recreated. Only when the reserved range of a pool is exhausted, a
+      new pool is created.
+
+      Buffers whose last handle is gone are cached, keyed by their
+      geometry, and returned by subsequent allocations. This makes
+      resizing a window back and forth as cheap as flipping between
+      already created buffers.
+
+      Copies of a shm_allocator_t refer to the same allocator. Buffers keep
+      their memory alive, even if the allocator itself has been destroyed.
+      Like the rest of the library, the allocator is not thread safe and
+      has to be used from the thread that dispatches the events of the
+      shm_t.
+  */
+  class shm_allocator_t
+  {
+  private:
+    std::shared_ptr<detail::shm_allocator_data_t> data;
+
+  public:
+    /** \brief Default size of the address space reserved for each pool
+
+        1 GiB on 64 bit targets, 64 MiB on 32 bit targets, where a few
+        pools would otherwise exhaust the address space.
+     */
+    static constexpr std::size_t default_reserve_size = sizeof(void*) >= 8 ? std::size_t(1) << 30 : std::size_t(64) << 20;
+
+    /** \brief Alignment of the pixel data of each buffer in bytes
+     */
+    static constexpr std::size_t alignment = 64;
+
+    shm_allocator_t() = default;
+
+    /** \brief Create an allocator
+        \param shm The wl_shm global
+        \param initial_size Initial size of the first pool in bytes, 0
+                            to size the pool by the first allocation
+        \param reserve_size Size of the address space reserved for each
+                            pool, i.e. the maximum size it can grow to
+        \param options Options of the memory backing the pools
+        \exception std::system_error if the backing memory can not be
+                   created
+    */
+    shm_allocator_t(const shm_t &shm, std::size_t initial_size = 0,
+                    std::size_t reserve_size = default_reserve_size,
+                    const shm_backing_options_t &options = shm_backing_options_t());
+
+    /** \brief Allocate a buffer
+        \param width Width of the buffer in pixels
+        \param height Height of the buffer in pixels
+        \param format Pixel format of the buffer
+        \param stride Number of bytes between two rows, 0 to derive it
+                      from the width and the format
+        \return A buffer, either newly created or taken from the cache
+
+        Buffers taken from the cache keep their previous contents.
+        \exception std::invalid_argument if the geometry is invalid or
+                   the stride can not be derived from the format
+        \exception std::system_error if a pool could not be grown
+    */
+    shm_buffer_t allocate(int32_t width, int32_t height, shm_format format = shm_format::argb8888,
+                          int32_t stride = 0);
+
+    /** \brief Set the maximum number of unused buffers kept for reuse
+     */
+    void set_cache_size(std::size_t size);
+
+    /** \brief Destroy all unused cached buffers
+     */
+    void trim();
+
+    /** \brief Total size of all pools in bytes
+     */
+    std::size_t pool_size() const;
+
+    /** \brief Number of bytes currently allocated to buffers, including
+               cached ones
+     */
+    std::size_t allocated_size() const;
+
+    /** \brief Number of pools
+     */
+    std::size_t pool_count() const;
+
+    /** \brief Check whether this handle refers to an allocator
+     */
+    operator bool() const;
+  };
+
+  /** \brief Counters of a swapchain_t
+   */
+  struct swapchain_stats_t
+  {
+    /** \brief Number of buffers returned by swapchain_t::acquire()
+     */
+    uint64_t acquired = 0;
+
+    /** \brief Number of buffers committed by swapchain_t::present()
+     */
+    uint64_t presented = 0;
+
+    /** \brief Number of swapchain_t::acquire() calls that found all
+               buffers busy and had to wait for a release event
+     */
+    uint64_t starved = 0;
+
+    /** \brief Number of times the display was dispatched while waiting
+     */
+    uint64_t wait_dispatches = 0;
+
+    /** \brief Total time spent waiting for release events
+     */
+    std::chrono::steady_clock::duration wait_time = std::chrono::steady_clock::duration::zero();
+  };
+
+  /** \brief N-buffered shm swapchain of a surface
+
+      A swapchain_t cycles between 2 to 4 buffers of the same size, which
+      are allocated from a shm_allocator_t on demand. acquire() only ever
+      returns a buffer that the compositor has released, so drawing into
+      it never races with the compositor reading it. If all buffers are
+      busy, acquire() dispatches the default event queue of the display
+      until one is released and counts this as starvation in stats(). A
+      compositor that holds buffers for long thus costs throughput, but
+      never correctness.
+
+      present() attaches the buffer, damages it, requests a frame callback
+      and commits the surface. A typical render loop draws from
+      on_frame():
+
+          swapchain.on_frame() = [&] (uint32_t) { draw(); };
+          void draw()
+          {
+            shm_buffer_t buffer = swapchain.acquire();
+            render(buffer.pixels());
+            swapchain.present(buffer);
+          }
+
+      Copies of a swapchain_t refer to the same swapchain. While waiting
+      for a buffer, acquire() dispatches the event queue of the buffers,
+      so the swapchain also works on a separate event_queue_t.
+  */
+  class swapchain_t
+  {
+  private:
+    std::shared_ptr<detail::swapchain_data_t> data;
+
+    void commit(const shm_buffer_t &buffer, bool frame);
+
+  public:
+    /** \brief Minimum number of buffers
+     */
+    static constexpr unsigned int min_buffers = 2;
+
+    /** \brief Maximum number of buffers
+     */
+    static constexpr unsigned int max_buffers = 4;
+
+    swapchain_t() = default;
+
+    /** \brief Create a swapchain
+        \param display Display that is dispatched while waiting for buffers
+        \param surface Surface the buffers are presented on
+        \param allocator Allocator of the buffers
+        \param buffers Number of buffers, between min_buffers and
+                       max_buffers
+        \exception std::invalid_argument if the number of buffers is out of
+                   range
+    */
+    swapchain_t(display_t &display, const surface_t &surface, const shm_allocator_t &allocator,
+                unsigned int buffers = min_buffers);
+
+    /** \brief Set the size and format of the buffers
+        \param width Width in pixels
+        \param height Height in pixels
+        \param format Pixel format
+
+        Buffers of the previous size are given back to the allocator, which
+        keeps them for the case that the size changes back.
+    */
+    void resize(int32_t width, int32_t height, shm_format format = shm_format::argb8888);
+
+    /** \brief Get a buffer to draw into
+        \return A buffer that is not in use by the compositor
+
+        Until it is presented, the same buffer is returned by every call.
+        If all buffers are busy, the display is dispatched until one of
+        them is released.
+        \exception std::logic_error if resize() has not been called
+    */
+    shm_buffer_t acquire();
+
+    /** \brief Present a buffer
+        \param buffer Buffer returned by acquire()
+        \param frame Whether to request a frame callback, see on_frame()
+
+        Attaches the buffer, damages all of it (with
+        wl_surface.damage_buffer if the surface supports it) and commits
+        the surface.
+    */
+    void present(const shm_buffer_t &buffer, bool frame = true);
+
+    /** \brief Present a buffer with partial damage
+        \param buffer Buffer returned by acquire()
+        \param damage Damage since the last present, which is posted and
+                      cleared
+        \param frame Whether to request a frame callback, see on_frame()
+    */
+    void present(const shm_buffer_t &buffer, damage_tracker_t &damage, bool frame = true);
+
+    /** \brief Handler that is called when the compositor is ready for the
+               next frame
+     */
+    std::function<void(uint32_t)> &on_frame();
+
+    /** \brief Check whether a frame callback is outstanding
+     */
+    bool frame_pending() const;
+
+    /** \brief Number of buffers of the swapchain
+     */
+    unsigned int buffer_count() const;
+
+    /** \brief Get the counters of the swapchain
+     */
+    swapchain_stats_t stats() const;
+
+    /** \brief Check whether this handle refers to a swapchain
+     */
+    operator bool() const;
+  };
+
+  /** \brief Get the number of bytes per pixel of a shm format
+      \return Bytes per pixel, 0 for formats that are planar, subsampled
+              or unknown
+  */
+  unsigned int shm_format_bytes_per_pixel(shm_format format);
+}
+
+#endif
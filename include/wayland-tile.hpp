@@ -0,0 +1,175 @@
+/*
+ * Copyright (c) 2014-2019, Nils Christopher Brause, Philipp Kerling
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef WAYLAND_TILE_HPP
+#define WAYLAND_TILE_HPP
+
+/** \file */
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <wayland-damage.hpp>
+#include <wayland-shm.hpp>
+
+namespace wayland
+{
+  namespace detail
+  {
+    struct tile_renderer_data_t;
+  }
+
+  /** \brief Part of a buffer that is rendered by one call of the render
+             function of a tile_renderer_t
+   */
+  struct tile_t
+  {
+    /** \brief Position and size of the tile in buffer coordinates
+     */
+    rect_t rect;
+
+    /** \brief First pixel of the tile
+     */
+    uint8_t *data = nullptr;
+
+    /** \brief Stride of the buffer in bytes
+     */
+    int32_t stride = 0;
+
+    /** \brief Pixel format of the buffer
+     */
+    shm_format format = shm_format::argb8888;
+
+    /** \brief Get a pointer to the first pixel of a row of the tile
+        \param y Row relative to the tile
+     */
+    template <typename T = uint32_t>
+    T *row(int32_t y) const
+    {
+      return reinterpret_cast<T*>(data + static_cast<std::ptrdiff_t>(stride) * y);
+    }
+  };
+
+  /** \brief Renders buffers tile by tile on a thread pool
+
+      The buffer is divided into a grid of tiles, which are small enough
+      to stay in the cache of a core while they are rendered. Areas that
+      need to be redrawn are marked with invalidate(). render() then calls
+      the render function for every dirty tile, spread over all threads
+      of the pool, and waits until all tiles are done.
+
+      The renderer remembers which tiles of which buffer are up to date,
+      so that with a swapchain_t, where consecutive frames are rendered
+      into different buffers, each buffer only gets the tiles redrawn
+      that changed since it was last rendered into. Independently of that,
+      the tiles that changed since the previous frame are added to a
+      damage_tracker_t, which turns them into damage_buffer requests:
+
+          shm_buffer_t buffer = swapchain.acquire();
+          renderer.render(buffer, draw_tile, damage);
+          swapchain.present(buffer, damage);
+
+      The render function is called concurrently from several threads and
+      must only write to the pixels of the tile it is given. An exception
+      thrown by it stops the remaining tiles from being rendered and is
+      rethrown by render(). render() itself must only be called from one
+      thread at a time.
+  */
+  class tile_renderer_t
+  {
+  private:
+    std::shared_ptr<detail::tile_renderer_data_t> data;
+
+  public:
+    /** \brief Function that renders a tile
+     */
+    using render_func_t = std::function<void(const tile_t&)>;
+
+    /** \brief Default tile width in pixels
+     */
+    static constexpr int32_t default_tile_width = 128;
+
+    /** \brief Default tile height in pixels
+     */
+    static constexpr int32_t default_tile_height = 64;
+
+    tile_renderer_t() = default;
+
+    /** \brief Create a tile renderer
+        \param threads Number of threads rendering, including the one
+                       calling render(). 0 uses one thread per core.
+        \param tile_width Width of a tile in pixels
+        \param tile_height Height of a tile in pixels
+    */
+    tile_renderer_t(unsigned int threads, int32_t tile_width = default_tile_width,
+                    int32_t tile_height = default_tile_height);
+
+    /** \brief Mark an area as changed
+     */
+    void invalidate(const rect_t &rect);
+
+    /** \brief Mark everything as changed
+     */
+    void invalidate_all();
+
+    /** \brief Render the dirty tiles of a buffer
+        \param buffer Buffer to render into
+        \param func Function rendering a tile
+        \param damage Tracker the changed tiles are added to
+        \return Number of tiles rendered
+    */
+    std::size_t render(const shm_buffer_t &buffer, const render_func_t &func, damage_tracker_t &damage);
+
+    /** \brief Render the dirty tiles of a buffer
+        \param buffer Buffer to render into
+        \param func Function rendering a tile
+        \return Number of tiles rendered
+    */
+    std::size_t render(const shm_buffer_t &buffer, const render_func_t &func);
+
+    /** \brief Render the dirty tiles of plain memory
+        \param pixels First pixel of the image
+        \param width Width of the image in pixels
+        \param height Height of the image in pixels
+        \param stride Stride of the image in bytes
+        \param format Pixel format of the image
+        \param func Function rendering a tile
+        \param damage Tracker the changed tiles are added to, may be null
+        \return Number of tiles rendered
+    */
+    std::size_t render(void *pixels, int32_t width, int32_t height, int32_t stride, shm_format format,
+                       const render_func_t &func, damage_tracker_t *damage = nullptr);
+
+    /** \brief Number of threads rendering, including the calling one
+     */
+    unsigned int thread_count() const;
+
+    /** \brief Check whether this handle refers to a renderer
+     */
+    operator bool() const;
+  };
+}
+
+#endif
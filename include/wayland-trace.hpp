@@ -0,0 +1,192 @@
+/*
+ * Copyright (c) 2014-2019, Nils Christopher Brause, Philipp Kerling
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef WAYLAND_TRACE_HPP
+#define WAYLAND_TRACE_HPP
+
+/** \file */
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+struct wl_message;
+union wl_argument;
+
+namespace wayland
+{
+  /** \brief Binary trace file format
+
+      A trace file starts with a trace_file_header_t, followed by records.
+      Every record starts with a trace_record_t and is padded to a multiple
+      of 8 bytes. All values are in host byte order.
+
+      The payload of request and event records holds the arguments in the
+      order of the signature of the message:
+      - i, u, f, h: 4 bytes, the raw value, the fd number for h
+      - o, n: 4 bytes, the object id, 0 for null
+      - s, a: 4 bytes length of the original string (including the
+        terminating NUL, 0 for a null string) or array, followed by at most
+        trace_file_header_t::max_payload bytes of the data, padded to a
+        multiple of 4 bytes
+
+      The payload of interface records is the NUL terminated name of the
+      interface with the id given in trace_record_t::interface. It is
+      written before the first record using the id.
+  */
+  namespace trace
+  {
+    /** \brief Magic bytes at the start of a trace file
+     */
+    constexpr char magic[8] = {'W', 'L', 'P', 'P', 'T', 'R', 'C', '\0'};
+
+    /** \brief Version of the trace file format
+     */
+    constexpr uint32_t version = 1;
+
+    /** \brief Type of a trace record
+     */
+    enum class record_type : uint16_t
+      {
+        request = 0,
+        event = 1,
+        interface = 2,
+        padding = 3
+      };
+
+    /** \brief Header of a trace file
+     */
+    struct file_header_t
+    {
+      char magic[8];
+      uint32_t version;
+      /// Maximal number of bytes of a string or array that is recorded
+      uint32_t max_payload;
+      /// CLOCK_MONOTONIC time in nanoseconds when tracing was started
+      uint64_t start_time;
+      /// Number of bytes of records following the header
+      uint64_t size;
+    };
+
+    /** \brief Header of a trace record
+     */
+    struct record_t
+    {
+      /// CLOCK_MONOTONIC time in nanoseconds
+      uint64_t time;
+      /// Size of the record including this header
+      uint32_t size;
+      record_type type;
+      uint16_t opcode;
+      /// Id of the object the message was sent to or received by
+      uint32_t object;
+      /// Interface id, see record_type::interface
+      uint16_t interface;
+      /// Number of the thread that sent or dispatched the message
+      uint16_t thread;
+    };
+
+    static_assert(sizeof(file_header_t) == 32, "Unexpected trace file header size.");
+    static_assert(sizeof(record_t) == 24, "Unexpected trace record size.");
+  }
+
+  namespace detail
+  {
+    extern std::atomic<bool> trace_enabled;
+    void trace_message(trace::record_type type, void *proxy, const char *interface, uint32_t opcode,
+                       const char *signature, const wl_argument *args);
+  }
+
+  /** \brief Statistics of the tracer
+   */
+  struct trace_stats_t
+  {
+    /// Number of records written to the trace file
+    uint64_t records = 0;
+    /// Number of records lost because a ring buffer or the file was full
+    uint64_t dropped = 0;
+    /// Number of bytes written to the trace file
+    uint64_t bytes = 0;
+  };
+
+  /** \brief Binary protocol tracer
+
+      WAYLAND_DEBUG formats every message and writes it to stderr
+      synchronously, which is far too slow for production load. The tracer
+      instead records every request sent and every event dispatched as a
+      compact binary record, see trace::record_t. Records are written
+      into a lock-free ring buffer of the calling thread and copied to a
+      memory mapped file by a background thread. If a ring buffer is full,
+      records are dropped instead of blocking.
+
+      Tracing can be started and stopped at any time. While it is stopped,
+      the cost is a single branch per message.
+  */
+  class tracer_t
+  {
+  public:
+    /** \brief Default maximal size of the trace file
+     */
+    static constexpr std::size_t default_file_size = std::size_t(64) << 20;
+
+    /** \brief Default size of the ring buffer of each thread
+     */
+    static constexpr std::size_t default_ring_size = std::size_t(256) << 10;
+
+    /** \brief Start tracing into a file
+        An existing file is overwritten. When the file is full, further
+        records are dropped.
+        \param path Path of the trace file
+        \param file_size Maximal size of the trace file
+        \param ring_size Size of the ring buffer of each thread, rounded
+                         up to a power of two
+        \param max_payload Maximal number of bytes of a string or array
+                           argument that are recorded
+        \exception std::logic_error if tracing is already active
+        \exception std::system_error if the file can not be created
+    */
+    static void start(const std::string &path, std::size_t file_size = default_file_size,
+                      std::size_t ring_size = default_ring_size, uint32_t max_payload = 256);
+
+    /** \brief Stop tracing and close the trace file
+        Does nothing if tracing is not active.
+    */
+    static void stop();
+
+    /** \brief Check whether tracing is active
+     */
+    static bool active()
+    {
+      return detail::trace_enabled.load(std::memory_order_relaxed);
+    }
+
+    /** \brief Statistics of the current or last trace
+     */
+    static trace_stats_t stats();
+  };
+}
+
+#endif
@@ -0,0 +1,214 @@
+/*
+ * Copyright (c) 2014-2019, Nils Christopher Brause, Philipp Kerling
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef WAYLAND_TRANSFER_HPP
+#define WAYLAND_TRANSFER_HPP
+
+/** \file */
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <sys/types.h>
+
+namespace wayland
+{
+  namespace detail
+  {
+    struct transfer_data_t;
+    struct transfer_engine_data_t;
+  }
+
+  /** \brief A clipboard or drag and drop transfer in progress
+
+      Handles are returned by transfer_engine_t. The event handlers should
+      be set right after the transfer has been started; no data is moved
+      before the next call of transfer_engine_t::dispatch().
+  */
+  class transfer_t
+  {
+  private:
+    std::shared_ptr<detail::transfer_data_t> data;
+
+    transfer_t(std::shared_ptr<detail::transfer_data_t> d);
+    friend class transfer_engine_t;
+
+  public:
+    transfer_t() = default;
+
+    /** \brief Received data
+        Called with every chunk of a transfer started with
+        transfer_engine_t::receive() without a destination. The data is
+        only valid during the call.
+    */
+    std::function<void(const char*, std::size_t)> &on_data();
+
+    /** \brief The transfer has finished
+        Called once with an empty error code if all data has been
+        transferred, or with the error that ended the transfer.
+    */
+    std::function<void(std::error_code)> &on_done();
+
+    /** \brief Abort the transfer and close its file descriptors
+        on_done() is not called.
+    */
+    void cancel();
+
+    /** \brief Check whether the transfer has finished or was cancelled
+     */
+    bool done() const;
+
+    /** \brief Number of bytes transferred so far
+     */
+    uint64_t bytes() const;
+
+    /** \brief Check whether this handle refers to a transfer
+     */
+    operator bool() const;
+  };
+
+  /** \brief Moves clipboard and drag and drop payloads without blocking
+
+      data_offer_t::receive() and data_source_t::on_send() hand out pipes,
+      which are usually drained and filled with blocking read() and write()
+      calls in the event handler. Large payloads then stall the event loop
+      for as long as the other client takes to produce or consume them.
+
+      The engine makes all pipes non-blocking and moves data only when
+      they are ready. Sources backed by a file descriptor, e.g. a memfd
+      holding an image, are streamed into the pipe with splice(2) or
+      sendfile(2) without copying them through userspace. Received data is
+      either delivered in chunks or spliced directly into a file.
+
+      The engine is integrated into the main loop by polling get_fd() next
+      to the display fd and calling dispatch() when it becomes readable.
+      Transfers are progressed by at most one chunk per dispatch(), so the
+      event loop stays responsive during large transfers.
+
+      The engine is not thread safe.
+  */
+  class transfer_engine_t
+  {
+  private:
+    std::shared_ptr<detail::transfer_engine_data_t> data;
+
+    transfer_t add(int fd, std::shared_ptr<detail::transfer_data_t> transfer, bool output);
+
+  public:
+    /** \brief Transfer a source until its end
+     */
+    static constexpr std::size_t all = std::numeric_limits<std::size_t>::max();
+
+    /** \brief Create a transfer engine
+        \exception std::system_error if the epoll instance can not be
+                   created
+    */
+    transfer_engine_t();
+
+    /** \brief Set the maximal number of bytes moved per transfer and
+               dispatch()
+        The default is 64 KiB. Spliced transfers move 16 times as much, as
+        they do not touch the data.
+    */
+    void set_chunk_size(std::size_t size);
+
+    /** \brief Start receiving data
+        \param request Called with the write end of a new pipe, which has
+                       to be passed to the other client, e.g. with
+                       data_offer_t::receive(). It is closed afterwards.
+        \return The transfer, its data is delivered with
+                transfer_t::on_data()
+    */
+    transfer_t receive(const std::function<void(int)> &request);
+
+    /** \brief Start receiving data into a file descriptor
+        \param request See above
+        \param destination File descriptor the data is written to, it is
+                           not closed by the engine and has to stay open
+                           until the transfer is done. For regular files
+                           the data is spliced without copying it. If a
+                           non-blocking destination is full, the transfer
+                           waits for it to become writable.
+    */
+    transfer_t receive(const std::function<void(int)> &request, int destination);
+
+    /** \brief Start receiving an offer
+        Works with data_offer_t and the primary selection offers.
+    */
+    template <typename offer_type>
+    transfer_t receive(offer_type &offer, const std::string &mime_type)
+    {
+      return receive([&offer, &mime_type] (int fd) { offer.receive(mime_type, fd); });
+    }
+
+    /** \brief Start receiving an offer into a file descriptor
+     */
+    template <typename offer_type>
+    transfer_t receive(offer_type &offer, const std::string &mime_type, int destination)
+    {
+      return receive([&offer, &mime_type] (int fd) { offer.receive(mime_type, fd); }, destination);
+    }
+
+    /** \brief Start sending the contents of a file descriptor
+        \param fd Pipe from data_source_t::on_send(), the engine takes
+                  ownership and closes it when the transfer is done
+        \param source File or memfd to send, the engine keeps a duplicate
+                      of it, so it may be closed after this call
+        \param offset Offset in source to start at
+        \param length Number of bytes to send, or all to send until the
+                      end of source
+    */
+    transfer_t send(int fd, int source, off_t offset = 0, std::size_t length = all);
+
+    /** \brief Start sending a buffer
+        \param fd Pipe from data_source_t::on_send(), the engine takes
+                  ownership and closes it when the transfer is done
+        \param payload Data to send
+    */
+    transfer_t send(int fd, std::string payload);
+
+    /** \brief Get the epoll file descriptor of the engine
+        The fd becomes readable when a transfer can make progress.
+    */
+    int get_fd() const;
+
+    /** \brief Progress all transfers that are ready
+        \param timeout Timeout in milliseconds to wait for a transfer to
+                       become ready, -1 waits indefinitely
+        \return Number of transfers that made progress
+    */
+    std::size_t dispatch(int timeout = 0);
+
+    /** \brief Number of transfers in progress
+     */
+    std::size_t pending() const;
+  };
+}
+
+#endif
@@ -27,14 +27,20 @@
 #define WAYLAND_UTIL_HPP
 
 #include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
 #include <memory>
+#include <new>
 #include <stdexcept>
 #include <string>
+#include <type_traits>
 #include <typeinfo>
 #include <utility>
 #include <vector>
 
-#include <wayland-client-core.h>
+#include <wayland-util.h>
 
 #define wl_array_for_each_cpp(pos, array)                                                         \
   for ((pos) = static_cast<decltype(pos)>((array)->data);                                         \
@@ -47,8 +53,253 @@ namespace wayland
 
   class array_t;
 
+  /** \brief Fixed point number as used by the Wayland protocol
+
+      Protocol arguments of type fixed are signed 24.8 fixed point numbers.
+      fixed_t stores them as they come from the wire and converts
+      implicitly from and to double. The generated bindings pass fixed
+      arguments as double, unless the scanner is run with -f on (the
+      FIXED_ARGUMENTS build option), in which case they are passed as
+      fixed_t and WAYLANDPP_FIXED_ARGUMENTS is 1. Code that only forwards coordinates then does not do any
+      floating point conversion.
+  */
+  class fixed_t
+  {
+  private:
+    wl_fixed_t v = 0;
+
+  public:
+    fixed_t() = default;
+
+    /** \brief Convert a double to fixed point
+     */
+    fixed_t(double d)
+      : v(wl_fixed_from_double(d))
+    {
+    }
+
+    /** \brief Construct from the raw 24.8 representation
+     */
+    static constexpr fixed_t from_raw(wl_fixed_t raw)
+    {
+      return fixed_t(raw, 0);
+    }
+
+    /** \brief Construct from an integer
+     */
+    static constexpr fixed_t from_int(int i)
+    {
+      return fixed_t(static_cast<wl_fixed_t>(i * 256), 0);
+    }
+
+    /** \brief Get the raw 24.8 representation
+     */
+    constexpr wl_fixed_t raw() const
+    {
+      return v;
+    }
+
+    /** \brief Convert to an integer, rounding towards zero
+     */
+    int to_int() const
+    {
+      return wl_fixed_to_int(v);
+    }
+
+    /** \brief Convert to double
+     */
+    double to_double() const
+    {
+      return wl_fixed_to_double(v);
+    }
+
+    operator double() const
+    {
+      return to_double();
+    }
+
+  private:
+    // raw constructor, the second argument disambiguates it from fixed_t(double)
+    constexpr fixed_t(wl_fixed_t raw, int /*unused*/)
+      : v(raw)
+    {
+    }
+  };
+
+  /* Comparisons against arithmetic types are spelled out, as the implicit
+     conversions in both directions would make them ambiguous. */
+  constexpr bool operator==(fixed_t a, fixed_t b) { return a.raw() == b.raw(); }
+  constexpr bool operator!=(fixed_t a, fixed_t b) { return a.raw() != b.raw(); }
+
+  template <typename T, typename = typename std::enable_if<std::is_arithmetic<T>::value>::type>
+  bool operator==(fixed_t a, T b) { return a.to_double() == b; }
+  template <typename T, typename = typename std::enable_if<std::is_arithmetic<T>::value>::type>
+  bool operator!=(fixed_t a, T b) { return a.to_double() != b; }
+  template <typename T, typename = typename std::enable_if<std::is_arithmetic<T>::value>::type>
+  bool operator==(T a, fixed_t b) { return a == b.to_double(); }
+  template <typename T, typename = typename std::enable_if<std::is_arithmetic<T>::value>::type>
+  bool operator!=(T a, fixed_t b) { return a != b.to_double(); }
+
+  /** \brief What the library allocates memory for
+
+      See allocator_t and get_allocation_counters().
+  */
+  enum class allocation_category : unsigned int
+  {
+    /// Values of event arguments (detail::any)
+    any,
+    /// Argument arrays of requests and events
+    arguments,
+    /// Per proxy bookkeeping
+    proxy_data,
+    /// Event handler storage of proxies
+    events,
+    /// Formatting of log messages
+    log
+  };
+
+  /// Number of allocation categories
+  constexpr std::size_t allocation_category_count = 5;
+
+  /** \brief Allocation counters of one category
+   */
+  struct allocation_counters_t
+  {
+    uint64_t allocations = 0;
+    uint64_t deallocations = 0;
+    /// Bytes allocated in total
+    uint64_t bytes = 0;
+    /// Bytes currently allocated
+    uint64_t live_bytes = 0;
+  };
+
+  /** \brief Interface for the memory allocations of the library
+
+      Install an implementation with set_allocator(), e.g. to serve the
+      small per event and per request allocations from an arena. The
+      returned memory has to be suitably aligned for any fundamental type.
+  */
+  class allocator_t
+  {
+  public:
+    virtual ~allocator_t() = default;
+
+    /** \brief Allocate memory
+        \param size Number of bytes, never zero
+        \param category What the memory is used for
+        \return The memory, throw std::bad_alloc on failure
+    */
+    virtual void *allocate(std::size_t size, allocation_category category) = 0;
+
+    /** \brief Free memory returned by allocate()
+        \param ptr The memory
+        \param size Size passed to allocate()
+        \param category Category passed to allocate()
+    */
+    virtual void deallocate(void *ptr, std::size_t size, allocation_category category) noexcept = 0;
+  };
+
+  /** \brief Route the allocations of the library through an allocator
+      \param allocator The allocator, or nullptr for operator new
+
+      The allocator has to be set before any object of the library is
+      created and has to outlive all of them, as memory is always freed
+      with the allocator active at that time. It applies to the client
+      and the server library alike.
+  */
+  void set_allocator(allocator_t *allocator);
+
+  /** \brief Get the allocation counters of a category
+
+      The counters are collected for the whole process, including both the
+      client and the server library, regardless of the allocator in use.
+  */
+  allocation_counters_t get_allocation_counters(allocation_category category);
+
+  /** \brief Reset the allocation counters of all categories
+   */
+  void reset_allocation_counters();
+
   namespace detail
   {
+    /** \brief Allocate memory through the allocator set with set_allocator()
+     */
+    void *allocate(std::size_t size, allocation_category category);
+
+    /** \brief Free memory returned by allocate()
+     */
+    void deallocate(void *ptr, std::size_t size, allocation_category category) noexcept;
+
+    /** \brief Standard allocator using allocate() and deallocate()
+     */
+    template <typename T>
+    class allocator
+    {
+    private:
+      template <typename U> friend class allocator;
+      allocation_category category;
+
+    public:
+      using value_type = T;
+
+      allocator(allocation_category c)
+        : category(c) { }
+
+      template <typename U>
+      allocator(const allocator<U> &a)
+        : category(a.category) { }
+
+      T *allocate(std::size_t n)
+      {
+        return static_cast<T*>(detail::allocate(n * sizeof(T), category));
+      }
+
+      void deallocate(T *p, std::size_t n) noexcept
+      {
+        detail::deallocate(p, n * sizeof(T), category);
+      }
+
+      template <typename U>
+      bool operator==(const allocator<U> &a) const
+      {
+        return category == a.category;
+      }
+
+      template <typename U>
+      bool operator!=(const allocator<U> &a) const
+      {
+        return category != a.category;
+      }
+    };
+
+    /** \brief Create an object with allocate()
+     */
+    template <typename T, typename... Args>
+    T *create(allocation_category category, Args&&... args)
+    {
+      void *p = allocate(sizeof(T), category);
+      try
+        {
+          return new(p) T(std::forward<Args>(args)...);
+        }
+      catch(...)
+        {
+          deallocate(p, sizeof(T), category);
+          throw;
+        }
+    }
+
+    /** \brief Destroy an object created with create()
+     */
+    template <typename T>
+    void destroy(allocation_category category, T *object) noexcept
+    {
+      if(!object)
+        return;
+      object->~T();
+      deallocate(object, sizeof(T), category);
+    }
+
     /** \brief Check the return value of a C function and throw exception on
      *         failure
      *
@@ -59,6 +310,22 @@ namespace wayland
      */
     int check_return_value(int return_value, std::string const &function_name);
 
+    // base class for event listener storage.
+    struct events_base_t
+    {
+      events_base_t() = default;
+      events_base_t(const events_base_t&) = default;
+      events_base_t(events_base_t&&) noexcept = default;
+      events_base_t& operator=(const events_base_t&) = default;
+      events_base_t& operator=(events_base_t&&) noexcept = default;
+      virtual ~events_base_t() noexcept = default;
+
+      // Size of the derived object in bytes, for memory reports
+      virtual std::size_t size() const { return sizeof(*this); }
+      // Number of handlers that are set
+      virtual std::size_t handlers() const { return 0; }
+    };
+
     /** \brief Non-refcounted wrapper for C objects
      *
      * This is by default copyable. If this is not desired, delete the
@@ -236,6 +503,7 @@ namespace wayland
         virtual ~base() noexcept = default;
         virtual const std::type_info &type_info() const = 0;
         virtual base *clone() const = 0;
+        virtual void destroy() noexcept = 0;
       };
 
       template <typename T>
@@ -256,10 +524,22 @@ namespace wayland
 
         base *clone() const override
         {
-          return new derived<T>(val);
+          return create<derived<T>>(allocation_category::any, val);
+        }
+
+        void destroy() noexcept override
+        {
+          detail::destroy(allocation_category::any, this);
         }
       };
 
+      void reset() noexcept
+      {
+        if(val)
+          val->destroy();
+        val = nullptr;
+      }
+
       base *val = nullptr;
 
     public:
@@ -275,18 +555,18 @@ namespace wayland
 
       template <typename T>
       any(const T &t)
-        : val(new derived<T>(t)) { }
+        : val(create<derived<T>>(allocation_category::any, t)) { }
 
       ~any() noexcept
       {
-        delete val;
+        reset();
       }
 
       any &operator=(const any &a)
       {
         if (&a != this)
         {
-          delete val;
+          reset();
           val = a.val ? a.val->clone() : nullptr;
         }
         return *this;
@@ -305,8 +585,8 @@ namespace wayland
           static_cast<derived<T>*>(val)->val = t;
         else
           {
-            delete val;
-            val = new derived<T>(t);
+            reset();
+            val = create<derived<T>>(allocation_category::any, t);
           }
         return *this;
       }
@@ -328,6 +608,9 @@ namespace wayland
       }
     };
 
+    // Arguments of an event as passed to the dispatcher
+    using any_vector = std::vector<any, allocator<any>>;
+
     template<unsigned int size, int id = 0>
     class bitfield
     {
@@ -429,9 +712,9 @@ namespace wayland
     public:
 
       argument_t(const argument_t &arg);
-      argument_t(argument_t &&) noexcept = default;
+      argument_t(argument_t &&arg) noexcept;
       argument_t &operator=(const argument_t &arg);
-      argument_t &operator=(argument_t&&) noexcept = default;
+      argument_t &operator=(argument_t &&arg) noexcept;
       ~argument_t() noexcept;
 
       // handles integers
@@ -440,6 +723,7 @@ namespace wayland
 
       // handles wl_fixed_t
       argument_t(double f);
+      argument_t(fixed_t f);
 
       // handles strings
       argument_t(const std::string &s);
@@ -461,6 +745,14 @@ namespace wayland
        */
       wl_argument get_c_argument() const;
     };
+
+    // Arguments of a request
+    using argument_vector = std::vector<argument_t, allocator<argument_t>>;
+  }
+
+  namespace server
+  {
+    class resource_t;
   }
 
   class array_t
@@ -472,6 +764,7 @@ namespace wayland
     void get(wl_array *arr) const;
 
     friend class proxy_t;
+    friend class server::resource_t;
     friend class detail::argument_t;
 
   public:
@@ -514,6 +807,245 @@ namespace wayland
       return v;
     }
   };
+
+  namespace detail
+  {
+    struct latency_histogram_data_t;
+  }
+
+  /** \brief Histogram of latencies
+
+      Latencies are sorted into logarithmic buckets that are each divided
+      into 16 linear sub-buckets, like in HdrHistogram. Every value from
+      one nanosecond up to centuries is recorded with a relative error of
+      at most 6.25 %, using a fixed amount of memory.
+
+      Copies of a latency_histogram_t share the same counters. Recording
+      does not lock and may happen concurrently with queries from other
+      threads.
+  */
+  class latency_histogram_t
+  {
+  private:
+    std::shared_ptr<detail::latency_histogram_data_t> data;
+
+  public:
+    latency_histogram_t();
+
+    /** \brief Record a latency
+        \param latency Latency to add, negative values are counted as zero
+    */
+    void record(std::chrono::nanoseconds latency);
+
+    /** \brief Number of recorded latencies
+     */
+    uint64_t count() const;
+
+    /** \brief Smallest recorded latency, zero if empty
+     */
+    std::chrono::nanoseconds min() const;
+
+    /** \brief Largest recorded latency, zero if empty
+     */
+    std::chrono::nanoseconds max() const;
+
+    /** \brief Arithmetic mean of the recorded latencies, zero if empty
+     */
+    std::chrono::nanoseconds mean() const;
+
+    /** \brief Get a percentile
+        \param percentile Percentile between 0 and 100, e.g. 99.9
+        \return Upper bound of the bucket holding the percentile, at most
+                the largest recorded latency
+    */
+    std::chrono::nanoseconds percentile(double percentile) const;
+
+    /** \brief Remove all recorded latencies
+     */
+    void reset();
+
+    /** \brief Export the histogram as text
+
+        The first line holds the summary, followed by one line per
+        non-empty bucket with its upper bound in microseconds, the
+        cumulative percentile and the cumulative count. Lines starting
+        with a '#' are comments.
+    */
+    std::string to_string() const;
+  };
+
+  namespace detail
+  {
+    /** \brief Compile time description of a protocol interface
+
+        Specializations are generated by wayland-scanner++ for every
+        interface class. They contain the name and version of the interface
+        and a nested struct for every request and event (in requests and
+        events respectively) with the following members:
+        - opcode: The opcode of the message
+        - since: The interface version that introduced the message
+        - signature: The wire signature of the message
+        - arguments: std::tuple of the argument types of the message
+    */
+    template <typename T>
+    struct interface_traits;
+
+    /** \brief Name and value of an enum entry
+     */
+    struct enum_entry_t
+    {
+      const char *name;
+      uint32_t value;
+    };
+
+    /** \brief Compile time name tables of a protocol enum
+
+        Specializations are generated by wayland-scanner++ for every enum
+        (and bitfield) with the following members:
+        - size: Number of entries
+        - dense: Whether the values are consecutive, i.e. by_value can be
+                 indexed with value - by_value[0].value
+        - by_value: Entries sorted by value
+        - by_name: Entries sorted by name
+
+        Use enum_to_string() and enum_from_string() to access them.
+    */
+    template <typename E>
+    struct enum_traits;
+
+    // Wire signature character(s) an argument type of proxy_t::marshal()
+    // can be sent as
+    template <typename T>
+    struct wire_type
+    {
+      static constexpr bool matches(char /*unused*/) { return false; }
+    };
+
+    template <>
+    struct wire_type<int32_t>
+    {
+      static constexpr bool matches(char c) { return c == 'i'; }
+    };
+
+    template <>
+    struct wire_type<uint32_t>
+    {
+      static constexpr bool matches(char c) { return c == 'u'; }
+    };
+
+    template <>
+    struct wire_type<double>
+    {
+      static constexpr bool matches(char c) { return c == 'f'; }
+    };
+
+    template <>
+    struct wire_type<fixed_t>
+    {
+      static constexpr bool matches(char c) { return c == 'f'; }
+    };
+
+    template <>
+    struct wire_type<std::string>
+    {
+      static constexpr bool matches(char c) { return c == 's'; }
+    };
+
+    template <>
+    struct wire_type<wl_object*>
+    {
+      static constexpr bool matches(char c) { return c == 'o'; }
+    };
+
+    // new_id placeholder or null object
+    template <>
+    struct wire_type<std::nullptr_t>
+    {
+      static constexpr bool matches(char c) { return c == 'n' || c == 'o'; }
+    };
+
+    template <>
+    struct wire_type<array_t>
+    {
+      static constexpr bool matches(char c) { return c == 'a'; }
+    };
+
+    // only created by argument_t::fd()
+    template <>
+    struct wire_type<argument_t>
+    {
+      static constexpr bool matches(char c) { return c == 'h'; }
+    };
+
+    // Checks a list of argument types against a wire signature.
+    // Version prefixes and nullability markers are skipped.
+    template <typename...T>
+    struct signature_matcher;
+
+    template <>
+    struct signature_matcher<>
+    {
+      static constexpr bool matches(const char *s)
+      {
+        return *s == '\0' || ((*s == '?' || (*s >= '0' && *s <= '9')) && matches(s + 1));
+      }
+    };
+
+    template <typename T, typename...R>
+    struct signature_matcher<T, R...>
+    {
+      static constexpr bool matches(const char *s)
+      {
+        return (*s == '?' || (*s >= '0' && *s <= '9'))
+          ? signature_matcher<T, R...>::matches(s + 1)
+          : wire_type<T>::matches(*s) && signature_matcher<R...>::matches(s + 1);
+      }
+    };
+  }
+
+  /** \brief Get the protocol name of an enum value
+      \param value Enum value, for bitfields a single flag
+      \return Name of the entry or nullptr if there is no entry with this value
+
+      The flags of bitfields have the type of the underlying
+      detail::bitfield, so the bitfield type has to be given explicitly,
+      e.g. enum_to_string<seat_capability>(seat_capability::keyboard).
+      This does not allocate, it uses an index for consecutive values and a
+      binary search otherwise.
+  */
+  template <typename E>
+  const char *enum_to_string(const E &value)
+  {
+    using traits = detail::enum_traits<E>;
+    auto v = static_cast<uint32_t>(value);
+    if(traits::dense)
+      {
+        uint32_t index = v - traits::by_value[0].value;
+        return index < traits::size ? traits::by_value[index].name : nullptr;
+      }
+    auto end = traits::by_value + traits::size;
+    auto it = std::lower_bound(traits::by_value, end, v,
+                               [] (const detail::enum_entry_t &e, uint32_t val) { return e.value < val; });
+    return (it != end && it->value == v) ? it->name : nullptr;
+  }
+
+  /** \brief Get an enum value by its protocol name
+      \param name Name of the entry as written in the protocol
+      \param value Receives the value if the entry exists
+      \return Whether there is an entry with this name
+  */
+  template <typename E>
+  bool enum_from_string(const char *name, E &value)
+  {
+    using traits = detail::enum_traits<E>;
+    auto end = traits::by_name + traits::size;
+    auto it = std::lower_bound(traits::by_name, end, name,
+                               [] (const detail::enum_entry_t &e, const char *n) { return std::strcmp(e.name, n) < 0; });
+    if(it == end || std::strcmp(it->name, name) != 0)
+      return false;
+    value = E(it->value);
+    return true;
+  }
 }
 
 #endif
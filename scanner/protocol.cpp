@@ -0,0 +1,308 @@
+/*
+ *  Copyright (c) 2014-2019 Nils Christopher Brause, Philipp Kerling, Bernd Kuhls
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cmath>
+#include <cctype>
+#include <stdexcept>
+
+#include "pugixml.hpp"
+#include "protocol.hpp"
+
+using namespace pugi;
+
+// Joins the items with a separator.
+std::string join(const std::vector<std::string>& items, const std::string& separator)
+{
+  std::string result;
+  std::size_t size = 0;
+  for(auto const& item : items)
+    size += item.size() + separator.size();
+  result.reserve(size);
+  for(std::size_t c = 0; c < items.size(); c++)
+    {
+      if(c > 0)
+        result += separator;
+      result += items[c];
+    }
+  return result;
+}
+
+bool server = false;
+bool fixed_type = false;
+
+std::string unprefix(const std::string &name)
+{
+  auto prefix_len = name.find('_');
+  if(prefix_len != std::string::npos)
+    {
+      auto prefix = name.substr(0, prefix_len);
+      if(prefix == "wl" || prefix == "wp")
+        return name.substr(prefix_len+1, name.size());
+    }
+  return name;
+}
+
+static argument_t parse_argument(const xml_node& argument, const std::string& iface_name)
+{
+  argument_t arg;
+  arg.type = argument.attribute("type").value();
+  arg.name = argument.attribute("name").value();
+
+  if(argument.attribute("summary"))
+    arg.summary = argument.attribute("summary").value();
+
+  if(argument.attribute("interface"))
+    arg.interface = unprefix(argument.attribute("interface").value());
+
+  if(argument.attribute("enum"))
+    {
+      std::string tmp = argument.attribute("enum").value();
+      if(tmp.find('.') == std::string::npos)
+        {
+          arg.enum_iface = iface_name;
+          arg.enum_name = tmp;
+        }
+      else
+        {
+          arg.enum_iface = unprefix(tmp.substr(0, tmp.find('.')));
+          arg.enum_name = tmp.substr(tmp.find('.')+1);
+        }
+    }
+
+  arg.allow_null = argument.attribute("allow-null") && std::string(argument.attribute("allow-null").value()) == "true";
+  return arg;
+}
+
+// Parses a single protocol file. Enum ids are assigned by the caller.
+std::vector<interface_t> parse_protocol(const std::string& file)
+{
+  xml_document doc;
+  if(!doc.load_file(file.c_str()))
+    throw std::runtime_error("Could not load " + file);
+  auto protocol = doc.child("protocol");
+
+  std::vector<interface_t> interfaces;
+  for(auto const& interface : protocol.children("interface"))
+    {
+      interface_t iface;
+      iface.destroy_opcode = -1;
+      iface.orig_name = interface.attribute("name").value();
+      iface.name = unprefix(iface.orig_name);
+      if(interface.attribute("version"))
+        iface.version = std::stoi(std::string(interface.attribute("version").value()), nullptr, 0);
+      else
+        iface.version = 1;
+      if(interface.child("description"))
+        {
+          auto description = interface.child("description");
+          iface.summary = description.attribute("summary").value();
+          iface.description = description.text().get();
+        }
+
+      int opcode = 0; // Opcodes are in order of the XML. (Sadly undocumented)
+      for(auto const& request : interface.children("request"))
+        {
+          request_t req;
+          req.opcode = opcode++;
+          req.name = request.attribute("name").value();
+
+          if(request.attribute("since"))
+            req.since = std::stoi(std::string(request.attribute("since").value()), nullptr, 0);
+          else
+            req.since = 1;
+
+          if(request.child("description"))
+            {
+              auto description = request.child("description");
+              req.summary = description.attribute("summary").value();
+              req.description = description.text().get();
+            }
+
+          if(request.attribute("type"))
+            req.destructor = std::string(request.attribute("type").value()) == "destructor";
+
+          // destruction takes place through the class destuctor
+          if(req.name == "destroy")
+            iface.destroy_opcode = req.opcode;
+          for(auto const& argument : request.children("arg"))
+            {
+              argument_t arg = parse_argument(argument, iface.name);
+              if(arg.type == "new_id")
+                req.ret = arg;
+              req.args.push_back(arg);
+            }
+          iface.requests.push_back(std::move(req));
+        }
+
+      for(auto const& event : interface.children("event"))
+        {
+          event_t ev;
+          ev.name = event.attribute("name").value();
+
+          if(event.attribute("since"))
+            ev.since = std::stoi(std::string(event.attribute("since").value()), nullptr, 0);
+          else
+            ev.since = 1;
+
+          if(event.child("description"))
+            {
+              auto description = event.child("description");
+              ev.summary = description.attribute("summary").value();
+              ev.description = description.text().get();
+            }
+
+          for(auto const& argument : event.children("arg"))
+            ev.args.push_back(parse_argument(argument, iface.name));
+          iface.events.push_back(std::move(ev));
+        }
+
+      for(auto const& enumeration : interface.children("enum"))
+        {
+          enumeration_t enu;
+          enu.name = enumeration.attribute("name").value();
+          if(enumeration.child("description"))
+            {
+              auto description = enumeration.child("description");
+              enu.summary = description.attribute("summary").value();
+              enu.description = description.text().get();
+            }
+
+          if(enumeration.attribute("bitfield"))
+            {
+              std::string tmp = enumeration.attribute("bitfield").value();
+              enu.bitfield = (tmp == "true");
+            }
+          else
+            enu.bitfield = false;
+          enu.width = 0;
+
+          for(auto entry = enumeration.child("entry"); entry;
+              entry = entry.next_sibling("entry"))
+            {
+              enum_entry_t enum_entry;
+              enum_entry.name = entry.attribute("name").value();
+              enum_entry.orig_name = enum_entry.name;
+              if(enum_entry.name == "default"
+                 || isdigit(enum_entry.name.at(0)))
+                enum_entry.name.insert(0, 1, '_');
+              enum_entry.value = entry.attribute("value").value();
+
+              if(entry.attribute("summary"))
+                enum_entry.summary = entry.attribute("summary").value();
+
+              auto tmp = static_cast<uint32_t>(std::log2(stol(enum_entry.value, nullptr, 0))) + 1U;
+              if(tmp > enu.width)
+                enu.width = tmp;
+
+              enu.entries.push_back(std::move(enum_entry));
+            }
+          iface.enums.push_back(std::move(enu));
+        }
+
+      interfaces.push_back(std::move(iface));
+    }
+  return interfaces;
+}
+
+// set of C++-only keywords not to use as names
+const std::set<std::string> element_t::keywords =
+  {
+   "alignas",
+   "alignof",
+   "and",
+   "and_eq",
+   "asm",
+   "auto",
+   "bitand",
+   "bitor",
+   "bool",
+   "break",
+   "case",
+   "catch",
+   "char",
+   "char16_t",
+   "char32_t",
+   "class",
+   "compl",
+   "const",
+   "constexpr",
+   "const_cast",
+   "continue",
+   "decltype",
+   "default",
+   "delete",
+   "do",
+   "double",
+   "dynamic_cast",
+   "else",
+   "enum",
+   "explicit",
+   "export",
+   "extern",
+   "false",
+   "float",
+   "for",
+   "friend",
+   "goto",
+   "if",
+   "inline",
+   "int",
+   "long",
+   "mutable",
+   "namespace",
+   "new",
+   "noexcept",
+   "not",
+   "not_eq",
+   "nullptr",
+   "operator",
+   "or",
+   "or_eq",
+   "private",
+   "protected",
+   "public",
+   "register",
+   "reinterpret_cast",
+   "return",
+   "short",
+   "signed",
+   "sizeof",
+   "static",
+   "static_assert",
+   "static_cast",
+   "struct",
+   "switch",
+   "template",
+   "this",
+   "thread_local",
+   "throw",
+   "true",
+   "try",
+   "typedef",
+   "typeid",
+   "typename",
+   "union",
+   "unsigned",
+   "using",
+   "virtual",
+   "void",
+   "volatile",
+   "wchar_t",
+   "while",
+   "xor",
+   "xor_eq",
+  };
@@ -0,0 +1,1140 @@
+/*
+ *  Copyright (c) 2014-2019 Nils Christopher Brause, Philipp Kerling, Bernd Kuhls
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SCANNER_PROTOCOL_HPP
+#define SCANNER_PROTOCOL_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Model of a protocol description, shared by the scanner and the tools
+// working with the protocol XML files.
+
+// Joins the items with a separator.
+std::string join(const std::vector<std::string>& items, const std::string& separator = ", ");
+
+// generate server side bindings instead of client side ones
+extern bool server;
+
+// pass arguments of type fixed as fixed_t instead of double
+extern bool fixed_type;
+
+struct element_t
+{
+  std::string name;
+  std::string summary;
+  std::string description;
+  static const std::set<std::string> keywords;
+
+  static std::string sanitise(std::string str)
+  {
+    if(keywords.count(str))
+      return "_" + str;
+    return str;
+  }
+};
+
+struct argument_t : public element_t
+{
+  std::string type;
+  std::string interface;
+  std::string enum_iface;
+  std::string enum_name;
+  bool allow_null = false;
+
+  std::string print_enum_wire_type() const
+  {
+    // Enums can be int or uint on the wire, except for bitfields
+    if(type == "int")
+      return "int32_t";
+    if(type == "uint")
+      return "uint32_t";
+    throw std::runtime_error("Enum type must be int or uint");
+  }
+
+  std::string print_type() const
+  {
+    if(!interface.empty())
+      return interface + "_t";
+    if(!enum_iface.empty())
+      return enum_iface + "_" + enum_name;
+    if(type == "int")
+      return "int32_t";
+    if(type == "uint")
+      return "uint32_t";
+    if(type == "fixed")
+      return fixed_type ? "fixed_t" : "double";
+    if(type == "string")
+      return "std::string";
+    if(type == "object")
+      return server ? "resource_t" : "proxy_t";
+    if(type == "new_id")
+      return server ? "resource_t" : "proxy_t";
+    if(type == "fd")
+      return "int";
+    if(type == "array")
+      return "array_t";
+    return type;
+  }
+
+  // type of the argument as stored by the dispatcher, fixed arguments
+  // always arrive as fixed_t and convert to double if needed
+  std::string print_dispatch_type() const
+  {
+    if(type == "fixed")
+      return "fixed_t";
+    return print_type();
+  }
+
+  std::string print_short() const
+  {
+    if(type == "int")
+      return "i";
+    if(type == "uint")
+      return "u";
+    if(type == "fixed")
+      return "f";
+    if(type == "string")
+      return "s";
+    if(type == "object")
+      return "o";
+    if(type == "new_id")
+      return "n";
+    if(type == "array")
+      return "a";
+    if(type == "fd")
+      return "h";
+    return "x";
+  }
+
+  std::string print_argument() const
+  {
+    return print_type() + (!interface.empty() || !enum_iface.empty() || type == "string" || type == "array"
+                           || (server && (type == "object" || type == "new_id")) ? " const& " : " ") + sanitise(name);
+  }
+
+  // conversion of the argument for resource_t::send_event()
+  std::string print_server_event_argument() const
+  {
+    if(type == "object" || type == "new_id")
+      return sanitise(name) + ".resource_has_object() ? reinterpret_cast<wl_object*>(" + sanitise(name) + ".c_ptr()) : nullptr";
+    if(type == "fd")
+      return "argument_t::fd(" + sanitise(name) + ")";
+    if(!enum_name.empty())
+      return "static_cast<" + print_enum_wire_type() + ">(" + sanitise(name) + ")";
+    return sanitise(name);
+  }
+};
+
+struct event_t : public element_t
+{
+  std::vector<argument_t> args;
+  int since = 0;
+
+  std::vector<std::string> print_types() const
+  {
+    std::vector<std::string> types;
+    types.reserve(args.size());
+    for(auto const& arg : args)
+      types.push_back(arg.print_type());
+    return types;
+  }
+
+  std::string print_signature() const
+  {
+    std::stringstream ss;
+    if(since > 1)
+      ss << since;
+    for(auto const& arg : args)
+      {
+        if(arg.allow_null)
+          ss << "?";
+        if(arg.type == "new_id" && arg.interface.empty())
+          ss << "su";
+        ss << arg.print_short();
+      }
+    return ss.str();
+  }
+
+  std::string print_traits(int opcode) const
+  {
+    std::stringstream ss;
+    ss << "    struct " << sanitise(name) << std::endl
+       << "    {" << std::endl
+       << "      static constexpr std::uint32_t opcode = " << opcode << ";" << std::endl
+       << "      static constexpr std::uint32_t since = " << since << ";" << std::endl
+       << "      static constexpr const char *signature = \"" << print_signature() << "\";" << std::endl
+       << "      using arguments = std::tuple<" << join(print_types()) << ">;" << std::endl
+       << "    };" << std::endl;
+    return ss.str();
+  }
+
+  std::string print_functional() const
+  {
+    return "    std::function<void(" + join(print_types()) + ")> " + sanitise(name) + ";";
+  }
+
+  std::string print_dispatcher(int opcode) const
+  {
+    std::stringstream ss;
+    ss << "    case " << opcode << ":" << std::endl
+       << "      if(events->" << sanitise(name) << ") events->" << sanitise(name) << "(";
+
+    std::vector<std::string> params;
+    int c = 0;
+    for(auto const& arg : args)
+      {
+        std::string a = "args[" + std::to_string(c++) + "]";
+        if(!arg.enum_name.empty() && arg.type != "array")
+          params.push_back(arg.print_type() + "(" + a + ".get<" + arg.print_enum_wire_type() + ">())");
+        else if(!arg.interface.empty())
+          params.push_back(arg.print_type() + "(" + a + ".get<proxy_t>())");
+        else
+          params.push_back(a + ".get<" + arg.print_dispatch_type() + ">()");
+      }
+    ss << join(params) << ");" << std::endl
+       << "      break;";
+    return ss.str();
+  }
+
+  std::string print_signal_header() const
+  {
+    std::stringstream ss;
+    ss << "  /** \\brief " << summary << std::endl;
+    for(auto const& arg : args)
+      ss << "      \\param " << arg.name << " " << arg.summary << std::endl;
+    ss << description << std::endl
+       << "  */" << std::endl;
+
+    ss << "  std::function<void(" << join(print_types()) << ")> &on_" <<  name << "();" << std::endl;
+    return ss.str();
+  }
+
+  std::string print_signal_body(const std::string& interface_name) const
+  {
+    std::stringstream ss;
+    ss << "std::function<void(" << join(print_types()) << ")> &" + interface_name + "_t::on_" + name + "()" << std::endl
+       << "{" << std::endl
+       << "  return std::static_pointer_cast<events_t>(get_events())->" + sanitise(name) + ";" << std::endl
+       << "}" << std::endl;
+    return ss.str();
+  }
+
+  // server side: argument types of a request handler
+  std::string print_server_handler_type() const
+  {
+    std::vector<std::string> types;
+    for(auto const& arg : args)
+      if(arg.type == "new_id" && arg.interface.empty())
+        types.insert(types.end(), { "std::string", "uint32_t", "uint32_t" });
+      else
+        types.push_back(arg.print_type());
+    return "std::function<void(" + join(types) + ")>";
+  }
+
+  std::string print_server_functional() const
+  {
+    return "    " + print_server_handler_type() + " " + sanitise(name) + ";";
+  }
+
+  std::string print_server_dispatcher(int opcode) const
+  {
+    std::stringstream ss;
+    ss << "    case " << opcode << ":" << std::endl
+       << "      if(events->" << sanitise(name) << ") events->" << sanitise(name) << "(";
+
+    std::vector<std::string> params;
+    int c = 0;
+    for(auto const& arg : args)
+      {
+        std::string a = "args[" + std::to_string(c++) + "]";
+        if(!arg.enum_name.empty() && arg.type != "array")
+          params.push_back(arg.print_type() + "(" + a + ".get<" + arg.print_enum_wire_type() + ">())");
+        else if(!arg.interface.empty())
+          params.push_back(arg.print_type() + "(" + a + ".get<resource_t>())");
+        else if(arg.type == "new_id")
+          {
+            params.push_back(a + ".get<std::string>()");
+            params.push_back("args[" + std::to_string(c++) + "].get<uint32_t>()");
+            params.push_back("args[" + std::to_string(c++) + "].get<uint32_t>()");
+          }
+        else
+          params.push_back(a + ".get<" + arg.print_dispatch_type() + ">()");
+      }
+    ss << join(params) << ");" << std::endl
+       << "      break;";
+    return ss.str();
+  }
+
+  std::string print_server_signal_header() const
+  {
+    std::stringstream ss;
+    ss << "  /** \\brief " << summary << std::endl;
+    for(auto const& arg : args)
+      {
+        if(arg.type == "new_id" && arg.interface.empty())
+          ss << "      \\param interface Interface to bind" << std::endl
+             << "      \\param version Interface version" << std::endl;
+        ss << "      \\param " << arg.name << " " << arg.summary << std::endl;
+      }
+    ss << description << std::endl
+       << "  */" << std::endl;
+
+    ss << "  " << print_server_handler_type() << " &on_" << name << "();" << std::endl;
+    return ss.str();
+  }
+
+  std::string print_server_signal_body(const std::string& interface_name) const
+  {
+    std::stringstream ss;
+    ss << print_server_handler_type() << " &" + interface_name + "_t::on_" + name + "()" << std::endl
+       << "{" << std::endl
+       << "  return std::static_pointer_cast<events_t>(get_events())->" + sanitise(name) + ";" << std::endl
+       << "}" << std::endl;
+    return ss.str();
+  }
+
+  std::string print_server_send_header() const
+  {
+    std::stringstream ss;
+    ss << "  /** \\brief " << summary << std::endl;
+    for(auto const& arg : args)
+      ss << "      \\param " << sanitise(arg.name) << " " << arg.summary << std::endl;
+    ss << "      \\param post Send the event immediately (true) or queue it until" << std::endl
+       << "                  the next event is posted or the client is flushed (false)" << std::endl
+       << description << std::endl
+       << "  */" << std::endl;
+
+    ss << "  void send_" << name << "(";
+    for(auto const& arg : args)
+      ss << arg.print_argument() << ", ";
+    ss << "bool post = true);" << std::endl;
+
+    ss << std::endl
+       << "  /** \\brief Minimum protocol version required for the \\ref send_" << name << " function" << std::endl
+       << "  */" << std::endl
+       << "  static constexpr std::uint32_t " << name << "_since_version = " << since << ";" << std::endl;
+
+    if(since > 1)
+      {
+        ss << std::endl
+           << "  /** \\brief Check whether the \\ref send_" << name << " function is available with" << std::endl
+           << "      the currently bound version of the protocol" << std::endl
+           << "  */" << std::endl
+           << "  bool can_send_" << name << "() const;" << std::endl;
+      }
+
+    return ss.str();
+  }
+
+  std::string print_server_send_body(const std::string& interface_name, int opcode) const
+  {
+    std::stringstream ss;
+    ss << "void " << interface_name << "_t::send_" << name << "(";
+    for(auto const& arg : args)
+      ss << arg.print_argument() << ", ";
+    ss << "bool post)" << std::endl
+       << "{" << std::endl
+       << "  send_event(post, " << opcode << "U";
+    for(auto const& arg : args)
+      ss << ", " << arg.print_server_event_argument();
+    ss << ");" << std::endl
+       << "}" << std::endl;
+
+    if(since > 1)
+      {
+        ss << std::endl
+           << "bool " << interface_name << "_t::can_send_" << name << "() const" << std::endl
+           << "{" << std::endl
+           << "  return (get_version() >= " << name << "_since_version);" << std::endl
+           << "}" << std::endl;
+      }
+
+    return ss.str();
+  }
+};
+
+struct request_t : public event_t
+{
+  argument_t ret;
+  int opcode = 0;
+  bool destructor = false;
+
+  std::string availability_function_name() const
+  {
+    if(since > 1)
+      return std::string("can_") + name;
+    return "";
+  }
+
+  std::string since_version_constant_name() const
+  {
+    return name + "_since_version";
+  }
+
+  // parameters of the request function
+  std::vector<std::string> print_parameters() const
+  {
+    std::vector<std::string> params;
+    for(auto const& arg : args)
+      if(arg.type == "new_id")
+        {
+          if(arg.interface.empty())
+            params.insert(params.end(), { "proxy_t &interface", "uint32_t version" });
+        }
+      else
+        params.push_back(arg.print_argument());
+    return params;
+  }
+
+  std::string print_header() const
+  {
+    std::stringstream ss;
+    ss << "  /** \\brief " << summary << std::endl;
+    if(!ret.summary.empty())
+      ss << "      \\return " << ret.summary << std::endl;
+    for(auto const& arg : args)
+      {
+        if(arg.type == "new_id")
+          {
+            if(arg.interface.empty())
+              ss << "      \\param interface Interface to bind" << std::endl
+                 << "      \\param version Interface version" << std::endl;
+          }
+        else
+          ss << "      \\param " << sanitise(arg.name) << " " << arg.summary << std::endl;
+      }
+    ss << description << std::endl
+       << "  */" << std::endl;
+
+    if(ret.name.empty())
+      ss << "  void ";
+    else
+      ss << "  " << ret.print_type() << " ";
+    ss << sanitise(name) << "(" << join(print_parameters()) << ");" << std::endl;
+
+    ss << std::endl
+       << "  /** \\brief Minimum protocol version required for the \\ref " << sanitise(name) << " function" << std::endl
+       << "  */" << std::endl
+       << "  static constexpr std::uint32_t " << since_version_constant_name() << " = " << since << ";" << std::endl;
+
+    if(!availability_function_name().empty())
+    {
+      ss << std::endl
+         << "  /** \\brief Check whether the \\ref " << name << " function is available with" << std::endl
+         << "      the currently bound version of the protocol" << std::endl
+         << "  */" << std::endl
+         << "  bool " << availability_function_name() << "() const;" << std::endl;
+    }
+
+    return ss.str();
+  }
+
+  std::string print_body(const std::string& interface_name) const
+  {
+    std::stringstream ss;
+    if(ret.name.empty())
+      ss <<  "void ";
+    else
+      ss << ret.print_type() << " ";
+    ss << interface_name << "_t::" << sanitise(name) << "(" << join(print_parameters()) << ")\n{" << std::endl;
+
+    bool new_id_arg = false;
+    for(auto const& arg : args)
+      if(arg.type == "new_id" && arg.interface.empty())
+        new_id_arg = true;
+
+    std::string message = "detail::interface_traits<" + interface_name + "_t>::requests::" + sanitise(name);
+    std::vector<std::string> params;
+    if(ret.name.empty())
+      ss <<  "  marshal<" << message << ">(";
+    else if(ret.interface.empty())
+      {
+        ss << "  proxy_t p = marshal_constructor_versioned<" << message << ">(";
+        params.insert(params.end(), { "interface.interface", "version" });
+      }
+    else
+      {
+        ss << "  proxy_t p = marshal_constructor<" << message << ">(";
+        params.push_back("&" + ret.interface + "_interface");
+      }
+
+    for(auto const& arg : args)
+      {
+        if(arg.type == "new_id")
+          {
+            if(arg.interface.empty())
+              params.insert(params.end(), { "std::string(interface.interface->name)", "version" });
+            params.push_back("nullptr");
+          }
+        else if(arg.type == "fd")
+          params.push_back("argument_t::fd(" + sanitise(arg.name) + ")");
+        else if(arg.type == "object")
+          params.push_back(sanitise(arg.name) + ".proxy_has_object() ? reinterpret_cast<wl_object*>(" + sanitise(arg.name) + ".c_ptr()) : nullptr");
+        else if(!arg.enum_name.empty())
+          params.push_back("static_cast<" + arg.print_enum_wire_type() + ">(" + sanitise(arg.name) + ")");
+        else
+          params.push_back(sanitise(arg.name));
+      }
+
+    ss << join(params) << ");" << std::endl;
+
+    if(!ret.name.empty())
+      {
+        if(new_id_arg)
+          {
+            ss << "  interface = interface.copy_constructor(p);" << std::endl
+               << "  return interface;" << std::endl;
+          }
+        else
+          ss << "  return " << ret.print_type() << "(p);" << std::endl;
+      }
+    ss << "}";
+
+    if(!availability_function_name().empty())
+    {
+      ss << std::endl
+         << "bool " << interface_name << "_t::" << availability_function_name() << "() const" << std::endl
+         << "{" << std::endl
+         << "  return (get_version() >= " << since_version_constant_name() << ");" << std::endl
+         << "}";
+    }
+
+    return ss.str();
+  }
+};
+
+struct enum_entry_t : public element_t
+{
+  std::string value;
+  std::string orig_name;
+};
+
+struct enumeration_t : public element_t
+{
+  std::vector<enum_entry_t> entries;
+  bool bitfield = false;
+  int id = 0;
+  uint32_t width = 0;
+
+  std::string print_forward(const std::string& iface_name) const
+  {
+    std::stringstream ss;
+    if(!bitfield)
+      ss << "enum class " << iface_name << "_" << name << " : uint32_t;" << std::endl;
+    else
+      ss << "struct " << iface_name << "_" << name << ";" << std::endl;
+    return ss.str();
+  }
+
+  std::string print_header(const std::string& iface_name) const
+  {
+    std::stringstream ss;
+    ss << "/** \\brief " << summary << std::endl
+       << description << std::endl
+       << "  */" << std::endl;
+
+    if(!bitfield)
+      ss << "enum class " << iface_name << "_" << name << " : uint32_t" << std::endl
+         << "  {" << std::endl;
+    else
+      ss << "struct " << iface_name << "_" << name << " : public wayland::detail::bitfield<" << width << ", " << id << ">" << std::endl
+         << "{" << std::endl
+         << "  " << iface_name << "_" << name << "(const wayland::detail::bitfield<" << width << ", " << id << "> &b)" << std::endl
+         << "    : wayland::detail::bitfield<" << width << ", " << id << ">(b) {}" << std::endl
+         << "  " << iface_name << "_" << name << "(const uint32_t value)" << std::endl
+         << "    : wayland::detail::bitfield<" << width << ", " << id << ">(value) {}" << std::endl;
+
+    for(std::size_t c = 0; c < entries.size(); c++)
+      {
+        auto const& entry = entries[c];
+        if(!entry.summary.empty())
+          ss << "  /** \\brief " << entry.summary << " */" << std::endl;
+
+        if(!bitfield)
+          ss << "  " << sanitise(entry.name) << " = " << entry.value << (c + 1 < entries.size() ? "," : "") << std::endl;
+        else
+          ss << "  static const wayland::detail::bitfield<" << width << ", " << id << "> " << sanitise(entry.name) << ";" << std::endl;
+      }
+
+    ss << "};" << std::endl;
+    return ss.str();
+  }
+
+  // reflection tables, type is the (qualified) C++ type of the enum
+  std::string print_traits(const std::string& type) const
+  {
+    if(entries.empty())
+      return "";
+
+    std::vector<const enum_entry_t*> by_value;
+    for(auto const& entry : entries)
+      by_value.push_back(&entry);
+    auto by_name = by_value;
+    std::stable_sort(by_value.begin(), by_value.end(), [] (const enum_entry_t *a, const enum_entry_t *b)
+                     { return std::stoul(a->value, nullptr, 0) < std::stoul(b->value, nullptr, 0); });
+    std::stable_sort(by_name.begin(), by_name.end(), [] (const enum_entry_t *a, const enum_entry_t *b)
+                     { return a->orig_name < b->orig_name; });
+
+    bool dense = true;
+    unsigned long first = std::stoul(by_value.front()->value, nullptr, 0);
+    for(std::size_t c = 0; c < by_value.size(); c++)
+      if(std::stoul(by_value[c]->value, nullptr, 0) != first + c)
+        dense = false;
+
+    auto print_table = [] (const std::vector<const enum_entry_t*>& table)
+      {
+        std::vector<std::string> items;
+        for(auto const *entry : table)
+          items.push_back("{ \"" + entry->orig_name + "\", " + std::to_string(std::stoul(entry->value, nullptr, 0)) + "U }");
+        return "{" + join(items) + "}";
+      };
+
+    std::stringstream ss;
+    ss << "template <>" << std::endl
+       << "struct enum_traits<" << type << ">" << std::endl
+       << "{" << std::endl
+       << "  static constexpr std::size_t size = " << entries.size() << ";" << std::endl
+       << "  static constexpr bool dense = " << (dense ? "true" : "false") << ";" << std::endl
+       << "  static constexpr enum_entry_t by_value[" << entries.size() << "] = " << print_table(by_value) << ";" << std::endl
+       << "  static constexpr enum_entry_t by_name[" << entries.size() << "] = " << print_table(by_name) << ";" << std::endl
+       << "};" << std::endl;
+    return ss.str();
+  }
+
+  std::string print_traits_body(const std::string& type) const
+  {
+    if(entries.empty())
+      return "";
+    std::stringstream ss;
+    ss << "constexpr wayland::detail::enum_entry_t wayland::detail::enum_traits<" << type << ">::by_value[];" << std::endl
+       << "constexpr wayland::detail::enum_entry_t wayland::detail::enum_traits<" << type << ">::by_name[];" << std::endl;
+    return ss.str();
+  }
+
+  std::string print_body(const std::string& iface_name) const
+  {
+    std::stringstream ss;
+    if(bitfield)
+      for(auto const& entry : entries)
+        {
+          ss << "const wayland::detail::bitfield<" << width << ", " << id << "> " << iface_name << "_" << name
+             << "::" << sanitise(entry.name) << "{" << entry.value << "};" << std::endl;
+        }
+    return ss.str();
+  }
+};
+
+struct interface_t : public element_t
+{
+  int version = 0;
+  std::string orig_name;
+  int destroy_opcode = 0;
+  std::vector<request_t> requests;
+  std::vector<event_t> events;
+  std::vector<enumeration_t> enums;
+
+  std::string print_forward() const
+  {
+    std::stringstream ss;
+    ss << "class " << name << "_t;" << std::endl;
+    for(auto const& e : enums)
+      ss << e.print_forward(name);
+    return ss.str();
+  }
+
+  std::string print_c_forward() const
+  {
+    std::stringstream ss;
+    ss << "struct " << orig_name << ";" << std::endl;
+    return ss.str();
+  }
+
+  std::string print_header() const
+  {
+    std::stringstream ss;
+    ss << "/** \\brief " << summary << std::endl
+       << description << std::endl
+       << "*/" << std::endl;
+
+    ss << "class " << name << "_t : public proxy_t" << std::endl
+       << "{" << std::endl
+       << "private:" << std::endl
+       << "  struct events_t : public detail::events_base_t" << std::endl
+       << "  {" << std::endl;
+
+    for(auto const& event : events)
+      ss << event.print_functional() << std::endl;
+
+    // for display_t::memory_report()
+    std::vector<std::string> handlers;
+    for(auto const& event : events)
+      handlers.push_back("(" + element_t::sanitise(event.name) + " ? 1 : 0)");
+    ss << std::endl
+       << "    std::size_t size() const override { return sizeof(*this); }" << std::endl;
+    if(!handlers.empty())
+      ss << "    std::size_t handlers() const override { return " << join(handlers, " + ") << "; }" << std::endl;
+
+    ss << "  };" << std::endl
+       << std::endl
+       << "  static int dispatcher(uint32_t opcode, const detail::any_vector& args, const std::shared_ptr<detail::events_base_t>& e);" << std::endl
+       << std::endl
+       << "  " << name << "_t(proxy_t const &wrapped_proxy, construct_proxy_wrapper_tag /*unused*/);" << std::endl
+       << std::endl;
+
+    ss << "public:" << std::endl
+       << "  " << name << "_t();" << std::endl
+       << "  explicit " << name << "_t(const proxy_t &proxy);" << std::endl
+       << "  " << name << "_t(" << orig_name << " *p, wrapper_type t = wrapper_type::standard);" << std::endl
+       << std::endl
+       << "  " << name << "_t proxy_create_wrapper();" << std::endl
+       << std::endl
+       << "  static const std::string interface_name;" << std::endl
+       << std::endl
+       << "  operator " << orig_name << "*() const;" << std::endl
+       << std::endl;
+
+    for(auto const& request : requests)
+      if(request.name != "destroy")
+        ss << request.print_header() << std::endl;
+
+    for(auto const& event : events)
+      ss << event.print_signal_header() << std::endl;
+
+    ss << "};" << std::endl
+       << std::endl;
+
+    for(auto const& enumeration : enums)
+      ss << enumeration.print_header(name) << std::endl;
+
+    return ss.str();
+  }
+
+  std::string print_traits() const
+  {
+    std::stringstream ss;
+    ss << "template <>" << std::endl
+       << "struct interface_traits<" << name << "_t>" << std::endl
+       << "{" << std::endl
+       << "  static constexpr const char *name = \"" << orig_name << "\";" << std::endl
+       << "  static constexpr std::uint32_t version = " << version << ";" << std::endl
+       << std::endl
+       << "  struct requests" << std::endl
+       << "  {" << std::endl;
+    int opcode = 0;
+    for(auto const& request : requests)
+      ss << request.print_traits(opcode++);
+    ss << "  };" << std::endl
+       << std::endl
+       << "  struct events" << std::endl
+       << "  {" << std::endl;
+    opcode = 0;
+    for(auto const& event : events)
+      ss << event.print_traits(opcode++);
+    ss << "  };" << std::endl
+       << "};" << std::endl;
+    return ss.str();
+  }
+
+  std::string print_interface_header() const
+  {
+    std::stringstream ss;
+    ss << "  extern const wl_interface " << name << "_interface;" << std::endl;
+    return ss.str();
+  }
+
+  std::string print_body() const
+  {
+    std::stringstream set_events;
+    set_events << "  if(proxy_has_object() && get_wrapper_type() == wrapper_type::standard)" << std::endl
+               << "    {" << std::endl
+               << "      set_events(std::allocate_shared<events_t>(wayland::detail::allocator<events_t>(wayland::allocation_category::events)), dispatcher);" << std::endl;
+    if(destroy_opcode != -1)
+      set_events << "      set_destroy_opcode(" << destroy_opcode << "U);" << std::endl;
+    set_events << "    }" << std::endl;
+
+    std::stringstream set_interface;
+    set_interface << "  set_interface(&" << name << "_interface);" << std::endl
+                  << "  set_copy_constructor([] (const proxy_t &p) -> proxy_t" << std::endl
+                  << "    { return " << name << "_t(p); });" << std::endl;
+
+    std::stringstream ss;
+    ss << name << "_t::" << name << "_t(const proxy_t &p)" << std::endl
+       << "  : proxy_t(p)" << std::endl
+       << "{" << std::endl
+       << set_events.str()
+       << set_interface.str()
+       << "}" << std::endl
+       << std::endl
+       << name << "_t::" << name << "_t()" << std::endl
+       << "{" << std::endl
+       << set_interface.str()
+       << "}" << std::endl
+       << std::endl
+       << name << "_t::" << name << "_t(" << orig_name << " *p, wrapper_type t)" << std::endl
+       << "  : proxy_t(reinterpret_cast<wl_proxy*> (p), t)"
+       << "{" << std::endl
+       << set_events.str()
+       << set_interface.str()
+       << "}" << std::endl
+       << std::endl
+       << name << "_t::" << name << "_t(proxy_t const &wrapped_proxy, construct_proxy_wrapper_tag /*unused*/)" << std::endl
+       << "  : proxy_t(wrapped_proxy, construct_proxy_wrapper_tag())"
+       << "{" << std::endl
+       << set_interface.str()
+       << "}" << std::endl
+       << std::endl
+       << name << "_t " << name << "_t::proxy_create_wrapper()" << std::endl
+       << "{" << std::endl
+       << "  return {*this, construct_proxy_wrapper_tag()};" << std::endl
+       << "}" << std::endl
+       << std::endl
+       << "const std::string " << name << "_t::interface_name = \"" << orig_name << "\";" << std::endl
+       << std::endl
+       << name << "_t::operator " << orig_name << "*() const" << std::endl
+       << "{" << std::endl
+       << "  return reinterpret_cast<" << orig_name << "*> (c_ptr());" << std::endl
+       << "}" << std::endl
+       << std::endl;
+
+    for(auto const& request : requests)
+      if(request.name != "destroy")
+        ss << request.print_body(name) << std::endl
+           << std::endl;
+
+    for(auto const& event : events)
+      ss << event.print_signal_body(name) << std::endl;
+
+    ss << "int " << name << "_t::dispatcher(uint32_t opcode, const any_vector& args, const std::shared_ptr<detail::events_base_t>& e)" << std::endl
+       << "{" << std::endl;
+
+    if(!events.empty())
+      {
+        ss << "  std::shared_ptr<events_t> events = std::static_pointer_cast<events_t>(e);" << std::endl
+           << "  switch(opcode)" << std::endl
+           << "    {" << std::endl;
+
+        int opcode = 0;
+        for(auto const& event : events)
+          ss << event.print_dispatcher(opcode++) << std::endl;
+
+        ss << "    }" << std::endl;
+      }
+
+    ss << "  return 0;" << std::endl
+       << "}" << std::endl;
+
+    for(auto const& enumeration : enums)
+      ss << enumeration.print_body(name) << std::endl;
+
+    return ss.str();
+  }
+
+  int server_destroy_opcode() const
+  {
+    for(auto const& request : requests)
+      if(request.destructor || request.name == "destroy")
+        return request.opcode;
+    return -1;
+  }
+
+  std::string print_server_header() const
+  {
+    std::stringstream ss;
+    ss << "/** \\brief " << summary << std::endl
+       << description << std::endl
+       << "*/" << std::endl;
+
+    ss << "class " << name << "_t : public resource_t" << std::endl
+       << "{" << std::endl
+       << "private:" << std::endl
+       << "  struct events_t : public wayland::detail::events_base_t" << std::endl
+       << "  {" << std::endl;
+
+    for(auto const& request : requests)
+      if(request.name != "destroy")
+        ss << request.print_server_functional() << std::endl;
+
+    ss << "  };" << std::endl
+       << std::endl
+       << "  static int dispatcher(uint32_t opcode, const wayland::detail::any_vector& args, const std::shared_ptr<wayland::detail::events_base_t>& e);" << std::endl
+       << std::endl;
+
+    ss << "public:" << std::endl
+       << "  " << name << "_t();" << std::endl
+       << "  " << name << "_t(const client_t& client, uint32_t version, uint32_t id = 0);" << std::endl
+       << "  explicit " << name << "_t(const resource_t &resource);" << std::endl
+       << std::endl
+       << "  static const std::string interface_name;" << std::endl
+       << std::endl;
+
+    for(auto const& request : requests)
+      if(request.name != "destroy")
+        ss << request.print_server_signal_header() << std::endl;
+
+    for(auto const& event : events)
+      ss << event.print_server_send_header() << std::endl;
+
+    for(auto const& enumeration : enums)
+      if(enumeration.name == "error" && !enumeration.bitfield)
+        for(auto const& entry : enumeration.entries)
+          {
+            ss << "  /** \\brief Post error code " << entry.name << std::endl;
+            if(!entry.summary.empty())
+              ss << "      " << entry.summary << std::endl;
+            ss << "      \\param msg Human readable error message" << std::endl
+               << "  */" << std::endl
+               << "  void post_" << entry.name << "(std::string const& msg);" << std::endl
+               << std::endl;
+          }
+
+    ss << "};" << std::endl
+       << std::endl;
+
+    ss << "/** \\brief " << summary << std::endl
+       << "    Global that announces the " << orig_name << " interface to the clients" << std::endl
+       << "*/" << std::endl
+       << "class global_" << name << "_t : public global_base_t" << std::endl
+       << "{" << std::endl
+       << "private:" << std::endl
+       << "  struct events_t : public wayland::detail::events_base_t" << std::endl
+       << "  {" << std::endl
+       << "    std::function<void(client_t, " << name << "_t)> bind;" << std::endl
+       << "  };" << std::endl
+       << std::endl
+       << "  static void binder(const std::shared_ptr<wayland::detail::events_base_t>& e, client_t client, uint32_t version, uint32_t id);" << std::endl
+       << std::endl
+       << "public:" << std::endl
+       << "  global_" << name << "_t() = default;" << std::endl
+       << "  global_" << name << "_t(display_t &display, unsigned int version = " << version << ");" << std::endl
+       << std::endl
+       << "  /** \\brief A client bound the global" << std::endl
+       << "      \\param client The client that bound the global" << std::endl
+       << "      \\param resource The newly created resource" << std::endl
+       << "  */" << std::endl
+       << "  std::function<void(client_t, " << name << "_t)> &on_bind();" << std::endl
+       << "};" << std::endl
+       << std::endl;
+
+    for(auto const& enumeration : enums)
+      ss << enumeration.print_header(name) << std::endl;
+
+    return ss.str();
+  }
+
+  std::string print_server_interface_header() const
+  {
+    std::stringstream ss;
+    ss << "  extern const wl_interface " << name << "_interface;" << std::endl;
+    return ss.str();
+  }
+
+  std::string print_server_body() const
+  {
+    int destroy = server_destroy_opcode();
+    std::stringstream set_events;
+    set_events << "  set_events(std::allocate_shared<events_t>(wayland::detail::allocator<events_t>(wayland::allocation_category::events)), dispatcher);" << std::endl;
+    if(destroy != -1)
+      set_events << "  set_destroy_opcode(" << destroy << "U);" << std::endl;
+
+    std::stringstream set_events_wrapped;
+    set_events_wrapped << "  if(resource_has_object())" << std::endl
+                       << "    {" << std::endl
+                       << "      set_events(std::allocate_shared<events_t>(wayland::detail::allocator<events_t>(wayland::allocation_category::events)), dispatcher);" << std::endl;
+    if(destroy != -1)
+      set_events_wrapped << "      set_destroy_opcode(" << destroy << "U);" << std::endl;
+    set_events_wrapped << "    }" << std::endl;
+
+    std::stringstream ss;
+    ss << name << "_t::" << name << "_t(const client_t& client, uint32_t version, uint32_t id)" << std::endl
+       << "  : resource_t(client, &server::detail::" << name << "_interface, static_cast<int>(version), id)" << std::endl
+       << "{" << std::endl
+       << set_events.str()
+       << "}" << std::endl
+       << std::endl
+       << name << "_t::" << name << "_t(const resource_t &resource)" << std::endl
+       << "  : resource_t(resource)" << std::endl
+       << "{" << std::endl
+       << set_events_wrapped.str()
+       << "}" << std::endl
+       << std::endl
+       << name << "_t::" << name << "_t()" << std::endl
+       << "{" << std::endl
+       << "}" << std::endl
+       << std::endl
+       << "const std::string " << name << "_t::interface_name = \"" << orig_name << "\";" << std::endl
+       << std::endl;
+
+    for(auto const& request : requests)
+      if(request.name != "destroy")
+        ss << request.print_server_signal_body(name) << std::endl;
+
+    int opcode = 0;
+    for(auto const& event : events)
+      ss << event.print_server_send_body(name, opcode++) << std::endl;
+
+    for(auto const& enumeration : enums)
+      if(enumeration.name == "error" && !enumeration.bitfield)
+        for(auto const& entry : enumeration.entries)
+          ss << "void " << name << "_t::post_" << entry.name << "(std::string const& msg)" << std::endl
+             << "{" << std::endl
+             << "  post_error(static_cast<uint32_t>(" << name << "_error::" << sanitise(entry.name) << "), msg);" << std::endl
+             << "}" << std::endl
+             << std::endl;
+
+    ss << "int " << name << "_t::dispatcher(uint32_t opcode, const wayland::detail::any_vector& args, const std::shared_ptr<wayland::detail::events_base_t>& e)" << std::endl
+       << "{" << std::endl;
+
+    bool handlers = false;
+    for(auto const& request : requests)
+      if(request.name != "destroy")
+        handlers = true;
+
+    if(handlers)
+      {
+        ss << "  std::shared_ptr<events_t> events = std::static_pointer_cast<events_t>(e);" << std::endl
+           << "  switch(opcode)" << std::endl
+           << "    {" << std::endl;
+
+        for(auto const& request : requests)
+          if(request.name != "destroy")
+            ss << request.print_server_dispatcher(request.opcode) << std::endl;
+
+        ss << "    }" << std::endl;
+      }
+
+    ss << "  return 0;" << std::endl
+       << "}" << std::endl
+       << std::endl;
+
+    ss << "global_" << name << "_t::global_" << name << "_t(display_t &display, unsigned int version)" << std::endl
+       << "  : global_base_t(display, &server::detail::" << name << "_interface, static_cast<int>(version)," << std::endl
+       << "                  std::allocate_shared<events_t>(wayland::detail::allocator<events_t>(wayland::allocation_category::events)), binder)" << std::endl
+       << "{" << std::endl
+       << "}" << std::endl
+       << std::endl
+       << "void global_" << name << "_t::binder(const std::shared_ptr<wayland::detail::events_base_t>& e, client_t client, uint32_t version, uint32_t id)" << std::endl
+       << "{" << std::endl
+       << "  " << name << "_t resource(client, version, id);" << std::endl
+       << "  std::shared_ptr<events_t> events = std::static_pointer_cast<events_t>(e);" << std::endl
+       << "  if(events->bind) events->bind(client, resource);" << std::endl
+       << "}" << std::endl
+       << std::endl
+       << "std::function<void(client_t, " << name << "_t)> &global_" << name << "_t::on_bind()" << std::endl
+       << "{" << std::endl
+       << "  return std::static_pointer_cast<events_t>(get_events())->bind;" << std::endl
+       << "}" << std::endl
+       << std::endl;
+
+    for(auto const& enumeration : enums)
+      ss << enumeration.print_body(name) << std::endl;
+
+    return ss.str();
+  }
+
+  // An untyped new_id is sent as interface name, version and id.
+  static unsigned int print_types_size(const event_t& message)
+  {
+    unsigned int size = 0;
+    for(auto const& arg : message.args)
+      size += (arg.type == "new_id" && arg.interface.empty()) ? 3 : 1;
+    return size;
+  }
+
+  static std::string print_types(const event_t& message)
+  {
+    std::stringstream ss;
+    for(auto const& arg : message.args)
+      if(!arg.interface.empty())
+        ss  << "  &" << arg.interface << "_interface," << std::endl;
+      else if(arg.type == "new_id")
+        ss  << "  nullptr," << std::endl
+            << "  nullptr," << std::endl
+            << "  nullptr," << std::endl;
+      else
+        ss  << "  nullptr," << std::endl;
+    return ss.str();
+  }
+
+  std::string print_interface_body() const
+  {
+    // The server tables must not clash with the ones of the client library.
+    const std::string storage = server ? "static " : "";
+    std::stringstream ss;
+    for(auto const& request : requests)
+      {
+        ss << storage << "const wl_interface* " << name << "_interface_" << request.name << "_request[" << print_types_size(request) << "] = {" << std::endl
+           << print_types(request)
+           << "};" << std::endl
+           << std::endl;
+      }
+    for(auto const& event : events)
+      {
+        ss << storage << "const wl_interface* " << name << "_interface_" << event.name << "_event[" << print_types_size(event) << "] = {" << std::endl
+           << print_types(event)
+           << "};" << std::endl
+           << std::endl;
+      }
+    ss << storage << "const wl_message " << name << "_interface_requests[" << requests.size() << "] = {" << std::endl;
+    for(auto const& request : requests)
+      {
+        ss << "  {" << std::endl
+           << "    \"" << request.name << "\"," << std::endl
+           << "    \"" << request.print_signature() << "\"," << std::endl
+           << "    " << name << "_interface_" << request.name << "_request," << std::endl
+           << "  }," << std::endl;
+      }
+    ss << "};" << std::endl
+       << std::endl;
+    ss << storage << "const wl_message " << name << "_interface_events[" << events.size() << "] = {" << std::endl;
+    for(auto const& event : events)
+      {
+        ss << "  {" << std::endl
+           << "    \"" << event.name << "\"," << std::endl
+           << "    \"" << event.print_signature() << "\"," << std::endl
+           << "    " << name << "_interface_" << event.name << "_event," << std::endl
+           << "  }," << std::endl;
+      }
+    ss << "};" << std::endl
+       << std::endl;
+    ss << "const wl_interface wayland::" << (server ? "server::" : "") << "detail::" << name << "_interface =" << std::endl
+       << "  {" << std::endl
+       << "    \"" << orig_name << "\"," << std::endl
+       << "    " << version << "," << std::endl
+       << "    " << requests.size() << "," << std::endl
+       << "    " << name << "_interface_requests," << std::endl
+       << "    " << events.size() << "," << std::endl
+       << "    " << name << "_interface_events," << std::endl
+       << "  };" << std::endl
+       << std::endl;
+
+    return ss.str();
+  }
+};
+
+// Strips the wl_ and wp_ prefixes.
+std::string unprefix(const std::string &name);
+
+// Parses a single protocol file. Enum ids are assigned by the caller.
+std::vector<interface_t> parse_protocol(const std::string& file);
+
+#endif
@@ -0,0 +1,441 @@
+/*
+ *  Copyright (c) 2014-2019 Nils Christopher Brause, Philipp Kerling, Bernd Kuhls
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+#include "protocol.hpp"
+#include "wayland-trace.hpp"
+
+using namespace wayland;
+
+// A decoded request or event
+struct message_t
+{
+  trace::record_t header;
+  std::string interface;
+  const interface_t *iface = nullptr;
+  const event_t *msg = nullptr;
+  const char *payload = nullptr;
+  std::size_t payload_size = 0;
+};
+
+// Reads a trace file and sorts its messages by time.
+class trace_file_t
+{
+private:
+  std::vector<char> content;
+  std::map<uint16_t, std::string> interfaces;
+
+public:
+  trace::file_header_t header;
+  std::vector<message_t> messages;
+
+  trace_file_t(const std::string& file, const std::map<std::string, const interface_t*>& protocol)
+  {
+    std::ifstream in(file, std::ios_base::in | std::ios_base::binary);
+    if(!in)
+      throw std::runtime_error("Could not open " + file);
+    content.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    if(content.size() < sizeof(header))
+      throw std::runtime_error(file + " is not a trace file");
+    std::memcpy(&header, content.data(), sizeof(header));
+    if(std::memcmp(header.magic, trace::magic, sizeof(header.magic)) != 0)
+      throw std::runtime_error(file + " is not a trace file");
+    if(header.version != trace::version)
+      throw std::runtime_error(file + " has an unsupported version");
+
+    // The size is only written when the tracer stops. The trace of a
+    // process that crashed or was killed goes up to the first empty record.
+    bool complete = header.size != 0;
+    if(!complete)
+      std::cerr << "Warning: " << file << " was not closed, reading up to the last complete record" << std::endl;
+    std::size_t end = complete ? std::min<std::size_t>(content.size(), sizeof(header) + header.size) : content.size();
+    std::size_t pos = sizeof(header);
+    while(pos < end)
+      {
+        message_t m;
+        if(pos + sizeof(trace::record_t) <= end)
+          std::memcpy(&m.header, content.data() + pos, sizeof(m.header));
+        if(!complete && pos + sizeof(trace::record_t) <= end && m.header.size == 0)
+          break;
+        if(pos + sizeof(trace::record_t) > end || m.header.size < sizeof(trace::record_t) || pos + m.header.size > end)
+          {
+            std::cerr << "Warning: " << file << " is truncated, ignoring its last " << end - pos << " bytes" << std::endl;
+            break;
+          }
+        m.payload = content.data() + pos + sizeof(trace::record_t);
+        m.payload_size = m.header.size - sizeof(trace::record_t);
+        pos += m.header.size;
+
+        if(m.header.type == trace::record_type::interface)
+          {
+            interfaces[m.header.interface] = std::string(m.payload, strnlen(m.payload, m.payload_size));
+            continue;
+          }
+        if(m.header.type != trace::record_type::request && m.header.type != trace::record_type::event)
+          continue;
+
+        m.interface = interfaces[m.header.interface];
+        auto it = protocol.find(m.interface);
+        if(it != protocol.end())
+          {
+            m.iface = it->second;
+            if(m.header.type == trace::record_type::request && m.header.opcode < m.iface->requests.size())
+              m.msg = &m.iface->requests[m.header.opcode];
+            if(m.header.type == trace::record_type::event && m.header.opcode < m.iface->events.size())
+              m.msg = &m.iface->events[m.header.opcode];
+          }
+        messages.push_back(m);
+      }
+
+    // every thread has its own ring buffer, so records are only ordered
+    // per thread
+    std::stable_sort(messages.begin(), messages.end(), [] (const message_t& a, const message_t& b)
+                     { return a.header.time < b.header.time; });
+  }
+
+  // Time since the start of the trace in milliseconds.
+  double time(const message_t& m) const
+  {
+    return static_cast<double>(m.header.time - header.start_time) / 1e6;
+  }
+};
+
+// Reads the arguments of a message.
+class argument_reader_t
+{
+private:
+  const message_t& message;
+  std::size_t pos = 0;
+
+public:
+  argument_reader_t(const message_t& m)
+    : message(m)
+  {
+  }
+
+  uint32_t get()
+  {
+    if(pos + 4 > message.payload_size)
+      throw std::runtime_error("Truncated message");
+    uint32_t value = 0;
+    std::memcpy(&value, message.payload + pos, 4);
+    pos += 4;
+    return value;
+  }
+
+  std::string get_data(uint32_t size, uint32_t max_payload)
+  {
+    std::size_t n = std::min(size, max_payload);
+    if(pos + n > message.payload_size)
+      throw std::runtime_error("Truncated message");
+    std::string data(message.payload + pos, n);
+    pos += (n + 3) & ~std::size_t(3);
+    return data;
+  }
+};
+
+std::string print_object(const std::string& interface, uint32_t id)
+{
+  if(id == 0)
+    return "nil";
+  return (interface.empty() ? "object" : interface) + "@" + std::to_string(id);
+}
+
+// Formats a message like WAYLAND_DEBUG does.
+std::string print_message(const trace_file_t& trace, const message_t& m)
+{
+  std::stringstream ss;
+  ss << "[" << std::fixed << std::setprecision(3) << std::setw(12) << trace.time(m) << "] "
+     << "{" << m.header.thread << "}"
+     << (m.header.type == trace::record_type::request ? " -> " : " ")
+     << print_object(m.iface ? m.iface->name : m.interface, m.header.object) << ".";
+  if(!m.msg)
+    {
+      ss << "#" << m.header.opcode << "(?)";
+      return ss.str();
+    }
+
+  ss << m.msg->name << "(";
+  argument_reader_t reader(m);
+  std::vector<std::string> args;
+  try
+    {
+      for(auto const& arg : m.msg->args)
+        {
+          if(arg.type == "int")
+            args.push_back(std::to_string(static_cast<int32_t>(reader.get())));
+          else if(arg.type == "uint")
+            args.push_back(std::to_string(reader.get()));
+          else if(arg.type == "fixed")
+            args.push_back(std::to_string(static_cast<int32_t>(reader.get()) / 256.0));
+          else if(arg.type == "fd")
+            args.push_back("fd " + std::to_string(reader.get()));
+          else if(arg.type == "object")
+            args.push_back(print_object(arg.interface, reader.get()));
+          else if(arg.type == "new_id")
+            {
+              std::string interface = arg.interface;
+              // untyped new_id, e.g. wl_registry.bind
+              if(interface.empty())
+                {
+                  uint32_t size = reader.get();
+                  interface = unprefix(reader.get_data(size, trace.header.max_payload).c_str());
+                  reader.get();
+                }
+              args.push_back("new " + print_object(interface, reader.get()));
+            }
+          else if(arg.type == "string")
+            {
+              uint32_t size = reader.get();
+              if(size == 0)
+                args.push_back("nil");
+              else
+                {
+                  std::string str = reader.get_data(size, trace.header.max_payload);
+                  args.push_back("\"" + std::string(str.c_str()) + (size > trace.header.max_payload ? "\"..." : "\""));
+                }
+            }
+          else if(arg.type == "array")
+            {
+              uint32_t size = reader.get();
+              reader.get_data(size, trace.header.max_payload);
+              args.push_back("array[" + std::to_string(size) + "]");
+            }
+        }
+    }
+  catch(std::exception& e)
+    {
+      args.push_back("<" + std::string(e.what()) + ">");
+    }
+  ss << join(args) << ")";
+  return ss.str();
+}
+
+// min, mean, median, 99th percentile and max of a list of values
+std::string print_distribution(std::vector<double> values)
+{
+  if(values.empty())
+    return "none";
+  std::sort(values.begin(), values.end());
+  double sum = 0;
+  for(double v : values)
+    sum += v;
+  std::stringstream ss;
+  ss << std::fixed << std::setprecision(3)
+     << "n=" << values.size()
+     << " min=" << values.front()
+     << " mean=" << sum / static_cast<double>(values.size())
+     << " median=" << values[values.size() / 2]
+     << " p99=" << values[std::min(values.size() - 1, values.size() * 99 / 100)]
+     << " max=" << values.back() << " ms";
+  return ss.str();
+}
+
+void print_statistics(const trace_file_t& trace, double window)
+{
+  const auto& messages = trace.messages;
+  if(messages.empty())
+    {
+      std::cout << "No messages." << std::endl;
+      return;
+    }
+  double duration = std::max(trace.time(messages.back()) - trace.time(messages.front()), 1e-3);
+
+  // message rates
+  std::map<std::string, std::pair<std::size_t, std::size_t>> counts;
+  std::map<std::string, std::size_t> message_counts;
+  for(auto const& m : messages)
+    {
+      auto& count = counts[m.interface];
+      std::string name = m.interface + "." + (m.msg ? m.msg->name : "#" + std::to_string(m.header.opcode));
+      if(m.header.type == trace::record_type::request)
+        count.first++;
+      else
+        count.second++;
+      message_counts[name]++;
+    }
+
+  std::cout << messages.size() << " messages in " << std::fixed << std::setprecision(3) << duration << " ms" << std::endl
+            << std::endl
+            << "Interface                                 requests      req/s    events      ev/s" << std::endl;
+  for(auto const& count : counts)
+    std::cout << std::left << std::setw(40) << count.first << std::right
+              << std::setw(10) << count.second.first
+              << std::setw(11) << std::setprecision(1) << static_cast<double>(count.second.first) * 1000.0 / duration
+              << std::setw(10) << count.second.second
+              << std::setw(10) << static_cast<double>(count.second.second) * 1000.0 / duration << std::endl;
+
+  std::vector<std::pair<std::size_t, std::string>> top;
+  for(auto const& count : message_counts)
+    top.emplace_back(count.second, count.first);
+  std::sort(top.rbegin(), top.rend());
+  std::cout << std::endl << "Most frequent messages:" << std::endl;
+  for(std::size_t c = 0; c < top.size() && c < 10; c++)
+    std::cout << std::setw(10) << top[c].first << "  " << top[c].second << std::endl;
+
+  // roundtrips and frame callbacks: a wl_callback created by
+  // wl_display.sync or wl_surface.frame is answered by wl_callback.done
+  struct pending_t
+  {
+    double time;
+    bool frame;
+    uint32_t surface;
+  };
+  std::map<uint32_t, pending_t> callbacks;
+  std::map<uint32_t, double> last_frame;
+  std::vector<double> roundtrips;
+  std::vector<double> frame_latencies;
+  std::vector<double> frame_intervals;
+  for(auto const& m : messages)
+    {
+      if(!m.msg)
+        continue;
+      if(m.header.type == trace::record_type::request
+         && ((m.interface == "wl_display" && m.msg->name == "sync")
+             || (m.interface == "wl_surface" && m.msg->name == "frame")))
+        {
+          argument_reader_t reader(m);
+          try
+            {
+              callbacks[reader.get()] = pending_t{trace.time(m), m.msg->name == "frame", m.header.object};
+            }
+          catch(std::exception&)
+            {
+            }
+        }
+      else if(m.header.type == trace::record_type::event && m.interface == "wl_callback" && m.msg->name == "done")
+        {
+          auto it = callbacks.find(m.header.object);
+          if(it == callbacks.end())
+            continue;
+          double latency = trace.time(m) - it->second.time;
+          if(it->second.frame)
+            {
+              frame_latencies.push_back(latency);
+              auto last = last_frame.find(it->second.surface);
+              if(last != last_frame.end())
+                frame_intervals.push_back(trace.time(m) - last->second);
+              last_frame[it->second.surface] = trace.time(m);
+            }
+          else
+            roundtrips.push_back(latency);
+          callbacks.erase(it);
+        }
+    }
+
+  std::cout << std::endl
+            << "Roundtrip latency:        " << print_distribution(roundtrips) << std::endl
+            << "Frame callback latency:   " << print_distribution(frame_latencies) << std::endl
+            << "Frame callback interval:  " << print_distribution(frame_intervals) << std::endl;
+
+  // bursts: the most messages within a sliding window
+  std::vector<std::pair<std::size_t, std::size_t>> bursts;
+  std::size_t first = 0;
+  for(std::size_t c = 0; c < messages.size(); c++)
+    {
+      while(trace.time(messages[c]) - trace.time(messages[first]) > window)
+        first++;
+      bursts.emplace_back(c - first + 1, first);
+    }
+  std::sort(bursts.begin(), bursts.end(), [] (const std::pair<std::size_t, std::size_t>& a, const std::pair<std::size_t, std::size_t>& b)
+            { return a.first > b.first || (a.first == b.first && a.second < b.second); });
+  std::cout << std::endl << std::setprecision(3) << "Largest bursts within " << window << " ms:" << std::endl;
+  std::vector<std::size_t> shown;
+  for(auto const& burst : bursts)
+    {
+      if(shown.size() == 5)
+        break;
+      // skip windows overlapping with a larger burst
+      if(std::any_of(shown.begin(), shown.end(), [&] (std::size_t start)
+                     { return std::abs(trace.time(messages[start]) - trace.time(messages[burst.second])) < window; }))
+        continue;
+      shown.push_back(burst.second);
+      std::cout << std::setw(10) << burst.first << " messages at " << trace.time(messages[burst.second]) << " ms" << std::endl;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+  bool statistics = false;
+  double window = 1.0;
+  std::vector<std::string> files;
+  for(int c = 1; c < argc; c++)
+    {
+      std::string arg(argv[c]);
+      if(arg == "-s")
+        statistics = true;
+      else if(arg == "-w" && c + 1 < argc)
+        {
+          try
+            {
+              window = std::stod(argv[++c]);
+            }
+          catch(std::exception&)
+            {
+              window = 0;
+            }
+        }
+      else
+        files.push_back(arg);
+    }
+
+  if(files.size() < 2 || !(window > 0))
+    {
+      std::cerr << "Usage:" << std::endl
+                << "  " << argv[0] << " [-s] [-w window] trace protocol1.xml [protocol2.xml ...]" << std::endl
+                << std::endl
+                << "  -s         Print statistics instead of the messages" << std::endl
+                << "  -w window  Window in ms in which bursts are counted (default: 1)" << std::endl;
+      return 1;
+    }
+
+  try
+    {
+      std::vector<interface_t> interfaces;
+      for(std::size_t c = 1; c < files.size(); c++)
+        for(auto& iface : parse_protocol(files[c]))
+          interfaces.push_back(std::move(iface));
+      std::map<std::string, const interface_t*> protocol;
+      for(auto const& iface : interfaces)
+        protocol[iface.orig_name] = &iface;
+
+      trace_file_t trace(files[0], protocol);
+      if(statistics)
+        print_statistics(trace, window);
+      else
+        for(auto const& m : trace.messages)
+          std::cout << print_message(trace, m) << std::endl;
+    }
+  catch(std::exception& e)
+    {
+      std::cerr << e.what() << std::endl;
+      return 1;
+    }
+
+  return 0;
+}
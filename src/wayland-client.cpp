@@ -27,23 +27,144 @@
 #include <cstdio>
 #include <cerrno>
 
+#include <cstring>
 #include <iostream>
 #include <limits>
+#include <map>
+#include <mutex>
+#include <sstream>
 #include <system_error>
+#include <thread>
+#include <tuple>
+#include <unordered_map>
 #include <wayland-client.hpp>
 #include <wayland-client-protocol.hpp>
+#include <wayland-trace.hpp>
 
 using namespace wayland;
 using namespace wayland::detail;
 
+constexpr std::size_t log_record_t::max_length;
+
 namespace
 {
 
 log_handler g_log_handler;
 
+// Bounded multi producer, multi consumer queue of log records, after
+// Dmitry Vyukov. Every slot carries a sequence number that tells
+// producers and consumers whether it is free or filled for their turn.
+class log_queue_t
+{
+private:
+  struct slot_t
+  {
+    std::atomic<std::size_t> sequence{0};
+    log_record_t record;
+  };
+
+  std::unique_ptr<slot_t[]> slots;
+  std::size_t mask;
+  // padded to separate cache lines, producers and consumers do not share
+  // them (alignas would need an over-aligned new)
+  char pad0[64];
+  std::atomic<std::size_t> enqueue_pos{0};
+  char pad1[64];
+  std::atomic<std::size_t> dequeue_pos{0};
+  char pad2[64];
+
+public:
+  std::atomic<uint64_t> dropped{0};
+
+  log_queue_t(std::size_t capacity)
+  {
+    std::size_t size = 2;
+    while(size < capacity)
+      size *= 2;
+    slots.reset(new slot_t[size]);
+    mask = size - 1;
+    for(std::size_t c = 0; c < size; c++)
+      slots[c].sequence.store(c, std::memory_order_relaxed);
+  }
+
+  bool push(const log_record_t &record)
+  {
+    std::size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+    slot_t *slot = nullptr;
+    while(true)
+      {
+        slot = &slots[pos & mask];
+        std::size_t sequence = slot->sequence.load(std::memory_order_acquire);
+        auto diff = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(pos);
+        if(diff == 0)
+          {
+            if(enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+              break;
+          }
+        else if(diff < 0)
+          return false;
+        else
+          pos = enqueue_pos.load(std::memory_order_relaxed);
+      }
+    // only copy the used part of the message
+    slot->record.time = record.time;
+    slot->record.length = record.length;
+    slot->record.truncated = record.truncated;
+    std::memcpy(slot->record.message, record.message, record.length + 1);
+    slot->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool pop(log_record_t &record)
+  {
+    std::size_t pos = dequeue_pos.load(std::memory_order_relaxed);
+    slot_t *slot = nullptr;
+    while(true)
+      {
+        slot = &slots[pos & mask];
+        std::size_t sequence = slot->sequence.load(std::memory_order_acquire);
+        auto diff = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(pos + 1);
+        if(diff == 0)
+          {
+            if(dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+              break;
+          }
+        else if(diff < 0)
+          return false;
+        else
+          pos = dequeue_pos.load(std::memory_order_relaxed);
+      }
+    record.time = slot->record.time;
+    record.length = slot->record.length;
+    record.truncated = slot->record.truncated;
+    std::memcpy(record.message, slot->record.message, slot->record.length + 1);
+    slot->sequence.store(pos + mask + 1, std::memory_order_release);
+    return true;
+  }
+};
+
+// Created once and never freed, the C library may log at any time
+std::atomic<log_queue_t*> g_log_queue{nullptr};
+std::atomic<bool> g_log_async{false};
+
 extern "C"
 void _c_log_handler(const char *format, va_list args)
 {
+  if(g_log_async.load(std::memory_order_acquire))
+    {
+      log_queue_t *queue = g_log_queue.load(std::memory_order_acquire);
+      thread_local log_record_t record;
+      record.time = std::chrono::system_clock::now();
+      int length = std::vsnprintf(record.message, sizeof(record.message), format, args);
+      if(length < 0)
+        return;
+      record.truncated = static_cast<std::size_t>(length) > log_record_t::max_length;
+      record.length = static_cast<uint32_t>(std::min(static_cast<std::size_t>(length), log_record_t::max_length));
+      if(!queue->push(record))
+        queue->dropped.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+
   if(!g_log_handler)
     return;
 
@@ -52,12 +173,22 @@ void _c_log_handler(const char *format, va_list args)
 
   // vsnprintf consumes args, so copy beforehand
   va_copy(args_copy, args);
-  int length = std::vsnprintf(nullptr, 0, format, args);
+
+  // Most messages fit into a thread local buffer, which saves formatting
+  // twice and the allocation of a buffer
+  thread_local char small[256];
+  int length = std::vsnprintf(small, sizeof(small), format, args);
   if(length < 0)
   {
     va_end(args_copy);
     throw std::runtime_error("Error getting length of formatted wayland-client log message");
   }
+  if(static_cast<std::size_t>(length) < sizeof(small))
+  {
+    va_end(args_copy);
+    g_log_handler(small);
+    return;
+  }
 
   // check for possible overflow - could be done at runtime but the following should hold on all usual platforms
   static_assert(std::numeric_limits<std::vector<char>::size_type>::max() >= std::numeric_limits<int>::max() + 1U /* NUL */, "vector constructor must allow size big enough for vsnprintf return value");
@@ -65,7 +196,7 @@ void _c_log_handler(const char *format, va_list args)
   // for terminating NUL
   length++;
 
-  std::vector<char> buf(static_cast<std::vector<char>::size_type>(length));
+  std::vector<char, allocator<char>> buf(static_cast<std::vector<char>::size_type>(length), allocator<char>(allocation_category::log));
   if(std::vsnprintf(buf.data(), buf.size(), format, args_copy) < 0)
     throw std::runtime_error("Error formatting wayland-client log message");
 
@@ -76,23 +207,303 @@ void _c_log_handler(const char *format, va_list args)
 
 }
 
+namespace
+{
+
+// Counters of one message. Only the thread owning the shard adds to them.
+struct message_counters_t
+{
+  std::atomic<uint64_t> count{0};
+  std::atomic<uint64_t> bytes{0};
+  std::atomic<uint64_t> handler_ns{0};
+};
+
+struct message_key_t
+{
+  const char *interface;
+  const char *message;
+  uint32_t opcode;
+  bool event;
+
+  bool operator==(const message_key_t &k) const
+  {
+    return interface == k.interface && opcode == k.opcode && event == k.event;
+  }
+};
+
+struct message_key_hash_t
+{
+  std::size_t operator()(const message_key_t &k) const
+  {
+    return std::hash<const void*>()(k.interface) ^ (static_cast<std::size_t>(k.opcode) << 1 | (k.event ? 1 : 0));
+  }
+};
+
+// Statistics of one thread
+struct stats_shard_t
+{
+  // guards insertions, which only the owning thread makes
+  std::mutex mutex;
+  std::unordered_map<message_key_t, std::unique_ptr<message_counters_t>, message_key_hash_t> counters;
+};
+
+std::atomic<uint64_t> next_stats_id{1};
+
+// Size of a message on the wire, file descriptors are passed out of band
+uint64_t wire_size(const char *signature, const wl_argument *args)
+{
+  uint64_t size = 8;
+  for(const char *s = signature; s && *s; s++)
+    {
+      switch(*s)
+        {
+        case 'i': case 'u': case 'f': case 'o': case 'n':
+          size += 4;
+          break;
+        case 's':
+          size += 4 + (args->s ? (std::strlen(args->s) + 4) & ~std::size_t(3) : 0);
+          break;
+        case 'a':
+          size += 4 + (args->a ? (args->a->size + 3) & ~std::size_t(3) : 0);
+          break;
+        case 'h':
+          break;
+        default:
+          continue;
+        }
+      args++;
+    }
+  return size;
+}
+
+}
+
+// message statistics of a display, shared by all its proxies
+struct wayland::detail::display_stats_t
+{
+  std::atomic<bool> enabled{false};
+  // distinguishes the statistics of displays allocated at the same address
+  const uint64_t id{next_stats_id++};
+  std::mutex mutex;
+  std::map<std::thread::id, std::unique_ptr<stats_shard_t>> shards;
+
+  stats_shard_t &shard()
+  {
+    thread_local uint64_t cached_id = 0;
+    thread_local stats_shard_t *cached = nullptr;
+    if(cached_id != id)
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::unique_ptr<stats_shard_t> &s = shards[std::this_thread::get_id()];
+        if(!s)
+          s.reset(new stats_shard_t);
+        cached_id = id;
+        cached = s.get();
+      }
+    return *cached;
+  }
+
+  message_counters_t &counters(const message_key_t &key)
+  {
+    stats_shard_t &s = shard();
+    auto it = s.counters.find(key);
+    if(it != s.counters.end())
+      return *it->second;
+    std::lock_guard<std::mutex> lock(s.mutex);
+    std::unique_ptr<message_counters_t> &c = s.counters[key];
+    c.reset(new message_counters_t);
+    return *c;
+  }
+
+  // time from display_t::sync() or roundtrip() to completion
+  latency_histogram_t roundtrip_latency;
+  // time from wl_surface.commit to the done event of its frame callbacks
+  latency_histogram_t frame_latency;
+
+  // all live proxies of the display, linked through proxy_data_t
+  std::mutex proxies_mutex;
+  proxy_data_t *proxies = nullptr;
+
+  void add(const message_key_t &key, const char *signature, const wl_argument *args, uint64_t handler_ns = 0)
+  {
+    message_counters_t &c = counters(key);
+    c.count.fetch_add(1, std::memory_order_relaxed);
+    c.bytes.fetch_add(wire_size(signature, args), std::memory_order_relaxed);
+    if(handler_ns)
+      c.handler_ns.fetch_add(handler_ns, std::memory_order_relaxed);
+  }
+};
+
+namespace
+{
+
+// A callback whose latency is measured
+struct pending_latency_t
+{
+  // steady_clock time since epoch of the start, negative until started
+  std::atomic<int64_t> start{-1};
+  std::vector<latency_histogram_t> histograms;
+};
+
+// Frame callbacks of a surface
+struct surface_frames_t
+{
+  latency_histogram_t latency;
+  // requested since the last commit
+  std::vector<std::shared_ptr<pending_latency_t>> uncommitted;
+};
+
+int64_t steady_now()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+uint32_t request_opcode(const wl_interface &interface, const char *name)
+{
+  for(int c = 0; c < interface.method_count; c++)
+    if(std::strcmp(interface.methods[c].name, name) == 0)
+      return static_cast<uint32_t>(c);
+  return std::numeric_limits<uint32_t>::max();
+}
+
+}
+
 // stored in the proxy user data
 struct wayland::detail::proxy_data_t
 {
+  std::shared_ptr<display_stats_t> stats;
   std::shared_ptr<events_base_t> events;
   bool has_destroy_opcode{false};
   std::uint32_t destroy_opcode{};
   std::atomic<unsigned int> counter{1};
   event_queue_t queue;
   proxy_t wrapped_proxy;
+  // only set for surfaces that requested a frame callback
+  std::shared_ptr<surface_frames_t> frames;
+  // only set for callbacks of display_t::sync() and surface_t::frame()
+  std::shared_ptr<pending_latency_t> pending_latency;
+  // list of the live proxies of the display, see link_proxy()
+  const char *interface_name = nullptr;
+  proxy_data_t *prev = nullptr;
+  proxy_data_t *next = nullptr;
+  // only set for wl_shm_pool, its size in bytes
+  int32_t pool_size = 0;
+  // the dispatcher takes a std::vector<any>, see set_events()
+  bool vector_dispatcher = false;
 };
 
+namespace
+{
+
+// Associates the data of a proxy with a display and adds it to the
+// list of its live proxies
+void link_proxy(proxy_data_t &data, const std::shared_ptr<display_stats_t> &stats, wl_proxy *proxy)
+{
+  if(!stats)
+    return;
+  data.stats = stats;
+  data.interface_name = wl_proxy_get_class(proxy);
+  std::lock_guard<std::mutex> lock(stats->proxies_mutex);
+  data.next = stats->proxies;
+  if(data.next)
+    data.next->prev = &data;
+  stats->proxies = &data;
+}
+
+void unlink_proxy(proxy_data_t &data)
+{
+  if(!data.stats)
+    return;
+  std::lock_guard<std::mutex> lock(data.stats->proxies_mutex);
+  if(data.prev)
+    data.prev->next = data.next;
+  else
+    data.stats->proxies = data.next;
+  if(data.next)
+    data.next->prev = data.prev;
+  data.prev = data.next = nullptr;
+}
+
+// Starts measuring sync and frame callbacks and keeps track of the size
+// of shm pools, created is the proxy returned by the request, if any.
+void track_request(const wl_interface *interface, uint32_t opcode, const wl_argument *args,
+                   proxy_data_t &data, proxy_data_t *created)
+{
+  static const uint32_t sync = request_opcode(detail::display_interface, "sync");
+  static const uint32_t frame = request_opcode(detail::surface_interface, "frame");
+  static const uint32_t commit = request_opcode(detail::surface_interface, "commit");
+  static const uint32_t create_pool = request_opcode(detail::shm_interface, "create_pool");
+  static const uint32_t resize = request_opcode(detail::shm_pool_interface, "resize");
+
+  // wl_shm.create_pool(id, fd, size) and wl_shm_pool.resize(size)
+  if(interface == &detail::shm_interface && opcode == create_pool && created)
+    created->pool_size = args[2].i;
+  else if(interface == &detail::shm_pool_interface && opcode == resize)
+    data.pool_size = args[0].i;
+
+  if(interface == &detail::display_interface && opcode == sync && created)
+    {
+      auto pending = std::make_shared<pending_latency_t>();
+      pending->histograms.push_back(data.stats->roundtrip_latency);
+      pending->start.store(steady_now(), std::memory_order_release);
+      created->pending_latency = pending;
+    }
+  else if(interface == &detail::surface_interface)
+    {
+      if(opcode == frame && created)
+        {
+          if(!data.frames)
+            data.frames = std::make_shared<surface_frames_t>();
+          auto pending = std::make_shared<pending_latency_t>();
+          pending->histograms.push_back(data.stats->frame_latency);
+          pending->histograms.push_back(data.frames->latency);
+          data.frames->uncommitted.push_back(pending);
+          created->pending_latency = pending;
+        }
+      else if(opcode == commit && data.frames)
+        {
+          int64_t now = steady_now();
+          for(auto &pending : data.frames->uncommitted)
+            pending->start.store(now, std::memory_order_release);
+          data.frames->uncommitted.clear();
+        }
+    }
+}
+
+}
+
 void wayland::set_log_handler(log_handler handler)
 {
   g_log_handler = std::move(handler);
+  g_log_async = false;
   wl_log_set_handler_client(_c_log_handler);
 }
 
+void wayland::set_async_log_handler(std::size_t capacity)
+{
+  if(!g_log_queue.load())
+    {
+      log_queue_t *queue = new log_queue_t(capacity);
+      log_queue_t *expected = nullptr;
+      if(!g_log_queue.compare_exchange_strong(expected, queue))
+        delete queue;
+    }
+  g_log_async = true;
+  wl_log_set_handler_client(_c_log_handler);
+}
+
+bool wayland::read_log_record(log_record_t &record)
+{
+  log_queue_t *queue = g_log_queue.load(std::memory_order_acquire);
+  return queue && queue->pop(record);
+}
+
+uint64_t wayland::dropped_log_records()
+{
+  log_queue_t *queue = g_log_queue.load(std::memory_order_acquire);
+  return queue ? queue->dropped.load(std::memory_order_relaxed) : 0;
+}
+
 event_queue_t::event_queue_t(wl_event_queue *q)
   : detail::refcounted_wrapper<wl_event_queue>({q, wl_event_queue_destroy})
 {
@@ -111,11 +522,16 @@ int proxy_t::c_dispatcher(const void *implementation, void *target, uint32_t opc
 
   // Don't bother dispatching for objects that we don't know about, or not
   // any more (they will not have any C++ event handlers anyway)
-  if(!wl_proxy_get_user_data(reinterpret_cast<wl_proxy*>(target)))
+  auto *target_data = static_cast<proxy_data_t*>(wl_proxy_get_user_data(reinterpret_cast<wl_proxy*>(target)));
+  if(!target_data)
     return 0;
 
+  if(trace_enabled.load(std::memory_order_relaxed))
+    trace_message(trace::record_type::event, target, wl_proxy_get_class(reinterpret_cast<wl_proxy*>(target)),
+                  opcode, message->signature, args);
+
   std::string signature(message->signature);
-  std::vector<any> vargs;
+  any_vector vargs(allocator<any>(allocation_category::arguments));
   unsigned int c = 0;
   for(char ch : signature)
     {
@@ -139,7 +555,7 @@ int proxy_t::c_dispatcher(const void *implementation, void *target, uint32_t opc
           break;
           // fixed
         case 'f':
-          a = wl_fixed_to_double(args[c].f);
+          a = fixed_t::from_raw(args[c].f);
           break;
           // string
         case 's':
@@ -162,7 +578,9 @@ int proxy_t::c_dispatcher(const void *implementation, void *target, uint32_t opc
               {
                 auto *proxy = reinterpret_cast<wl_proxy*>(args[c].o);
                 wl_proxy_set_user_data(proxy, nullptr); // Wayland leaves the user data uninitialized
-                a = proxy_t(proxy);
+                proxy_t new_proxy(proxy);
+                link_proxy(*new_proxy.data, target_data->stats, proxy);
+                a = new_proxy;
               }
             else
               a = proxy_t();
@@ -183,35 +601,94 @@ int proxy_t::c_dispatcher(const void *implementation, void *target, uint32_t opc
       c++;
     }
   proxy_t p(reinterpret_cast<wl_proxy*>(target), wrapper_type::standard);
-  using dispatcher_func = int(*)(std::uint32_t, const std::vector<any>&, const std::shared_ptr<events_base_t>&);
-  auto dispatcher = reinterpret_cast<dispatcher_func>(const_cast<void*>(implementation));
-  return dispatcher(opcode, vargs, p.get_events());
+  using dispatcher_func = int(*)(std::uint32_t, const any_vector&, const std::shared_ptr<events_base_t>&);
+  using vector_dispatcher_func = int(*)(std::uint32_t, const std::vector<any>&, const std::shared_ptr<events_base_t>&);
+  auto dispatch = [&] ()
+    {
+      if(target_data->vector_dispatcher)
+        return reinterpret_cast<vector_dispatcher_func>(const_cast<void*>(implementation))
+          (opcode, std::vector<any>(vargs.begin(), vargs.end()), p.get_events());
+      return reinterpret_cast<dispatcher_func>(const_cast<void*>(implementation))(opcode, vargs, p.get_events());
+    };
+  if(target_data->pending_latency)
+    {
+      // the only event of a callback is done
+      int64_t start = target_data->pending_latency->start.load(std::memory_order_acquire);
+      if(start >= 0)
+        for(auto &histogram : target_data->pending_latency->histograms)
+          histogram.record(std::chrono::nanoseconds(steady_now() - start));
+      target_data->pending_latency.reset();
+    }
+  if(!target_data->stats || !target_data->stats->enabled.load(std::memory_order_relaxed))
+    return dispatch();
+
+  auto start = std::chrono::steady_clock::now();
+  int result = dispatch();
+  auto time = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+  message_key_t key = {wl_proxy_get_class(reinterpret_cast<wl_proxy*>(target)), message->name, opcode, true};
+  target_data->stats->add(key, message->signature, args, static_cast<uint64_t>(time.count()));
+  return result;
 }
 
-proxy_t proxy_t::marshal_single(uint32_t opcode, const wl_interface *interface, const std::vector<argument_t>& args, std::uint32_t version)
+proxy_t proxy_t::marshal_single(uint32_t opcode, const wl_interface *interface, const argument_vector& args, std::uint32_t version)
 {
-  std::vector<wl_argument> v;
+  std::vector<wl_argument, allocator<wl_argument>> v(allocator<wl_argument>(allocation_category::arguments));
   v.reserve(args.size());
   for(auto const& arg : args)
     v.push_back(arg.get_c_argument());
+  return marshal_single(opcode, interface, v.data(), version);
+}
+
+proxy_t proxy_t::marshal_single(uint32_t opcode, const wl_interface *interface, wl_argument *args, std::uint32_t version)
+{
+  if(data && data->stats && data->stats->enabled.load(std::memory_order_relaxed))
+    {
+      const wl_message *request = nullptr;
+      if(this->interface && opcode < static_cast<uint32_t>(this->interface->method_count))
+        request = &this->interface->methods[opcode];
+      message_key_t key = {wl_proxy_get_class(proxy), request ? request->name : nullptr, opcode, false};
+      data->stats->add(key, request ? request->signature : nullptr, args);
+    }
+
   if(interface)
     {
       wl_proxy *p = nullptr;
       if(version > 0)
-        p = wl_proxy_marshal_array_constructor_versioned(c_ptr(), opcode, v.data(), interface, version);
+        p = wl_proxy_marshal_array_constructor_versioned(c_ptr(), opcode, args, interface, version);
       else
-        p = wl_proxy_marshal_array_constructor(c_ptr(), opcode, v.data(), interface);
+        p = wl_proxy_marshal_array_constructor(c_ptr(), opcode, args, interface);
 
       if(!p)
         throw std::runtime_error("wl_proxy_marshal_array_constructor");
+      // traced afterwards, libwayland fills in the new object
+      if(trace_enabled.load(std::memory_order_relaxed))
+        trace_request(opcode, args);
       wl_proxy_set_user_data(p, nullptr); // Wayland leaves the user data uninitialized
       // libwayland-client inherits the queue, so we need to, too
-      return proxy_t(p, wrapper_type::standard, data ? data->queue : wayland::event_queue_t());
+      proxy_t result(p, wrapper_type::standard, data ? data->queue : wayland::event_queue_t());
+      if(data && data->stats)
+        {
+          link_proxy(*result.data, data->stats, p);
+          track_request(this->interface, opcode, args, *data, result.data);
+        }
+      return result;
     }
-  wl_proxy_marshal_array(proxy, opcode, v.data());
+  if(trace_enabled.load(std::memory_order_relaxed))
+    trace_request(opcode, args);
+  if(data && data->stats)
+    track_request(this->interface, opcode, args, *data, nullptr);
+  wl_proxy_marshal_array(proxy, opcode, args);
   return proxy_t();
 }
 
+void proxy_t::trace_request(uint32_t opcode, wl_argument *args)
+{
+  const char *signature = nullptr;
+  if(interface && opcode < static_cast<uint32_t>(interface->method_count))
+    signature = interface->methods[opcode].signature;
+  trace_message(trace::record_type::request, proxy, wl_proxy_get_class(proxy), opcode, signature, args);
+}
+
 void proxy_t::set_interface(const wl_interface *iface)
 {
   interface = iface;
@@ -234,7 +711,7 @@ void proxy_t::set_destroy_opcode(uint32_t destroy_opcode)
 }
 
 void proxy_t::set_events(std::shared_ptr<events_base_t> events,
-                         int(*dispatcher)(uint32_t, const std::vector<any>&, const std::shared_ptr<events_base_t> &))
+                         int(*dispatcher)(uint32_t, const any_vector&, const std::shared_ptr<events_base_t> &))
 {
   // set only one time
   if(data && !data->events)
@@ -246,6 +723,19 @@ void proxy_t::set_events(std::shared_ptr<events_base_t> events,
     }
 }
 
+void proxy_t::set_events(std::shared_ptr<events_base_t> events,
+                         int(*dispatcher)(uint32_t, const std::vector<any>&, const std::shared_ptr<events_base_t> &))
+{
+  // set only one time
+  if(data && !data->events)
+    {
+      data->events = std::move(events);
+      data->vector_dispatcher = true;
+      if(wl_proxy_add_dispatcher(c_ptr(), c_dispatcher, reinterpret_cast<void*>(dispatcher), data) < 0)
+        throw std::runtime_error("wl_proxy_add_dispatcher failed.");
+    }
+}
+
 std::shared_ptr<events_base_t> proxy_t::get_events()
 {
   if(data)
@@ -266,8 +756,10 @@ proxy_t::proxy_t(wl_proxy *p, wrapper_type t, event_queue_t const &queue)
 
       if(!data)
         {
-          data = new proxy_data_t;
+          data = create<proxy_data_t>(allocation_category::proxy_data);
           data->queue = queue;
+          if(type == wrapper_type::display)
+            link_proxy(*data, std::make_shared<display_stats_t>(), c_ptr());
           wl_proxy_set_user_data(c_ptr(), data);
         }
       else
@@ -283,6 +775,7 @@ proxy_t::proxy_t(const proxy_t &wrapped_proxy, construct_proxy_wrapper_tag /*unu
   // Need to retain a reference to the proxy this wrapper was created from:
   // It may only be deleted after the proxy wrapper.
   data->wrapped_proxy = wrapped_proxy;
+  link_proxy(*data, wrapped_proxy.data->stats, proxy);
 }
 
 proxy_t::proxy_t(const proxy_t &p)
@@ -363,7 +856,8 @@ void proxy_t::proxy_release()
                 }
             }
 
-          delete data;
+          unlink_proxy(*data);
+          destroy(allocation_category::proxy_data, data);
       }
   }
 
@@ -394,6 +888,11 @@ void proxy_t::set_queue(event_queue_t queue)
     data->queue = std::move(queue);
 }
 
+event_queue_t proxy_t::get_queue() const
+{
+  return data ? data->queue : event_queue_t();
+}
+
 wl_proxy *proxy_t::c_ptr() const
 {
   if(!proxy)
@@ -513,12 +1012,20 @@ int display_t::get_fd() const
 
 int display_t::roundtrip()
 {
-  return check_return_value(wl_display_roundtrip(*this), "wl_display_roundtrip");
+  auto start = std::chrono::steady_clock::now();
+  int result = check_return_value(wl_display_roundtrip(*this), "wl_display_roundtrip");
+  if(data && data->stats)
+    data->stats->roundtrip_latency.record(std::chrono::steady_clock::now() - start);
+  return result;
 }
 
 int display_t::roundtrip_queue(const event_queue_t& queue)
 {
-  return check_return_value(wl_display_roundtrip_queue(*this, queue), "wl_display_roundtrip_queue");
+  auto start = std::chrono::steady_clock::now();
+  int result = check_return_value(wl_display_roundtrip_queue(*this, queue), "wl_display_roundtrip_queue");
+  if(data && data->stats)
+    data->stats->roundtrip_latency.record(std::chrono::steady_clock::now() - start);
+  return result;
 }
 
 read_intent display_t::obtain_read_intent()
@@ -584,12 +1091,12 @@ std::tuple<int, bool> display_t::flush()
 
 callback_t display_t::sync()
 {
-  return callback_t(marshal_constructor(0, &callback_interface, nullptr));
+  return callback_t(marshal_constructor<interface_traits<display_t>::requests::sync>(&callback_interface, nullptr));
 }
 
 registry_t display_t::get_registry()
 {
-  return registry_t(marshal_constructor(1, &registry_interface, nullptr));
+  return registry_t(marshal_constructor<interface_traits<display_t>::requests::get_registry>(&registry_interface, nullptr));
 }
 
 display_t::operator wl_display*() const
@@ -606,3 +1113,140 @@ display_t display_t::proxy_create_wrapper()
 {
   return display_t{*this, construct_proxy_wrapper_tag()};
 }
+
+void display_t::set_stats_enabled(bool enabled)
+{
+  if(!data || !data->stats)
+    throw std::runtime_error("Statistics are not available for foreign displays.");
+  data->stats->enabled = enabled;
+}
+
+bool display_t::stats_enabled() const
+{
+  return data && data->stats && data->stats->enabled;
+}
+
+std::vector<message_stats_t> display_t::stats() const
+{
+  std::vector<message_stats_t> result;
+  if(!data || !data->stats)
+    return result;
+
+  // interface, event, opcode
+  std::map<std::tuple<std::string, bool, uint32_t>, message_stats_t> sum;
+  std::lock_guard<std::mutex> lock(data->stats->mutex);
+  for(auto &shard : data->stats->shards)
+    {
+      std::lock_guard<std::mutex> shard_lock(shard.second->mutex);
+      for(auto &counter : shard.second->counters)
+        {
+          const message_key_t &key = counter.first;
+          uint64_t count = counter.second->count.load(std::memory_order_relaxed);
+          if(count == 0)
+            continue;
+          message_stats_t &m = sum[std::make_tuple(std::string(key.interface), key.event, key.opcode)];
+          m.interface = key.interface;
+          if(key.message)
+            m.message = key.message;
+          m.opcode = key.opcode;
+          m.event = key.event;
+          m.count += count;
+          m.bytes += counter.second->bytes.load(std::memory_order_relaxed);
+          m.handler_time += std::chrono::nanoseconds(counter.second->handler_ns.load(std::memory_order_relaxed));
+        }
+    }
+  result.reserve(sum.size());
+  for(auto &m : sum)
+    result.push_back(std::move(m.second));
+  return result;
+}
+
+latency_histogram_t display_t::roundtrip_latency() const
+{
+  if(!data || !data->stats)
+    return latency_histogram_t();
+  return data->stats->roundtrip_latency;
+}
+
+latency_histogram_t display_t::frame_latency() const
+{
+  if(!data || !data->stats)
+    return latency_histogram_t();
+  return data->stats->frame_latency;
+}
+
+latency_histogram_t display_t::frame_latency(const proxy_t &surface) const
+{
+  if(!surface.data || !surface.data->frames)
+    return latency_histogram_t();
+  return surface.data->frames->latency;
+}
+
+memory_report_t display_t::memory_report() const
+{
+  memory_report_t report;
+  if(!data || !data->stats)
+    return report;
+
+  std::map<std::string, interface_memory_t> interfaces;
+  {
+    std::lock_guard<std::mutex> lock(data->stats->proxies_mutex);
+    for(proxy_data_t *d = data->stats->proxies; d; d = d->next)
+      {
+        interface_memory_t &m = interfaces[d->interface_name ? d->interface_name : ""];
+        m.proxies++;
+        m.proxy_data_bytes += sizeof(proxy_data_t);
+        if(d->events)
+          {
+            m.events_bytes += d->events->size();
+            m.handlers += d->events->handlers();
+          }
+        m.shm_pool_bytes += static_cast<uint64_t>(std::max(d->pool_size, 0));
+      }
+  }
+
+  report.interfaces.reserve(interfaces.size());
+  for(auto &i : interfaces)
+    {
+      i.second.interface = i.first;
+      report.total.proxies += i.second.proxies;
+      report.total.proxy_data_bytes += i.second.proxy_data_bytes;
+      report.total.events_bytes += i.second.events_bytes;
+      report.total.handlers += i.second.handlers;
+      report.total.shm_pool_bytes += i.second.shm_pool_bytes;
+      report.interfaces.push_back(std::move(i.second));
+    }
+  return report;
+}
+
+std::string memory_report_t::to_string() const
+{
+  std::ostringstream out;
+  out << "interface\tproxies\tproxy_data_bytes\tevents_bytes\thandlers\tshm_pool_bytes" << std::endl;
+  auto line = [&] (const std::string &name, const interface_memory_t &m)
+    {
+      out << name << "\t" << m.proxies << "\t" << m.proxy_data_bytes << "\t" << m.events_bytes
+          << "\t" << m.handlers << "\t" << m.shm_pool_bytes << std::endl;
+    };
+  for(auto const &m : interfaces)
+    line(m.interface, m);
+  line("total", total);
+  return out.str();
+}
+
+void display_t::reset_stats()
+{
+  if(!data || !data->stats)
+    return;
+  std::lock_guard<std::mutex> lock(data->stats->mutex);
+  for(auto &shard : data->stats->shards)
+    {
+      std::lock_guard<std::mutex> shard_lock(shard.second->mutex);
+      for(auto &counter : shard.second->counters)
+        {
+          counter.second->count = 0;
+          counter.second->bytes = 0;
+          counter.second->handler_ns = 0;
+        }
+    }
+}
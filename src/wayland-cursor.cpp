@@ -23,9 +23,147 @@
  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <system_error>
+#include <tuple>
+#include <vector>
+#include <unistd.h>
+#include <sys/timerfd.h>
 #include <wayland-cursor.hpp>
 
 using namespace wayland;
+using namespace wayland::detail;
+
+namespace wayland
+{
+  namespace detail
+  {
+    struct shared_cursor_theme_data_t
+    {
+      std::string name;
+      int size = 0;
+      shm_t shm;
+      std::mutex mutex;
+      cursor_theme_t theme;
+      std::map<std::string, cursor_t> cursors;
+
+      cursor_theme_t &load()
+      {
+        if(!theme)
+          theme = cursor_theme_t(name, size, shm);
+        return theme;
+      }
+    };
+
+    struct cursor_animator_data_t
+    {
+      pointer_t pointer;
+      surface_t surface;
+      cursor_t cursor;
+      // images and the time in ms at which each of them ends
+      std::vector<cursor_image_t> images;
+      std::vector<uint32_t> ends;
+      uint32_t duration = 0;
+      std::chrono::steady_clock::time_point start;
+      int fd = -1;
+      bool entered = false;
+      bool armed = false;
+      uint32_t serial = 0;
+      int32_t scale = 1;
+      std::size_t current = 0;
+      bool shown = false;
+
+      ~cursor_animator_data_t()
+      {
+        if(fd >= 0)
+          close(fd);
+      }
+
+      void arm(uint32_t ms)
+      {
+        itimerspec spec = {};
+        spec.it_value.tv_sec = ms / 1000;
+        spec.it_value.tv_nsec = static_cast<long>(ms % 1000) * 1000000;
+        // a zero it_value would disarm the timer
+        if(ms == 0)
+          spec.it_value.tv_nsec = 1;
+        if(timerfd_settime(fd, 0, &spec, nullptr) < 0)
+          throw std::system_error(errno, std::generic_category(), "timerfd_settime");
+        armed = true;
+      }
+
+      void disarm()
+      {
+        if(!armed)
+          return;
+        itimerspec spec = {};
+        if(timerfd_settime(fd, 0, &spec, nullptr) < 0)
+          throw std::system_error(errno, std::generic_category(), "timerfd_settime");
+        armed = false;
+      }
+
+      // attach the image that is due and arm the timer for the next one
+      void update()
+      {
+        armed = false;
+        if(!entered || images.empty())
+          return;
+
+        std::size_t n = 0;
+        uint32_t pos = 0;
+        if(duration > 0)
+          {
+            auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+            pos = static_cast<uint32_t>(elapsed.count() % duration);
+            n = std::upper_bound(ends.begin(), ends.end(), pos) - ends.begin();
+            n = std::min(n, images.size() - 1);
+          }
+
+        if(!shown || n != current)
+          {
+            const cursor_image_t &image = images[n];
+            if(!shown || image.hotspot_x() != images[current].hotspot_x()
+               || image.hotspot_y() != images[current].hotspot_y())
+              pointer.set_cursor(serial, surface, static_cast<int32_t>(image.hotspot_x()) / scale,
+                                 static_cast<int32_t>(image.hotspot_y()) / scale);
+            surface.attach(image.get_buffer(), 0, 0);
+            if(surface.can_damage_buffer())
+              surface.damage_buffer(0, 0, static_cast<int32_t>(image.width()), static_cast<int32_t>(image.height()));
+            else
+              surface.damage(0, 0, static_cast<int32_t>(image.width()) / scale, static_cast<int32_t>(image.height()) / scale);
+            surface.commit();
+            current = n;
+            shown = true;
+          }
+
+        if(duration > 0 && images.size() > 1)
+          arm(ends[n] - pos);
+      }
+    };
+  }
+}
+
+namespace
+{
+  // name, size, wl_shm
+  using cache_key_t = std::tuple<std::string, int, wl_proxy*>;
+
+  std::mutex cache_mutex;
+  std::map<cache_key_t, std::weak_ptr<shared_cursor_theme_data_t>> cache;
+
+  void purge_cache()
+  {
+    for(auto it = cache.begin(); it != cache.end(); )
+      if(it->second.expired())
+        it = cache.erase(it);
+      else
+        ++it;
+  }
+}
 
 cursor_theme_t::cursor_theme_t(const std::string& name, int size, const shm_t& shm)
   : detail::refcounted_wrapper<wl_cursor_theme>({wl_cursor_theme_load(name.empty() ? nullptr : name.c_str(),
@@ -109,3 +247,188 @@ buffer_t cursor_image_t::get_buffer() const
   // buffer will be destroyed when cursor_theme is destroyed
   return buffer_t(buffer, proxy_t::wrapper_type::foreign);
 }
+
+
+shared_cursor_theme_t::shared_cursor_theme_t(std::shared_ptr<shared_cursor_theme_data_t> d)
+  : data(std::move(d))
+{
+}
+
+cursor_t shared_cursor_theme_t::get_cursor(const std::string& name) const
+{
+  if(!data)
+    throw std::runtime_error("Tried to access empty object");
+  std::lock_guard<std::mutex> lock(data->mutex);
+  auto it = data->cursors.find(name);
+  if(it != data->cursors.end())
+    return it->second;
+  cursor_t cursor = data->load().get_cursor(name);
+  data->cursors[name] = cursor;
+  return cursor;
+}
+
+cursor_theme_t shared_cursor_theme_t::get_theme() const
+{
+  if(!data)
+    throw std::runtime_error("Tried to access empty object");
+  std::lock_guard<std::mutex> lock(data->mutex);
+  return data->load();
+}
+
+bool shared_cursor_theme_t::is_loaded() const
+{
+  if(!data)
+    return false;
+  std::lock_guard<std::mutex> lock(data->mutex);
+  return data->theme;
+}
+
+std::string shared_cursor_theme_t::name() const
+{
+  return data ? data->name : std::string();
+}
+
+int shared_cursor_theme_t::size() const
+{
+  return data ? data->size : 0;
+}
+
+shared_cursor_theme_t::operator bool() const
+{
+  return static_cast<bool>(data);
+}
+
+shared_cursor_theme_t cursor_theme_cache_t::get(const std::string& name, int size, const shm_t& shm, int scale)
+{
+  if(size <= 0 || scale <= 0)
+    throw std::invalid_argument("Invalid cursor size.");
+  cache_key_t key(name, size * scale, shm.c_ptr());
+
+  std::lock_guard<std::mutex> lock(cache_mutex);
+  purge_cache();
+  std::shared_ptr<shared_cursor_theme_data_t> data = cache[key].lock();
+  if(!data)
+    {
+      data = std::make_shared<shared_cursor_theme_data_t>();
+      data->name = name;
+      data->size = size * scale;
+      data->shm = shm;
+      cache[key] = data;
+    }
+  return shared_cursor_theme_t(data);
+}
+
+std::size_t cursor_theme_cache_t::size()
+{
+  std::lock_guard<std::mutex> lock(cache_mutex);
+  purge_cache();
+  return cache.size();
+}
+
+
+cursor_animator_t::cursor_animator_t(compositor_t &compositor, const pointer_t &pointer)
+  : data(std::make_shared<cursor_animator_data_t>())
+{
+  data->fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+  if(data->fd < 0)
+    throw std::system_error(errno, std::generic_category(), "timerfd_create");
+  data->pointer = pointer;
+  data->surface = compositor.create_surface();
+}
+
+void cursor_animator_t::set_cursor(const cursor_t &cursor)
+{
+  if(!data)
+    throw std::runtime_error("Tried to access empty object");
+  data->disarm();
+  data->cursor = cursor;
+  data->images.clear();
+  data->ends.clear();
+  data->duration = 0;
+  for(unsigned int c = 0; c < cursor.image_count(); c++)
+    {
+      data->images.push_back(cursor.image(c));
+      data->duration += data->images.back().delay();
+      data->ends.push_back(data->duration);
+    }
+  data->start = std::chrono::steady_clock::now();
+  data->shown = false;
+  data->update();
+}
+
+cursor_t cursor_animator_t::get_cursor() const
+{
+  return data ? data->cursor : cursor_t();
+}
+
+void cursor_animator_t::set_scale(int32_t scale)
+{
+  if(!data)
+    throw std::runtime_error("Tried to access empty object");
+  if(scale <= 0)
+    throw std::invalid_argument("Invalid cursor scale.");
+  data->scale = scale;
+  data->surface.set_buffer_scale(scale);
+  data->shown = false;
+  data->disarm();
+  data->update();
+}
+
+void cursor_animator_t::enter(uint32_t serial)
+{
+  if(!data)
+    throw std::runtime_error("Tried to access empty object");
+  data->serial = serial;
+  data->entered = true;
+  // a new serial needs a new set_cursor request
+  data->shown = false;
+  data->disarm();
+  data->update();
+}
+
+void cursor_animator_t::leave()
+{
+  if(!data)
+    throw std::runtime_error("Tried to access empty object");
+  data->entered = false;
+  data->disarm();
+}
+
+bool cursor_animator_t::is_entered() const
+{
+  return data && data->entered;
+}
+
+bool cursor_animator_t::is_animating() const
+{
+  return data && data->armed;
+}
+
+int cursor_animator_t::get_fd() const
+{
+  return data ? data->fd : -1;
+}
+
+void cursor_animator_t::dispatch()
+{
+  if(!data)
+    throw std::runtime_error("Tried to access empty object");
+  uint64_t expirations = 0;
+  if(read(data->fd, &expirations, sizeof(expirations)) != sizeof(expirations))
+    {
+      if(errno == EAGAIN || errno == EINTR)
+        return;
+      throw std::system_error(errno, std::generic_category(), "read");
+    }
+  data->update();
+}
+
+surface_t cursor_animator_t::get_surface() const
+{
+  return data ? data->surface : surface_t();
+}
+
+cursor_animator_t::operator bool() const
+{
+  return static_cast<bool>(data);
+}
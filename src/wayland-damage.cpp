@@ -0,0 +1,236 @@
+/*
+ * Copyright (c) 2014-2019, Nils Christopher Brause, Philipp Kerling
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <wayland-damage.hpp>
+
+using namespace wayland;
+
+namespace
+{
+  int32_t floor_div(int32_t a, int32_t b)
+  {
+    return a >= 0 ? a / b : -((-a + b - 1) / b);
+  }
+
+  int32_t ceil_div(int32_t a, int32_t b)
+  {
+    return -floor_div(-a, b);
+  }
+
+  // Convert buffer to surface coordinates
+  rect_t to_surface(const rect_t &r, int32_t scale, bool outwards)
+  {
+    if(scale == 1)
+      return r;
+    int32_t x0 = outwards ? floor_div(r.x, scale) : ceil_div(r.x, scale);
+    int32_t y0 = outwards ? floor_div(r.y, scale) : ceil_div(r.y, scale);
+    int32_t x1 = outwards ? ceil_div(r.x + r.width, scale) : floor_div(r.x + r.width, scale);
+    int32_t y1 = outwards ? ceil_div(r.y + r.height, scale) : floor_div(r.y + r.height, scale);
+    return rect_t(x0, y0, x1 - x0, y1 - y0);
+  }
+}
+
+rect_t rect_t::intersected(const rect_t &r) const
+{
+  int32_t x0 = std::max(x, r.x);
+  int32_t y0 = std::max(y, r.y);
+  int32_t x1 = std::min(x + width, r.x + r.width);
+  int32_t y1 = std::min(y + height, r.y + r.height);
+  if(x1 <= x0 || y1 <= y0)
+    return rect_t();
+  return rect_t(x0, y0, x1 - x0, y1 - y0);
+}
+
+rect_t rect_t::united(const rect_t &r) const
+{
+  if(r.empty())
+    return *this;
+  if(empty())
+    return r;
+  int32_t x0 = std::min(x, r.x);
+  int32_t y0 = std::min(y, r.y);
+  int32_t x1 = std::max(x + width, r.x + r.width);
+  int32_t y1 = std::max(y + height, r.y + r.height);
+  return rect_t(x0, y0, x1 - x0, y1 - y0);
+}
+
+bool rect_t::contains(const rect_t &r) const
+{
+  return !empty() && r.x >= x && r.y >= y
+    && r.x + r.width <= x + width && r.y + r.height <= y + height;
+}
+
+constexpr std::size_t damage_tracker_t::default_max_rects;
+constexpr int64_t damage_tracker_t::default_request_cost;
+
+damage_tracker_t::damage_tracker_t(std::size_t max_rects, int64_t request_cost)
+  : max_rects(max_rects), request_cost(request_cost)
+{
+}
+
+int64_t damage_tracker_t::merge_cost(const rect_t &a, const rect_t &b)
+{
+  return a.united(b).area() - a.area() - b.area() + a.intersected(b).area();
+}
+
+void damage_tracker_t::merge(rect_t r)
+{
+  bool merged = true;
+  while(merged)
+    {
+      merged = false;
+      for(auto it = rects.begin(); it != rects.end(); ++it)
+        {
+          if(it->contains(r))
+            return;
+          if(merge_cost(*it, r) <= request_cost)
+            {
+              r = r.united(*it);
+              rects.erase(it);
+              merged = true;
+              break;
+            }
+        }
+    }
+  rects.push_back(r);
+}
+
+void damage_tracker_t::limit()
+{
+  while(max_rects && rects.size() > max_rects)
+    {
+      std::size_t best_a = 0;
+      std::size_t best_b = 1;
+      int64_t best_cost = std::numeric_limits<int64_t>::max();
+      for(std::size_t a = 0; a < rects.size(); a++)
+        for(std::size_t b = a + 1; b < rects.size(); b++)
+          {
+            int64_t cost = merge_cost(rects[a], rects[b]);
+            if(cost < best_cost)
+              {
+                best_cost = cost;
+                best_a = a;
+                best_b = b;
+              }
+          }
+      rect_t r = rects[best_a].united(rects[best_b]);
+      rects.erase(rects.begin() + static_cast<std::ptrdiff_t>(best_b));
+      rects.erase(rects.begin() + static_cast<std::ptrdiff_t>(best_a));
+      merge(r);
+    }
+}
+
+void damage_tracker_t::set_bounds(int32_t width, int32_t height)
+{
+  bounds = rect_t(0, 0, width, height);
+  if(bounds.empty())
+    return;
+  std::vector<rect_t> old;
+  old.swap(rects);
+  for(auto &r : old)
+    add(r);
+}
+
+void damage_tracker_t::set_buffer_scale(int32_t buffer_scale)
+{
+  if(buffer_scale < 1)
+    throw std::invalid_argument("Invalid buffer scale.");
+  scale = buffer_scale;
+}
+
+void damage_tracker_t::add(const rect_t &rect)
+{
+  rect_t r = bounds.empty() ? rect : rect.intersected(bounds);
+  if(r.empty())
+    return;
+  merge(r);
+  limit();
+}
+
+void damage_tracker_t::add(int32_t x, int32_t y, int32_t width, int32_t height)
+{
+  add(rect_t(x, y, width, height));
+}
+
+void damage_tracker_t::add_all()
+{
+  if(bounds.empty())
+    throw std::logic_error("Damage tracker has no bounds.");
+  rects.assign(1, bounds);
+}
+
+void damage_tracker_t::clear()
+{
+  rects.clear();
+}
+
+bool damage_tracker_t::empty() const
+{
+  return rects.empty();
+}
+
+const std::vector<rect_t> &damage_tracker_t::get_rects() const
+{
+  return rects;
+}
+
+int64_t damage_tracker_t::area() const
+{
+  int64_t a = 0;
+  for(auto &r : rects)
+    a += r.area();
+  return a;
+}
+
+std::size_t damage_tracker_t::apply(surface_t &surface)
+{
+  std::size_t count = rects.size();
+  if(surface.can_damage_buffer())
+    for(auto &r : rects)
+      surface.damage_buffer(r.x, r.y, r.width, r.height);
+  else
+    for(auto &r : rects)
+      {
+        rect_t s = to_surface(r, scale, true);
+        surface.damage(s.x, s.y, s.width, s.height);
+      }
+  rects.clear();
+  return count;
+}
+
+region_t damage_tracker_t::create_region(compositor_t &compositor) const
+{
+  region_t region = compositor.create_region();
+  for(auto &r : rects)
+    {
+      rect_t s = to_surface(r, scale, false);
+      if(!s.empty())
+        region.add(s.x, s.y, s.width, s.height);
+    }
+  return region;
+}
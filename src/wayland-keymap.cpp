@@ -0,0 +1,182 @@
+/*
+ * Copyright (c) 2014-2019, Nils Christopher Brause, Philipp Kerling
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <cerrno>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <system_error>
+#include <sys/mman.h>
+#include <wayland-keymap.hpp>
+
+using namespace wayland;
+using namespace wayland::detail;
+
+namespace wayland
+{
+  namespace detail
+  {
+    struct keymap_data_t
+    {
+      keyboard_keymap_format format = keyboard_keymap_format::xkb_v1;
+      void *mem = MAP_FAILED;
+      std::size_t size = 0;
+      uint64_t hash = 0;
+      std::mutex mutex;
+      std::map<std::type_index, std::shared_ptr<void>> compiled;
+
+      ~keymap_data_t()
+      {
+        if(mem != MAP_FAILED)
+          munmap(mem, size);
+      }
+    };
+  }
+}
+
+namespace
+{
+  std::mutex cache_mutex;
+  // keymaps by hash of their contents
+  std::multimap<uint64_t, std::weak_ptr<keymap_data_t>> cache;
+
+  void purge_cache()
+  {
+    for(auto it = cache.begin(); it != cache.end(); )
+      if(it->second.expired())
+        it = cache.erase(it);
+      else
+        ++it;
+  }
+
+  // 64 bit FNV-1a
+  uint64_t hash_data(const void *data, std::size_t size)
+  {
+    const unsigned char *p = static_cast<const unsigned char*>(data);
+    uint64_t hash = 14695981039346656037ULL;
+    for(std::size_t c = 0; c < size; c++)
+      {
+        hash ^= p[c];
+        hash *= 1099511628211ULL;
+      }
+    return hash;
+  }
+}
+
+keymap_t::keymap_t(std::shared_ptr<keymap_data_t> d)
+  : data(std::move(d))
+{
+}
+
+std::shared_ptr<void> keymap_t::compiled(const std::type_index &type, const std::function<std::shared_ptr<void>()> &compile) const
+{
+  if(!data)
+    throw std::invalid_argument("keymap is NULL");
+  std::lock_guard<std::mutex> lock(data->mutex);
+  auto it = data->compiled.find(type);
+  if(it != data->compiled.end())
+    return it->second;
+  std::shared_ptr<void> result = compile();
+  if(result)
+    data->compiled[type] = result;
+  return result;
+}
+
+keyboard_keymap_format keymap_t::format() const
+{
+  if(!data)
+    throw std::invalid_argument("keymap is NULL");
+  return data->format;
+}
+
+const char *keymap_t::get_data() const
+{
+  if(!data)
+    throw std::invalid_argument("keymap is NULL");
+  return static_cast<const char*>(data->mem);
+}
+
+std::size_t keymap_t::size() const
+{
+  return data ? data->size : 0;
+}
+
+uint64_t keymap_t::hash() const
+{
+  return data ? data->hash : 0;
+}
+
+bool keymap_t::operator==(const keymap_t &k) const
+{
+  return data == k.data;
+}
+
+bool keymap_t::operator!=(const keymap_t &k) const
+{
+  return !(*this == k);
+}
+
+keymap_t::operator bool() const
+{
+  return static_cast<bool>(data);
+}
+
+keymap_t keymap_cache_t::get(keyboard_keymap_format format, int fd, uint32_t size)
+{
+  if(format == keyboard_keymap_format::no_keymap)
+    return keymap_t();
+  if(size == 0)
+    throw std::invalid_argument("Invalid keymap size.");
+
+  // Since version 7 the fd must be mapped with MAP_PRIVATE
+  auto data = std::make_shared<keymap_data_t>();
+  data->mem = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if(data->mem == MAP_FAILED)
+    throw std::system_error(errno, std::generic_category(), "mmap");
+  data->format = format;
+  data->size = size;
+  data->hash = hash_data(data->mem, size);
+
+  std::lock_guard<std::mutex> lock(cache_mutex);
+  purge_cache();
+  auto range = cache.equal_range(data->hash);
+  for(auto it = range.first; it != range.second; ++it)
+    {
+      std::shared_ptr<keymap_data_t> existing = it->second.lock();
+      if(existing && existing->format == format && existing->size == data->size
+         && std::memcmp(existing->mem, data->mem, data->size) == 0)
+        return keymap_t(existing);
+    }
+  cache.insert(std::make_pair(data->hash, std::weak_ptr<keymap_data_t>(data)));
+  return keymap_t(data);
+}
+
+std::size_t keymap_cache_t::size()
+{
+  std::lock_guard<std::mutex> lock(cache_mutex);
+  purge_cache();
+  return cache.size();
+}
@@ -0,0 +1,737 @@
+/*
+ * Copyright (c) 2014-2019, Nils Christopher Brause, Philipp Kerling
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <initializer_list>
+#include <stdexcept>
+#include <wayland-pixel.hpp>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define WAYLAND_PIXEL_X86
+#include <immintrin.h>
+#endif
+
+#if defined(__ARM_NEON) || defined(__aarch64__)
+#define WAYLAND_PIXEL_NEON
+#include <arm_neon.h>
+#endif
+
+using namespace wayland;
+using namespace wayland::pixel;
+
+namespace
+{
+  // Row kernels. All implementations have to produce the same results as
+  // the generic ones.
+  struct kernels_t
+  {
+    isa_t isa;
+    void (*fill32)(uint32_t *dst, std::size_t n, uint32_t value);
+    void (*fill16)(uint16_t *dst, std::size_t n, uint16_t value);
+    void (*premultiply)(uint32_t *pixels, std::size_t n);
+    // dst = src | bits
+    void (*set_bits)(uint32_t *dst, const uint32_t *src, std::size_t n, uint32_t bits);
+    // dst = src with red and blue swapped | bits
+    void (*swap_rb)(uint32_t *dst, const uint32_t *src, std::size_t n, uint32_t bits);
+    // 32 bit to rgb565, bgr if the source has red in the low byte
+    void (*pack565)(uint16_t *dst, const uint32_t *src, std::size_t n, bool bgr);
+    // rgb565 to opaque 32 bit, bgr to put red in the low byte
+    void (*unpack565)(uint32_t *dst, const uint16_t *src, std::size_t n, bool bgr);
+  };
+
+  // generic
+
+  inline uint32_t swap_rb(uint32_t p)
+  {
+    return (p & 0xff00ff00u) | ((p >> 16) & 0xffu) | ((p & 0xffu) << 16);
+  }
+
+  inline uint16_t pack565(uint32_t p)
+  {
+    return static_cast<uint16_t>(((p >> 8) & 0xf800u) | ((p >> 5) & 0x07e0u) | ((p >> 3) & 0x001fu));
+  }
+
+  inline uint32_t unpack565(uint16_t q, bool bgr)
+  {
+    uint32_t r = (q >> 11) & 0x1fu;
+    uint32_t g = (q >> 5) & 0x3fu;
+    uint32_t b = q & 0x1fu;
+    r = (r << 3) | (r >> 2);
+    g = (g << 2) | (g >> 4);
+    b = (b << 3) | (b >> 2);
+    return bgr ? 0xff000000u | (b << 16) | (g << 8) | r
+               : 0xff000000u | (r << 16) | (g << 8) | b;
+  }
+
+  // c * a / 255, rounded
+  inline uint32_t mul_div255(uint32_t c, uint32_t a)
+  {
+    uint32_t t = c * a + 128;
+    return (t + (t >> 8)) >> 8;
+  }
+
+  inline uint32_t premultiply(uint32_t p)
+  {
+    uint32_t a = p >> 24;
+    return (p & 0xff000000u) | (mul_div255((p >> 16) & 0xffu, a) << 16)
+      | (mul_div255((p >> 8) & 0xffu, a) << 8) | mul_div255(p & 0xffu, a);
+  }
+
+  void fill32_generic(uint32_t *dst, std::size_t n, uint32_t value)
+  {
+    std::fill_n(dst, n, value);
+  }
+
+  void fill16_generic(uint16_t *dst, std::size_t n, uint16_t value)
+  {
+    std::fill_n(dst, n, value);
+  }
+
+  void premultiply_generic(uint32_t *pixels, std::size_t n)
+  {
+    for(std::size_t c = 0; c < n; c++)
+      pixels[c] = premultiply(pixels[c]);
+  }
+
+  void set_bits_generic(uint32_t *dst, const uint32_t *src, std::size_t n, uint32_t bits)
+  {
+    for(std::size_t c = 0; c < n; c++)
+      dst[c] = src[c] | bits;
+  }
+
+  void swap_rb_generic(uint32_t *dst, const uint32_t *src, std::size_t n, uint32_t bits)
+  {
+    for(std::size_t c = 0; c < n; c++)
+      dst[c] = swap_rb(src[c]) | bits;
+  }
+
+  void pack565_generic(uint16_t *dst, const uint32_t *src, std::size_t n, bool bgr)
+  {
+    for(std::size_t c = 0; c < n; c++)
+      dst[c] = pack565(bgr ? swap_rb(src[c]) : src[c]);
+  }
+
+  void unpack565_generic(uint32_t *dst, const uint16_t *src, std::size_t n, bool bgr)
+  {
+    for(std::size_t c = 0; c < n; c++)
+      dst[c] = unpack565(src[c], bgr);
+  }
+
+  const kernels_t generic_kernels = { isa_t::generic, fill32_generic, fill16_generic, premultiply_generic,
+                                      set_bits_generic, swap_rb_generic, pack565_generic, unpack565_generic };
+
+#ifdef WAYLAND_PIXEL_X86
+  // SSE2
+
+  __attribute__((target("sse2")))
+  void fill32_sse2(uint32_t *dst, std::size_t n, uint32_t value)
+  {
+    __m128i v = _mm_set1_epi32(static_cast<int>(value));
+    std::size_t c = 0;
+    for(; c + 4 <= n; c += 4)
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + c), v);
+    fill32_generic(dst + c, n - c, value);
+  }
+
+  __attribute__((target("sse2")))
+  void fill16_sse2(uint16_t *dst, std::size_t n, uint16_t value)
+  {
+    __m128i v = _mm_set1_epi16(static_cast<short>(value));
+    std::size_t c = 0;
+    for(; c + 8 <= n; c += 8)
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + c), v);
+    fill16_generic(dst + c, n - c, value);
+  }
+
+  __attribute__((target("sse2")))
+  inline __m128i mul_div255_sse2(__m128i c, __m128i a)
+  {
+    __m128i t = _mm_add_epi16(_mm_mullo_epi16(c, a), _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+  }
+
+  __attribute__((target("sse2")))
+  inline __m128i premultiply_half_sse2(__m128i p)
+  {
+    // Alpha is multiplied with 255, which leaves it unchanged.
+    __m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(p, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+    a = _mm_or_si128(a, _mm_set_epi16(0xff, 0, 0, 0, 0xff, 0, 0, 0));
+    return mul_div255_sse2(p, a);
+  }
+
+  __attribute__((target("sse2")))
+  void premultiply_sse2(uint32_t *pixels, std::size_t n)
+  {
+    __m128i zero = _mm_setzero_si128();
+    std::size_t c = 0;
+    for(; c + 4 <= n; c += 4)
+      {
+        __m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels + c));
+        __m128i lo = premultiply_half_sse2(_mm_unpacklo_epi8(p, zero));
+        __m128i hi = premultiply_half_sse2(_mm_unpackhi_epi8(p, zero));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(pixels + c), _mm_packus_epi16(lo, hi));
+      }
+    premultiply_generic(pixels + c, n - c);
+  }
+
+  __attribute__((target("sse2")))
+  void set_bits_sse2(uint32_t *dst, const uint32_t *src, std::size_t n, uint32_t bits)
+  {
+    __m128i b = _mm_set1_epi32(static_cast<int>(bits));
+    std::size_t c = 0;
+    for(; c + 4 <= n; c += 4)
+      {
+        __m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + c));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + c), _mm_or_si128(p, b));
+      }
+    set_bits_generic(dst + c, src + c, n - c, bits);
+  }
+
+  __attribute__((target("sse2")))
+  inline __m128i swap_rb_sse2(__m128i p)
+  {
+    __m128i ga = _mm_and_si128(p, _mm_set1_epi32(static_cast<int>(0xff00ff00u)));
+    __m128i rb = _mm_and_si128(p, _mm_set1_epi32(0x00ff00ff));
+    return _mm_or_si128(ga, _mm_or_si128(_mm_slli_epi32(rb, 16), _mm_srli_epi32(rb, 16)));
+  }
+
+  __attribute__((target("sse2")))
+  void swap_rb_sse2(uint32_t *dst, const uint32_t *src, std::size_t n, uint32_t bits)
+  {
+    __m128i b = _mm_set1_epi32(static_cast<int>(bits));
+    std::size_t c = 0;
+    for(; c + 4 <= n; c += 4)
+      {
+        __m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + c));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + c), _mm_or_si128(swap_rb_sse2(p), b));
+      }
+    swap_rb_generic(dst + c, src + c, n - c, bits);
+  }
+
+  __attribute__((target("sse2")))
+  inline __m128i pack565_sse2(__m128i p)
+  {
+    __m128i r = _mm_and_si128(_mm_srli_epi32(p, 8), _mm_set1_epi32(0xf800));
+    __m128i g = _mm_and_si128(_mm_srli_epi32(p, 5), _mm_set1_epi32(0x07e0));
+    __m128i b = _mm_and_si128(_mm_srli_epi32(p, 3), _mm_set1_epi32(0x001f));
+    // sign extend, so that the saturating pack keeps all 16 bits
+    return _mm_srai_epi32(_mm_slli_epi32(_mm_or_si128(r, _mm_or_si128(g, b)), 16), 16);
+  }
+
+  __attribute__((target("sse2")))
+  void pack565_sse2(uint16_t *dst, const uint32_t *src, std::size_t n, bool bgr)
+  {
+    std::size_t c = 0;
+    for(; c + 8 <= n; c += 8)
+      {
+        __m128i p0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + c));
+        __m128i p1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + c + 4));
+        if(bgr)
+          {
+            p0 = swap_rb_sse2(p0);
+            p1 = swap_rb_sse2(p1);
+          }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + c), _mm_packs_epi32(pack565_sse2(p0), pack565_sse2(p1)));
+      }
+    pack565_generic(dst + c, src + c, n - c, bgr);
+  }
+
+  __attribute__((target("sse2")))
+  inline __m128i unpack565_sse2(__m128i q, bool bgr)
+  {
+    __m128i r = _mm_and_si128(_mm_srli_epi32(q, 11), _mm_set1_epi32(0x1f));
+    __m128i g = _mm_and_si128(_mm_srli_epi32(q, 5), _mm_set1_epi32(0x3f));
+    __m128i b = _mm_and_si128(q, _mm_set1_epi32(0x1f));
+    r = _mm_or_si128(_mm_slli_epi32(r, 3), _mm_srli_epi32(r, 2));
+    g = _mm_or_si128(_mm_slli_epi32(g, 2), _mm_srli_epi32(g, 4));
+    b = _mm_or_si128(_mm_slli_epi32(b, 3), _mm_srli_epi32(b, 2));
+    if(bgr)
+      std::swap(r, b);
+    return _mm_or_si128(_mm_or_si128(_mm_set1_epi32(static_cast<int>(0xff000000u)), _mm_slli_epi32(r, 16)),
+                        _mm_or_si128(_mm_slli_epi32(g, 8), b));
+  }
+
+  __attribute__((target("sse2")))
+  void unpack565_sse2(uint32_t *dst, const uint16_t *src, std::size_t n, bool bgr)
+  {
+    __m128i zero = _mm_setzero_si128();
+    std::size_t c = 0;
+    for(; c + 8 <= n; c += 8)
+      {
+        __m128i q = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + c));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + c), unpack565_sse2(_mm_unpacklo_epi16(q, zero), bgr));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + c + 4), unpack565_sse2(_mm_unpackhi_epi16(q, zero), bgr));
+      }
+    unpack565_generic(dst + c, src + c, n - c, bgr);
+  }
+
+  const kernels_t sse2_kernels = { isa_t::sse2, fill32_sse2, fill16_sse2, premultiply_sse2,
+                                   set_bits_sse2, swap_rb_sse2, pack565_sse2, unpack565_sse2 };
+
+  // AVX2
+
+  __attribute__((target("avx2")))
+  void fill32_avx2(uint32_t *dst, std::size_t n, uint32_t value)
+  {
+    __m256i v = _mm256_set1_epi32(static_cast<int>(value));
+    std::size_t c = 0;
+    for(; c + 8 <= n; c += 8)
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + c), v);
+    fill32_generic(dst + c, n - c, value);
+  }
+
+  __attribute__((target("avx2")))
+  void fill16_avx2(uint16_t *dst, std::size_t n, uint16_t value)
+  {
+    __m256i v = _mm256_set1_epi16(static_cast<short>(value));
+    std::size_t c = 0;
+    for(; c + 16 <= n; c += 16)
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + c), v);
+    fill16_generic(dst + c, n - c, value);
+  }
+
+  __attribute__((target("avx2")))
+  inline __m256i premultiply_half_avx2(__m256i p)
+  {
+    // Alpha is multiplied with 255, which leaves it unchanged.
+    __m256i a = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(p, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+    a = _mm256_or_si256(a, _mm256_set1_epi64x(0x00ff000000000000ll));
+    __m256i t = _mm256_add_epi16(_mm256_mullo_epi16(p, a), _mm256_set1_epi16(128));
+    return _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+  }
+
+  __attribute__((target("avx2")))
+  void premultiply_avx2(uint32_t *pixels, std::size_t n)
+  {
+    __m256i zero = _mm256_setzero_si256();
+    std::size_t c = 0;
+    for(; c + 8 <= n; c += 8)
+      {
+        __m256i p = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pixels + c));
+        // unpack and pack work per 128 bit lane, so the order is kept
+        __m256i lo = premultiply_half_avx2(_mm256_unpacklo_epi8(p, zero));
+        __m256i hi = premultiply_half_avx2(_mm256_unpackhi_epi8(p, zero));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(pixels + c), _mm256_packus_epi16(lo, hi));
+      }
+    premultiply_sse2(pixels + c, n - c);
+  }
+
+  __attribute__((target("avx2")))
+  void set_bits_avx2(uint32_t *dst, const uint32_t *src, std::size_t n, uint32_t bits)
+  {
+    __m256i b = _mm256_set1_epi32(static_cast<int>(bits));
+    std::size_t c = 0;
+    for(; c + 8 <= n; c += 8)
+      {
+        __m256i p = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + c));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + c), _mm256_or_si256(p, b));
+      }
+    set_bits_generic(dst + c, src + c, n - c, bits);
+  }
+
+  __attribute__((target("avx2")))
+  inline __m256i swap_rb_avx2(__m256i p)
+  {
+    const __m256i shuffle = _mm256_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15,
+                                             2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+    return _mm256_shuffle_epi8(p, shuffle);
+  }
+
+  __attribute__((target("avx2")))
+  void swap_rb_avx2(uint32_t *dst, const uint32_t *src, std::size_t n, uint32_t bits)
+  {
+    __m256i b = _mm256_set1_epi32(static_cast<int>(bits));
+    std::size_t c = 0;
+    for(; c + 8 <= n; c += 8)
+      {
+        __m256i p = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + c));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + c), _mm256_or_si256(swap_rb_avx2(p), b));
+      }
+    swap_rb_generic(dst + c, src + c, n - c, bits);
+  }
+
+  __attribute__((target("avx2")))
+  inline __m256i pack565_avx2(__m256i p)
+  {
+    __m256i r = _mm256_and_si256(_mm256_srli_epi32(p, 8), _mm256_set1_epi32(0xf800));
+    __m256i g = _mm256_and_si256(_mm256_srli_epi32(p, 5), _mm256_set1_epi32(0x07e0));
+    __m256i b = _mm256_and_si256(_mm256_srli_epi32(p, 3), _mm256_set1_epi32(0x001f));
+    return _mm256_or_si256(r, _mm256_or_si256(g, b));
+  }
+
+  __attribute__((target("avx2")))
+  void pack565_avx2(uint16_t *dst, const uint32_t *src, std::size_t n, bool bgr)
+  {
+    std::size_t c = 0;
+    for(; c + 16 <= n; c += 16)
+      {
+        __m256i p0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + c));
+        __m256i p1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + c + 8));
+        if(bgr)
+          {
+            p0 = swap_rb_avx2(p0);
+            p1 = swap_rb_avx2(p1);
+          }
+        // packus interleaves the 128 bit lanes, the permute restores the order
+        __m256i q = _mm256_packus_epi32(pack565_avx2(p0), pack565_avx2(p1));
+        q = _mm256_permute4x64_epi64(q, _MM_SHUFFLE(3, 1, 2, 0));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + c), q);
+      }
+    pack565_sse2(dst + c, src + c, n - c, bgr);
+  }
+
+  __attribute__((target("avx2")))
+  void unpack565_avx2(uint32_t *dst, const uint16_t *src, std::size_t n, bool bgr)
+  {
+    std::size_t c = 0;
+    for(; c + 8 <= n; c += 8)
+      {
+        __m256i q = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + c)));
+        __m256i r = _mm256_and_si256(_mm256_srli_epi32(q, 11), _mm256_set1_epi32(0x1f));
+        __m256i g = _mm256_and_si256(_mm256_srli_epi32(q, 5), _mm256_set1_epi32(0x3f));
+        __m256i b = _mm256_and_si256(q, _mm256_set1_epi32(0x1f));
+        r = _mm256_or_si256(_mm256_slli_epi32(r, 3), _mm256_srli_epi32(r, 2));
+        g = _mm256_or_si256(_mm256_slli_epi32(g, 2), _mm256_srli_epi32(g, 4));
+        b = _mm256_or_si256(_mm256_slli_epi32(b, 3), _mm256_srli_epi32(b, 2));
+        if(bgr)
+          std::swap(r, b);
+        __m256i p = _mm256_or_si256(_mm256_or_si256(_mm256_set1_epi32(static_cast<int>(0xff000000u)), _mm256_slli_epi32(r, 16)),
+                                    _mm256_or_si256(_mm256_slli_epi32(g, 8), b));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + c), p);
+      }
+    unpack565_generic(dst + c, src + c, n - c, bgr);
+  }
+
+  const kernels_t avx2_kernels = { isa_t::avx2, fill32_avx2, fill16_avx2, premultiply_avx2,
+                                   set_bits_avx2, swap_rb_avx2, pack565_avx2, unpack565_avx2 };
+#endif
+
+#ifdef WAYLAND_PIXEL_NEON
+  // NEON
+
+  void fill32_neon(uint32_t *dst, std::size_t n, uint32_t value)
+  {
+    uint32x4_t v = vdupq_n_u32(value);
+    std::size_t c = 0;
+    for(; c + 4 <= n; c += 4)
+      vst1q_u32(dst + c, v);
+    fill32_generic(dst + c, n - c, value);
+  }
+
+  void fill16_neon(uint16_t *dst, std::size_t n, uint16_t value)
+  {
+    uint16x8_t v = vdupq_n_u16(value);
+    std::size_t c = 0;
+    for(; c + 8 <= n; c += 8)
+      vst1q_u16(dst + c, v);
+    fill16_generic(dst + c, n - c, value);
+  }
+
+  inline uint8x16_t mul_div255_neon(uint8x16_t c, uint8x16_t a)
+  {
+    uint16x8_t lo = vmull_u8(vget_low_u8(c), vget_low_u8(a));
+    uint16x8_t hi = vmull_u8(vget_high_u8(c), vget_high_u8(a));
+    return vcombine_u8(vrshrn_n_u16(vrsraq_n_u16(lo, lo, 8), 8),
+                       vrshrn_n_u16(vrsraq_n_u16(hi, hi, 8), 8));
+  }
+
+  void premultiply_neon(uint32_t *pixels, std::size_t n)
+  {
+    std::size_t c = 0;
+    for(; c + 16 <= n; c += 16)
+      {
+        uint8_t *p = reinterpret_cast<uint8_t*>(pixels + c);
+        uint8x16x4_t v = vld4q_u8(p);
+        v.val[0] = mul_div255_neon(v.val[0], v.val[3]);
+        v.val[1] = mul_div255_neon(v.val[1], v.val[3]);
+        v.val[2] = mul_div255_neon(v.val[2], v.val[3]);
+        vst4q_u8(p, v);
+      }
+    premultiply_generic(pixels + c, n - c);
+  }
+
+  void set_bits_neon(uint32_t *dst, const uint32_t *src, std::size_t n, uint32_t bits)
+  {
+    uint32x4_t b = vdupq_n_u32(bits);
+    std::size_t c = 0;
+    for(; c + 4 <= n; c += 4)
+      vst1q_u32(dst + c, vorrq_u32(vld1q_u32(src + c), b));
+    set_bits_generic(dst + c, src + c, n - c, bits);
+  }
+
+  void swap_rb_neon(uint32_t *dst, const uint32_t *src, std::size_t n, uint32_t bits)
+  {
+    uint32x4_t b = vdupq_n_u32(bits);
+    std::size_t c = 0;
+    for(; c + 16 <= n; c += 16)
+      {
+        uint8x16x4_t v = vld4q_u8(reinterpret_cast<const uint8_t*>(src + c));
+        uint8x16_t t = v.val[0];
+        v.val[0] = v.val[2];
+        v.val[2] = t;
+        vst4q_u8(reinterpret_cast<uint8_t*>(dst + c), v);
+        for(std::size_t d = 0; d < 16; d += 4)
+          vst1q_u32(dst + c + d, vorrq_u32(vld1q_u32(dst + c + d), b));
+      }
+    swap_rb_generic(dst + c, src + c, n - c, bits);
+  }
+
+  inline uint16x8_t pack565_neon(uint8x8_t r, uint8x8_t g, uint8x8_t b)
+  {
+    uint16x8_t q = vshll_n_u8(r, 8);
+    q = vsriq_n_u16(q, vshll_n_u8(g, 8), 5);
+    return vsriq_n_u16(q, vshll_n_u8(b, 8), 11);
+  }
+
+  void pack565_neon(uint16_t *dst, const uint32_t *src, std::size_t n, bool bgr)
+  {
+    std::size_t c = 0;
+    for(; c + 16 <= n; c += 16)
+      {
+        uint8x16x4_t v = vld4q_u8(reinterpret_cast<const uint8_t*>(src + c));
+        uint8x16_t r = bgr ? v.val[0] : v.val[2];
+        uint8x16_t b = bgr ? v.val[2] : v.val[0];
+        vst1q_u16(dst + c, pack565_neon(vget_low_u8(r), vget_low_u8(v.val[1]), vget_low_u8(b)));
+        vst1q_u16(dst + c + 8, pack565_neon(vget_high_u8(r), vget_high_u8(v.val[1]), vget_high_u8(b)));
+      }
+    pack565_generic(dst + c, src + c, n - c, bgr);
+  }
+
+  void unpack565_neon(uint32_t *dst, const uint16_t *src, std::size_t n, bool bgr)
+  {
+    std::size_t c = 0;
+    for(; c + 8 <= n; c += 8)
+      {
+        uint16x8_t q = vld1q_u16(src + c);
+        uint8x8_t r = vshrn_n_u16(q, 8);
+        r = vsri_n_u8(r, r, 5);
+        uint8x8_t g = vshrn_n_u16(vshlq_n_u16(q, 5), 8);
+        g = vsri_n_u8(g, g, 6);
+        uint8x8_t b = vmovn_u16(vshlq_n_u16(q, 3));
+        b = vsri_n_u8(b, b, 5);
+        uint8x8x4_t v;
+        v.val[0] = bgr ? r : b;
+        v.val[1] = g;
+        v.val[2] = bgr ? b : r;
+        v.val[3] = vdup_n_u8(0xff);
+        vst4_u8(reinterpret_cast<uint8_t*>(dst + c), v);
+      }
+    unpack565_generic(dst + c, src + c, n - c, bgr);
+  }
+
+  const kernels_t neon_kernels = { isa_t::neon, fill32_neon, fill16_neon, premultiply_neon,
+                                   set_bits_neon, swap_rb_neon, pack565_neon, unpack565_neon };
+#endif
+
+  const kernels_t *kernels_for(isa_t isa)
+  {
+    switch(isa)
+      {
+      case isa_t::generic:
+        return &generic_kernels;
+#ifdef WAYLAND_PIXEL_X86
+      case isa_t::sse2:
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("sse2") ? &sse2_kernels : nullptr;
+      case isa_t::avx2:
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2") ? &avx2_kernels : nullptr;
+#endif
+#ifdef WAYLAND_PIXEL_NEON
+      case isa_t::neon:
+        return &neon_kernels;
+#endif
+      default:
+        return nullptr;
+      }
+  }
+
+  std::atomic<const kernels_t*> &active_kernels()
+  {
+    static std::atomic<const kernels_t*> kernels([] ()
+      {
+        for(isa_t isa : { isa_t::avx2, isa_t::sse2, isa_t::neon })
+          if(const kernels_t *k = kernels_for(isa))
+            return k;
+        return &generic_kernels;
+      }());
+    return kernels;
+  }
+
+  const kernels_t &kernels()
+  {
+    return *active_kernels().load(std::memory_order_relaxed);
+  }
+
+  bool is_32bit(shm_format format)
+  {
+    return format == shm_format::argb8888 || format == shm_format::xrgb8888 || format == shm_format::abgr8888;
+  }
+
+  void check_format(shm_format format)
+  {
+    if(!is_supported(format))
+      throw std::invalid_argument("Unsupported pixel format.");
+  }
+
+  template <typename T>
+  T *row(void *pixels, int32_t stride, int32_t y)
+  {
+    return reinterpret_cast<T*>(static_cast<uint8_t*>(pixels) + static_cast<std::ptrdiff_t>(stride) * y);
+  }
+
+  template <typename T>
+  const T *row(const void *pixels, int32_t stride, int32_t y)
+  {
+    return reinterpret_cast<const T*>(static_cast<const uint8_t*>(pixels) + static_cast<std::ptrdiff_t>(stride) * y);
+  }
+}
+
+isa_t pixel::get_isa()
+{
+  return kernels().isa;
+}
+
+bool pixel::set_isa(isa_t isa)
+{
+  const kernels_t *k = kernels_for(isa);
+  if(!k)
+    return false;
+  active_kernels().store(k, std::memory_order_relaxed);
+  return true;
+}
+
+bool pixel::is_supported(shm_format format)
+{
+  return is_32bit(format) || format == shm_format::rgb565;
+}
+
+void pixel::fill(void *dst, int32_t stride, int32_t width, int32_t height, shm_format format, uint32_t argb)
+{
+  check_format(format);
+  if(width <= 0 || height <= 0)
+    return;
+  const kernels_t &k = kernels();
+  auto n = static_cast<std::size_t>(width);
+  if(format == shm_format::rgb565)
+    {
+      uint16_t value = pack565(argb);
+      for(int32_t y = 0; y < height; y++)
+        k.fill16(row<uint16_t>(dst, stride, y), n, value);
+    }
+  else
+    {
+      uint32_t value = format == shm_format::abgr8888 ? swap_rb(argb) : argb;
+      for(int32_t y = 0; y < height; y++)
+        k.fill32(row<uint32_t>(dst, stride, y), n, value);
+    }
+}
+
+void pixel::fill(const shm_buffer_t &buffer, uint32_t argb)
+{
+  fill(buffer.pixels(), buffer.stride(), buffer.width(), buffer.height(), buffer.format(), argb);
+}
+
+void pixel::copy_rect(void *dst, int32_t dst_stride, const void *src, int32_t src_stride,
+                      int32_t width, int32_t height, shm_format format)
+{
+  unsigned int bpp = shm_format_bytes_per_pixel(format);
+  if(bpp == 0)
+    throw std::invalid_argument("Unsupported pixel format.");
+  if(width <= 0 || height <= 0)
+    return;
+  // memcpy is already vectorized by the C library
+  std::size_t len = static_cast<std::size_t>(width) * bpp;
+  for(int32_t y = 0; y < height; y++)
+    std::memcpy(row<uint8_t>(dst, dst_stride, y), row<uint8_t>(src, src_stride, y), len);
+}
+
+void pixel::copy_rect(const shm_buffer_t &dst, int32_t dst_x, int32_t dst_y,
+                      const shm_buffer_t &src, const rect_t &src_rect)
+{
+  if(dst.format() != src.format())
+    throw std::invalid_argument("Buffers have different pixel formats.");
+  rect_t r = src_rect.intersected(rect_t(0, 0, src.width(), src.height()));
+  dst_x += r.x - src_rect.x;
+  dst_y += r.y - src_rect.y;
+  rect_t d = rect_t(dst_x, dst_y, r.width, r.height).intersected(rect_t(0, 0, dst.width(), dst.height()));
+  if(d.empty())
+    return;
+  r.x += d.x - dst_x;
+  r.y += d.y - dst_y;
+  unsigned int bpp = shm_format_bytes_per_pixel(src.format());
+  copy_rect(row<uint8_t>(dst.pixels(), dst.stride(), d.y) + static_cast<std::size_t>(d.x) * bpp, dst.stride(),
+            row<uint8_t>(src.pixels(), src.stride(), r.y) + static_cast<std::size_t>(r.x) * bpp, src.stride(),
+            d.width, d.height, src.format());
+}
+
+void pixel::premultiply(void *pixels, int32_t stride, int32_t width, int32_t height, shm_format format)
+{
+  if(format != shm_format::argb8888 && format != shm_format::abgr8888)
+    throw std::invalid_argument("Pixel format has no alpha channel.");
+  if(width <= 0 || height <= 0)
+    return;
+  const kernels_t &k = kernels();
+  for(int32_t y = 0; y < height; y++)
+    k.premultiply(row<uint32_t>(pixels, stride, y), static_cast<std::size_t>(width));
+}
+
+void pixel::convert(void *dst, int32_t dst_stride, shm_format dst_format,
+                    const void *src, int32_t src_stride, shm_format src_format,
+                    int32_t width, int32_t height)
+{
+  check_format(dst_format);
+  check_format(src_format);
+  if(width <= 0 || height <= 0)
+    return;
+  if(dst_format == src_format)
+    {
+      copy_rect(dst, dst_stride, src, src_stride, width, height, dst_format);
+      return;
+    }
+
+  const kernels_t &k = kernels();
+  auto n = static_cast<std::size_t>(width);
+  bool src_bgr = src_format == shm_format::abgr8888;
+  bool dst_bgr = dst_format == shm_format::abgr8888;
+  for(int32_t y = 0; y < height; y++)
+    {
+      if(dst_format == shm_format::rgb565)
+        k.pack565(row<uint16_t>(dst, dst_stride, y), row<uint32_t>(src, src_stride, y), n, src_bgr);
+      else if(src_format == shm_format::rgb565)
+        k.unpack565(row<uint32_t>(dst, dst_stride, y), row<uint16_t>(src, src_stride, y), n, dst_bgr);
+      else
+        {
+          // only xrgb8888 has no alpha channel
+          uint32_t bits = src_format == shm_format::xrgb8888 ? 0xff000000u : 0;
+          if(src_bgr != dst_bgr)
+            k.swap_rb(row<uint32_t>(dst, dst_stride, y), row<uint32_t>(src, src_stride, y), n, bits);
+          else
+            k.set_bits(row<uint32_t>(dst, dst_stride, y), row<uint32_t>(src, src_stride, y), n, bits);
+        }
+    }
+}
@@ -0,0 +1,632 @@
+/*
+ * Copyright (c) 2014-2019, Nils Christopher Brause, Philipp Kerling
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <cctype>
+#include <cerrno>
+
+#include <stdexcept>
+#include <system_error>
+#include <wayland-server.hpp>
+
+using namespace wayland::server;
+using namespace wayland::server::detail;
+using wayland::detail::any;
+using wayland::detail::any_vector;
+using wayland::detail::argument_t;
+using wayland::detail::events_base_t;
+
+namespace
+{
+  // wl_listener wrapper that allows getting back to the owning data
+  struct listener_t
+  {
+    wl_listener listener;
+    void *user;
+  };
+}
+
+// stored in the destroy listener of the client
+struct wayland::server::detail::client_data_t
+{
+  listener_t destroy_listener{};
+  std::function<void()> destroy;
+  std::atomic<unsigned int> counter{1};
+  bool destroyed{false};
+};
+
+// stored in the destroy listener and the user data of the resource
+struct wayland::server::detail::resource_data_t
+{
+  listener_t destroy_listener{};
+  std::shared_ptr<events_base_t> events;
+  std::function<void()> destroy;
+  bool has_destroy_opcode{false};
+  std::uint32_t destroy_opcode{};
+  std::atomic<unsigned int> counter{1};
+  bool destroyed{false};
+};
+
+// stored in the user data of the global
+struct wayland::server::detail::global_data_t
+{
+  wl_global *global = nullptr;
+  // the display must outlive the global
+  display_t display;
+  std::shared_ptr<events_base_t> events;
+  global_base_t::binder_t binder = nullptr;
+
+  global_data_t() = default;
+  global_data_t(const global_data_t&) = delete;
+  global_data_t(global_data_t&&) noexcept = delete;
+  global_data_t& operator=(const global_data_t&) = delete;
+  global_data_t& operator=(global_data_t&&) noexcept = delete;
+
+  ~global_data_t() noexcept
+  {
+    if(global)
+      wl_global_destroy(global);
+  }
+};
+
+event_loop_t::event_loop_t(wl_event_loop *loop)
+  : basic_wrapper<wl_event_loop>(loop)
+{
+}
+
+int event_loop_t::get_fd() const
+{
+  return wl_event_loop_get_fd(c_ptr());
+}
+
+int event_loop_t::dispatch(int timeout)
+{
+  return wayland::detail::check_return_value(wl_event_loop_dispatch(c_ptr(), timeout), "wl_event_loop_dispatch");
+}
+
+void event_loop_t::dispatch_idle()
+{
+  wl_event_loop_dispatch_idle(c_ptr());
+}
+
+display_t::display_t()
+  : refcounted_wrapper<wl_display>({wl_display_create(), wl_display_destroy})
+{
+  if(!has_object())
+    throw std::runtime_error("wl_display_create failed.");
+}
+
+event_loop_t display_t::get_event_loop() const
+{
+  return wl_display_get_event_loop(c_ptr());
+}
+
+void display_t::add_socket(const std::string &name)
+{
+  if(wl_display_add_socket(c_ptr(), name.c_str()) != 0)
+    throw std::runtime_error("wl_display_add_socket failed.");
+}
+
+std::string display_t::add_socket_auto()
+{
+  const char *name = wl_display_add_socket_auto(c_ptr());
+  if(!name)
+    throw std::runtime_error("wl_display_add_socket_auto failed.");
+  return name;
+}
+
+void display_t::run()
+{
+  wl_display_run(c_ptr());
+}
+
+void display_t::terminate()
+{
+  wl_display_terminate(c_ptr());
+}
+
+void display_t::flush_clients()
+{
+  wl_display_flush_clients(c_ptr());
+}
+
+uint32_t display_t::get_serial() const
+{
+  return wl_display_get_serial(c_ptr());
+}
+
+uint32_t display_t::next_serial()
+{
+  return wl_display_next_serial(c_ptr());
+}
+
+void client_t::destroy_func(wl_listener *listener, void * /*unused*/)
+{
+  auto *data = static_cast<client_data_t*>(reinterpret_cast<listener_t*>(listener)->user);
+  data->destroyed = true;
+  wl_list_remove(&listener->link);
+  if(data->destroy)
+    data->destroy();
+  data->destroy = nullptr;
+  // the reference of the connection itself
+  if(--data->counter == 0)
+    delete data;
+}
+
+client_t::client_t(display_t &display, int fd)
+  : client_t(wl_client_create(display, fd))
+{
+}
+
+client_t::client_t(wl_client *c)
+  : client(c)
+{
+  if(!client)
+    throw std::runtime_error("Cannot construct client_t from nullptr.");
+
+  wl_listener *listener = wl_client_get_destroy_listener(client, destroy_func);
+  if(listener)
+    {
+      data = static_cast<client_data_t*>(reinterpret_cast<listener_t*>(listener)->user);
+      ++data->counter;
+    }
+  else
+    {
+      data = new client_data_t;
+      data->destroy_listener.listener.notify = destroy_func;
+      data->destroy_listener.user = data;
+      wl_client_add_destroy_listener(client, &data->destroy_listener.listener);
+      ++data->counter;
+    }
+}
+
+client_t::client_t(const client_t &c)
+{
+  operator=(c);
+}
+
+client_t::client_t(client_t &&c) noexcept
+{
+  operator=(std::move(c));
+}
+
+client_t &client_t::operator=(const client_t &c)
+{
+  if(&c == this)
+    return *this;
+
+  if(data && --data->counter == 0)
+    delete data;
+
+  client = c.client;
+  data = c.data;
+  if(data)
+    data->counter++;
+  return *this;
+}
+
+client_t &client_t::operator=(client_t &&c) noexcept
+{
+  std::swap(client, c.client);
+  std::swap(data, c.data);
+  return *this;
+}
+
+client_t::~client_t()
+{
+  if(data && --data->counter == 0)
+    delete data;
+}
+
+void client_t::destroy()
+{
+  wl_client_destroy(c_ptr());
+}
+
+void client_t::flush()
+{
+  wl_client_flush(c_ptr());
+}
+
+void client_t::get_credentials(pid_t &pid, uid_t &uid, gid_t &gid) const
+{
+  wl_client_get_credentials(c_ptr(), &pid, &uid, &gid);
+}
+
+int client_t::get_fd() const
+{
+  return wl_client_get_fd(c_ptr());
+}
+
+void client_t::post_no_memory() const
+{
+  wl_client_post_no_memory(c_ptr());
+}
+
+std::function<void()> &client_t::on_destroy()
+{
+  if(!data)
+    throw std::invalid_argument("client is NULL");
+  return data->destroy;
+}
+
+wl_client *client_t::c_ptr() const
+{
+  if(!client_has_object())
+    throw std::invalid_argument("client is NULL");
+  return client;
+}
+
+bool client_t::client_has_object() const
+{
+  return client && data && !data->destroyed;
+}
+
+client_t::operator bool() const
+{
+  return client_has_object();
+}
+
+bool client_t::operator==(const client_t &right) const
+{
+  return client == right.client;
+}
+
+bool client_t::operator!=(const client_t &right) const
+{
+  return !(*this == right); // Reuse equals operator
+}
+
+int resource_t::c_dispatcher(const void *implementation, void *target, uint32_t opcode, const wl_message *message, wl_argument *args)
+{
+  if(!implementation)
+    throw std::invalid_argument("resource dispatcher: implementation is NULL.");
+  if(!target)
+    throw std::invalid_argument("resource dispatcher: target is NULL.");
+  if(!message)
+    throw std::invalid_argument("resource dispatcher: message is NULL.");
+  if(!args)
+    throw std::invalid_argument("resource dispatcher: args is NULL.");
+
+  auto *res = reinterpret_cast<wl_resource*>(target);
+  std::string signature(message->signature);
+  any_vector vargs(wayland::detail::allocator<any>(allocation_category::arguments));
+  unsigned int c = 0;
+  for(char ch : signature)
+    {
+      if(ch == '?' || isdigit(ch))
+        continue;
+
+      any a;
+      switch(ch)
+        {
+          // int_32_t
+        case 'i':
+          a = args[c].i;
+          break;
+          // uint32_t
+        case 'u':
+          a = args[c].u;
+          break;
+          // fd
+        case 'h':
+          a = args[c].h;
+          break;
+          // fixed
+        case 'f':
+          a = fixed_t::from_raw(args[c].f);
+          break;
+          // string
+        case 's':
+          if(args[c].s)
+            a = std::string(args[c].s);
+          else
+            a = std::string("");
+          break;
+          // resource
+        case 'o':
+          if(args[c].o)
+            a = resource_t(reinterpret_cast<wl_resource*>(args[c].o));
+          else
+            a = resource_t();
+          break;
+          // new id
+        case 'n':
+          // The resource for the new id is created here, so that the
+          // handlers always receive a usable resource.
+          if(message->types[c])
+            {
+              wl_resource *r = wl_resource_create(wl_resource_get_client(res), message->types[c],
+                                                  wl_resource_get_version(res), args[c].n);
+              if(!r)
+                {
+                  wl_resource_post_no_memory(res);
+                  return 0;
+                }
+              a = resource_t(r);
+            }
+          else
+            a = args[c].n;
+          break;
+          // array
+        case 'a':
+          if(args[c].a)
+            a = array_t(args[c].a);
+          else
+            a = array_t();
+          break;
+        default:
+          a = 0;
+          break;
+        }
+      vargs.push_back(a);
+      c++;
+    }
+  resource_t r(res);
+  using dispatcher_func = int(*)(std::uint32_t, const any_vector&, const std::shared_ptr<events_base_t>&);
+  auto dispatcher = reinterpret_cast<dispatcher_func>(const_cast<void*>(implementation));
+  int result = dispatcher(opcode, vargs, r.get_events());
+  // destructor requests destroy the resource after the handler has been called
+  if(r.data->has_destroy_opcode && r.data->destroy_opcode == opcode && !r.data->destroyed)
+    wl_resource_destroy(res);
+  return result;
+}
+
+void resource_t::destroy_func(wl_listener *listener, void * /*unused*/)
+{
+  auto *data = static_cast<resource_data_t*>(reinterpret_cast<listener_t*>(listener)->user);
+  data->destroyed = true;
+  wl_list_remove(&listener->link);
+  if(data->destroy)
+    data->destroy();
+  // Handlers may hold copies of the resource, release them now.
+  data->destroy = nullptr;
+  data->events.reset();
+  // the reference of the wl_resource itself
+  if(--data->counter == 0)
+    delete data;
+}
+
+void resource_t::init(wl_resource *r)
+{
+  resource = r;
+  wl_listener *listener = wl_resource_get_destroy_listener(resource, destroy_func);
+  if(listener)
+    {
+      data = static_cast<resource_data_t*>(reinterpret_cast<listener_t*>(listener)->user);
+      ++data->counter;
+    }
+  else
+    {
+      data = new resource_data_t;
+      data->destroy_listener.listener.notify = destroy_func;
+      data->destroy_listener.user = data;
+      wl_resource_add_destroy_listener(resource, &data->destroy_listener.listener);
+      ++data->counter;
+    }
+}
+
+resource_t::resource_t(const client_t &client, const wl_interface *interface, int version, uint32_t id)
+{
+  wl_resource *r = wl_resource_create(client.c_ptr(), interface, version, id);
+  if(!r)
+    throw std::runtime_error("wl_resource_create failed.");
+  init(r);
+}
+
+resource_t::resource_t(wl_resource *r)
+{
+  if(!r)
+    throw std::runtime_error("Cannot construct resource_t from nullptr.");
+  init(r);
+}
+
+resource_t::resource_t(const resource_t &r)
+{
+  operator=(r);
+}
+
+resource_t::resource_t(resource_t &&r) noexcept
+{
+  operator=(std::move(r));
+}
+
+resource_t &resource_t::operator=(const resource_t &r)
+{
+  if(&r == this)
+    return *this;
+
+  if(data && --data->counter == 0)
+    delete data;
+
+  resource = r.resource;
+  data = r.data;
+  if(data)
+    data->counter++;
+  return *this;
+}
+
+resource_t &resource_t::operator=(resource_t &&r) noexcept
+{
+  std::swap(resource, r.resource);
+  std::swap(data, r.data);
+  return *this;
+}
+
+resource_t::~resource_t()
+{
+  if(data && --data->counter == 0)
+    delete data;
+}
+
+void resource_t::send_event_array(bool post, uint32_t opcode, const std::vector<argument_t>& args)
+{
+  std::vector<wl_argument> v;
+  v.reserve(args.size());
+  for(auto const& arg : args)
+    v.push_back(arg.get_c_argument());
+  if(post)
+    wl_resource_post_event_array(c_ptr(), opcode, v.data());
+  else
+    wl_resource_queue_event_array(c_ptr(), opcode, v.data());
+}
+
+void resource_t::set_destroy_opcode(uint32_t destroy_opcode)
+{
+  if(data)
+    {
+      data->has_destroy_opcode = true;
+      data->destroy_opcode = destroy_opcode;
+    }
+}
+
+void resource_t::set_events(std::shared_ptr<events_base_t> events,
+                            int(*dispatcher)(uint32_t, const any_vector&, const std::shared_ptr<events_base_t>&))
+{
+  // set only one time
+  if(data && !data->events && !data->destroyed)
+    {
+      data->events = std::move(events);
+      // the dispatcher gets 'implementation'
+      wl_resource_set_dispatcher(c_ptr(), c_dispatcher, reinterpret_cast<void*>(dispatcher), data, nullptr);
+    }
+}
+
+std::shared_ptr<events_base_t> resource_t::get_events()
+{
+  if(data)
+    return data->events;
+  return std::shared_ptr<events_base_t>();
+}
+
+void resource_t::destroy()
+{
+  wl_resource_destroy(c_ptr());
+}
+
+void resource_t::post_error(uint32_t code, const std::string &msg) const
+{
+  wl_resource_post_error(c_ptr(), code, "%s", msg.c_str());
+}
+
+void resource_t::post_no_memory() const
+{
+  wl_resource_post_no_memory(c_ptr());
+}
+
+uint32_t resource_t::get_id() const
+{
+  return wl_resource_get_id(c_ptr());
+}
+
+client_t resource_t::get_client() const
+{
+  return client_t(wl_resource_get_client(c_ptr()));
+}
+
+unsigned int resource_t::get_version() const
+{
+  return static_cast<unsigned int>(wl_resource_get_version(c_ptr()));
+}
+
+std::string resource_t::get_class() const
+{
+  return wl_resource_get_class(c_ptr());
+}
+
+std::function<void()> &resource_t::on_destroy()
+{
+  if(!data)
+    throw std::invalid_argument("resource is NULL");
+  return data->destroy;
+}
+
+wl_resource *resource_t::c_ptr() const
+{
+  if(!resource_has_object())
+    throw std::invalid_argument("resource is NULL");
+  return resource;
+}
+
+bool resource_t::resource_has_object() const
+{
+  return resource && data && !data->destroyed;
+}
+
+resource_t::operator bool() const
+{
+  return resource_has_object();
+}
+
+bool resource_t::operator==(const resource_t &right) const
+{
+  return resource == right.resource;
+}
+
+bool resource_t::operator!=(const resource_t &right) const
+{
+  return !(*this == right); // Reuse equals operator
+}
+
+void global_base_t::bind_func(wl_client *client, void *data, uint32_t version, uint32_t id)
+{
+  auto *d = static_cast<global_data_t*>(data);
+  d->binder(d->events, client_t(client), version, id);
+}
+
+global_base_t::global_base_t(display_t &display, const wl_interface *interface, int version,
+                             std::shared_ptr<events_base_t> events, binder_t binder)
+  : data(std::make_shared<global_data_t>())
+{
+  data->display = display;
+  data->events = std::move(events);
+  data->binder = binder;
+  data->global = wl_global_create(display, interface, version, data.get(), bind_func);
+  if(!data->global)
+    throw std::runtime_error("wl_global_create failed.");
+}
+
+std::shared_ptr<events_base_t> global_base_t::get_events()
+{
+  if(data)
+    return data->events;
+  return std::shared_ptr<events_base_t>();
+}
+
+wl_global *global_base_t::c_ptr() const
+{
+  if(!data)
+    throw std::invalid_argument("global is NULL");
+  return data->global;
+}
+
+bool global_base_t::global_has_object() const
+{
+  return !!data;
+}
+
+global_base_t::operator bool() const
+{
+  return global_has_object();
+}
@@ -0,0 +1,927 @@
+/*
+ * Copyright (c) 2014-2019, Nils Christopher Brause, Philipp Kerling
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <list>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <wayland-shm.hpp>
+
+using namespace wayland;
+using namespace wayland::detail;
+
+namespace
+{
+  std::size_t align_up(std::size_t size, std::size_t alignment)
+  {
+    return (size + alignment - 1) / alignment * alignment;
+  }
+
+  std::size_t page_size()
+  {
+    static const std::size_t size = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+    return size;
+  }
+
+  // Default size of huge pages as reported in /proc/meminfo
+  std::size_t huge_page_size()
+  {
+    static const std::size_t size = [] ()
+      {
+        std::size_t kb = 0;
+        std::ifstream meminfo("/proc/meminfo");
+        std::string line;
+        while(std::getline(meminfo, line))
+          if(line.compare(0, 13, "Hugepagesize:") == 0)
+            {
+              kb = std::strtoul(line.c_str() + 13, nullptr, 10);
+              break;
+            }
+        return kb ? kb * 1024 : std::size_t(2) << 20;
+      }();
+    return size;
+  }
+}
+
+shm_backing_t::shm_backing_t(std::size_t size, std::size_t reserve_size, const shm_backing_options_t &options)
+  : options(options)
+{
+  if(options.huge_pages && create(size, reserve_size, true))
+    return;
+  create(size, reserve_size, false);
+}
+
+bool shm_backing_t::create(std::size_t size, std::size_t reserve_size, bool use_hugetlb)
+{
+  hugetlb = use_hugetlb;
+  granule = hugetlb ? huge_page_size() : page_size();
+  len = align_up(size, granule);
+  reserved_len = align_up(std::max(size, reserve_size), granule);
+
+  unsigned int flags = MFD_CLOEXEC;
+  if(options.seal)
+    flags |= MFD_ALLOW_SEALING;
+  if(hugetlb)
+    {
+#ifdef MFD_HUGETLB
+      flags |= MFD_HUGETLB;
+#else
+      return false;
+#endif
+    }
+  fd = memfd_create("wayland-shm", flags);
+  if(fd < 0 && options.seal && errno == EINVAL)
+    fd = memfd_create("wayland-shm", flags & ~MFD_ALLOW_SEALING);
+  if(fd < 0)
+    {
+      if(hugetlb)
+        return false;
+      throw std::system_error(errno, std::generic_category(), "memfd_create");
+    }
+
+  // Reserve the whole range once, so that growing never moves the
+  // existing mapping. Huge page mappings need an aligned start address.
+  reservation_len = reserved_len + (hugetlb ? granule : 0);
+  reservation = mmap(nullptr, reservation_len, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if(reservation == MAP_FAILED) // NOLINT
+    {
+      int err = errno;
+      reservation = nullptr;
+      release();
+      throw std::system_error(err, std::generic_category(), "mmap");
+    }
+  mem = reinterpret_cast<uint8_t*>(align_up(reinterpret_cast<std::uintptr_t>(reservation), granule));
+
+  try
+    {
+      map(0, len);
+    }
+  catch(std::system_error &)
+    {
+      release();
+      if(hugetlb)
+        return false;
+      throw;
+    }
+
+  if(options.seal)
+    fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK);
+  return true;
+}
+
+void shm_backing_t::map(std::size_t offset, std::size_t length)
+{
+  if(ftruncate(fd, static_cast<off_t>(offset + length)) < 0)
+    throw std::system_error(errno, std::generic_category(), "ftruncate");
+  int flags = MAP_SHARED | MAP_FIXED;
+  if(options.populate)
+    flags |= MAP_POPULATE;
+  void *m = mmap(mem + offset, length, PROT_READ | PROT_WRITE, flags, fd, static_cast<off_t>(offset));
+  if(m == MAP_FAILED) // NOLINT
+    throw std::system_error(errno, std::generic_category(), "mmap");
+#ifdef MADV_HUGEPAGE
+  // transparent huge pages are only a hint, failure is not an error
+  if(options.huge_pages && !hugetlb)
+    madvise(mem + offset, length, MADV_HUGEPAGE);
+#endif
+}
+
+void shm_backing_t::release()
+{
+  if(reservation)
+    munmap(reservation, reservation_len);
+  if(fd >= 0)
+    ::close(fd);
+  fd = -1;
+  reservation = nullptr;
+  reservation_len = 0;
+  mem = nullptr;
+  len = 0;
+  reserved_len = 0;
+}
+
+shm_backing_t::shm_backing_t(shm_backing_t &&b) noexcept
+{
+  operator=(std::move(b));
+}
+
+shm_backing_t &shm_backing_t::operator=(shm_backing_t &&b) noexcept
+{
+  std::swap(fd, b.fd);
+  std::swap(reservation, b.reservation);
+  std::swap(reservation_len, b.reservation_len);
+  std::swap(mem, b.mem);
+  std::swap(len, b.len);
+  std::swap(reserved_len, b.reserved_len);
+  std::swap(granule, b.granule);
+  std::swap(hugetlb, b.hugetlb);
+  std::swap(options, b.options);
+  return *this;
+}
+
+shm_backing_t::~shm_backing_t() noexcept
+{
+  release();
+}
+
+bool shm_backing_t::grow(std::size_t size)
+{
+  if(fd < 0)
+    throw std::invalid_argument("shm backing is empty");
+  size = align_up(size, granule);
+  if(size <= len)
+    return true;
+  if(size > reserved_len)
+    return false;
+  map(len, size - len);
+  len = size;
+  return true;
+}
+
+void shm_backing_t::seal_size()
+{
+  if(options.seal)
+    fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW);
+}
+
+int shm_backing_t::get_fd() const
+{
+  return fd;
+}
+
+void *shm_backing_t::get_mem() const
+{
+  return mem;
+}
+
+std::size_t shm_backing_t::get_size() const
+{
+  return len;
+}
+
+std::size_t shm_backing_t::get_reserved_size() const
+{
+  return reserved_len;
+}
+
+std::size_t shm_backing_t::get_page_size() const
+{
+  return granule;
+}
+
+bool shm_backing_t::uses_hugetlb() const
+{
+  return hugetlb;
+}
+
+shm_backing_t::operator bool() const
+{
+  return fd >= 0;
+}
+
+namespace wayland
+{
+  namespace detail
+  {
+    // A wl_shm_pool and the free blocks in its memory
+    struct shm_pool_data_t
+    {
+      shm_backing_t backing;
+      shm_pool_t pool;
+      std::size_t size = 0;
+      // growing failed, e.g. because no more huge pages were available
+      bool exhausted = false;
+      // offset -> length of free blocks
+      std::map<std::size_t, std::size_t> free_blocks;
+
+      shm_pool_data_t(shm_t &shm, std::size_t initial_size, std::size_t reserve_size,
+                      const shm_backing_options_t &options)
+        : backing(initial_size, reserve_size, options)
+      {
+        size = backing.get_size();
+        free_blocks[0] = size;
+        pool = shm.create_pool(backing.get_fd(), static_cast<int32_t>(size));
+      }
+
+      uint8_t *base() const
+      {
+        return static_cast<uint8_t*>(backing.get_mem());
+      }
+
+      // Try to grow the pool such that a block of the given size fits at
+      // its end.
+      bool grow(std::size_t length)
+      {
+        if(exhausted)
+          return false;
+        std::size_t tail = 0;
+        if(!free_blocks.empty())
+          {
+            auto last = std::prev(free_blocks.end());
+            if(last->first + last->second == size)
+              tail = last->second;
+          }
+        std::size_t needed = size + length - tail;
+        std::size_t limit = std::min(backing.get_reserved_size(),
+                                     static_cast<std::size_t>(std::numeric_limits<int32_t>::max()) / backing.get_page_size() * backing.get_page_size());
+        if(needed > limit)
+          return false;
+        try
+          {
+            if(!backing.grow(std::min(std::max(needed, 2 * size), limit)))
+              return false;
+          }
+        catch(std::system_error &)
+          {
+            exhausted = true;
+            return false;
+          }
+        std::size_t new_size = backing.get_size();
+        pool.resize(static_cast<int32_t>(new_size));
+        release(size, new_size - size);
+        size = new_size;
+        return true;
+      }
+
+      // First fit
+      bool take(std::size_t length, std::size_t &offset)
+      {
+        for(auto it = free_blocks.begin(); it != free_blocks.end(); ++it)
+          if(it->second >= length)
+            {
+              offset = it->first;
+              if(it->second > length)
+                free_blocks[it->first + length] = it->second - length;
+              free_blocks.erase(it);
+              return true;
+            }
+        return false;
+      }
+
+      // Return a block to the free list and coalesce it with its neighbours
+      void release(std::size_t offset, std::size_t length)
+      {
+        auto next = free_blocks.lower_bound(offset);
+        if(next != free_blocks.end() && offset + length == next->first)
+          {
+            length += next->second;
+            next = free_blocks.erase(next);
+          }
+        if(next != free_blocks.begin())
+          {
+            auto prev = std::prev(next);
+            if(prev->first + prev->second == offset)
+              {
+                prev->second += length;
+                return;
+              }
+          }
+        free_blocks[offset] = length;
+      }
+    };
+
+    struct shm_buffer_data_t
+    {
+      buffer_t buffer;
+      std::shared_ptr<shm_pool_data_t> pool;
+      std::weak_ptr<shm_allocator_data_t> allocator;
+      std::size_t offset = 0;
+      std::size_t length = 0;
+      int32_t width = 0;
+      int32_t height = 0;
+      int32_t stride = 0;
+      shm_format format = shm_format::argb8888;
+      bool busy = false;
+      // no handles left, waiting for the release event
+      bool orphaned = false;
+      std::function<void()> on_release;
+
+      ~shm_buffer_data_t()
+      {
+        buffer.proxy_release();
+        if(pool)
+          pool->release(offset, length);
+      }
+    };
+
+    struct shm_allocator_data_t
+    {
+      shm_t shm;
+      std::size_t reserve_size = 0;
+      shm_backing_options_t options;
+      std::size_t cache_size = 8;
+      std::size_t allocated = 0;
+      std::vector<std::shared_ptr<shm_pool_data_t>> pools;
+      // unused buffers, most recently used first
+      std::list<std::shared_ptr<shm_buffer_data_t>> cache;
+      // unused buffers that are still busy
+      std::list<std::shared_ptr<shm_buffer_data_t>> orphans;
+
+      void evict(std::size_t keep)
+      {
+        while(cache.size() > keep)
+          {
+            allocated -= cache.back()->length;
+            cache.pop_back();
+          }
+      }
+
+      // Called when the last handle of a buffer is gone or when an orphaned
+      // buffer is released.
+      void recycle(const std::shared_ptr<shm_buffer_data_t> &buffer)
+      {
+        if(buffer->busy)
+          {
+            buffer->orphaned = true;
+            orphans.push_back(buffer);
+            return;
+          }
+        if(buffer->orphaned)
+          {
+            buffer->orphaned = false;
+            orphans.remove(buffer);
+          }
+        buffer->on_release = std::function<void()>();
+        if(cache_size == 0)
+          {
+            allocated -= buffer->length;
+            return;
+          }
+        // The cache is trimmed on the next allocation.
+        cache.push_front(buffer);
+      }
+
+      std::shared_ptr<shm_buffer_data_t> find_cached(int32_t width, int32_t height, int32_t stride, shm_format format)
+      {
+        for(auto it = cache.begin(); it != cache.end(); ++it)
+          {
+            auto &b = *it;
+            if(b->width == width && b->height == height && b->stride == stride && b->format == format)
+              {
+                auto buffer = b;
+                cache.erase(it);
+                return buffer;
+              }
+          }
+        return nullptr;
+      }
+
+      bool take(std::size_t length, std::shared_ptr<shm_pool_data_t> &pool, std::size_t &offset)
+      {
+        for(auto &p : pools)
+          if(p->take(length, offset))
+            {
+              pool = p;
+              return true;
+            }
+        return false;
+      }
+
+      void place(std::size_t length, std::shared_ptr<shm_pool_data_t> &pool, std::size_t &offset)
+      {
+        if(take(length, pool, offset))
+          return;
+
+        // grow an existing pool in place
+        for(auto &p : pools)
+          if(p->grow(length) && p->take(length, offset))
+            {
+              pool = p;
+              return;
+            }
+
+        // make room by dropping unused buffers
+        while(!cache.empty())
+          {
+            evict(cache.size() - 1);
+            if(take(length, pool, offset))
+              return;
+          }
+
+        pools.push_back(std::make_shared<shm_pool_data_t>(shm, length, reserve_size, options));
+        pool = pools.back();
+        if(!pool->take(length, offset))
+          throw std::logic_error("New shm pool is too small.");
+      }
+    };
+
+    struct swapchain_data_t
+    {
+      // non-owning wrapper, independent of the display_t of the caller
+      display_t display;
+      surface_t surface;
+      shm_allocator_t allocator;
+      unsigned int count = 0;
+      int32_t width = 0;
+      int32_t height = 0;
+      shm_format format = shm_format::argb8888;
+      std::vector<shm_buffer_t> buffers;
+      // acquired, but not yet presented
+      shm_buffer_t current;
+      callback_t frame_cb;
+      std::function<void(uint32_t)> on_frame;
+      swapchain_stats_t stats;
+      // incremented by every resize, which drops all buffers
+      uint64_t generation = 0;
+
+      swapchain_data_t(wl_display *d)
+        : display(d)
+      {
+      }
+    };
+  }
+}
+
+unsigned int wayland::shm_format_bytes_per_pixel(shm_format format)
+{
+  switch(format)
+    {
+    case shm_format::c8:
+    case shm_format::rgb332:
+    case shm_format::bgr233:
+      return 1;
+    case shm_format::xrgb4444:
+    case shm_format::xbgr4444:
+    case shm_format::rgbx4444:
+    case shm_format::bgrx4444:
+    case shm_format::argb4444:
+    case shm_format::abgr4444:
+    case shm_format::rgba4444:
+    case shm_format::bgra4444:
+    case shm_format::xrgb1555:
+    case shm_format::xbgr1555:
+    case shm_format::rgbx5551:
+    case shm_format::bgrx5551:
+    case shm_format::argb1555:
+    case shm_format::abgr1555:
+    case shm_format::rgba5551:
+    case shm_format::bgra5551:
+    case shm_format::rgb565:
+    case shm_format::bgr565:
+      return 2;
+    case shm_format::rgb888:
+    case shm_format::bgr888:
+      return 3;
+    case shm_format::argb8888:
+    case shm_format::xrgb8888:
+    case shm_format::xbgr8888:
+    case shm_format::rgbx8888:
+    case shm_format::bgrx8888:
+    case shm_format::abgr8888:
+    case shm_format::rgba8888:
+    case shm_format::bgra8888:
+    case shm_format::xrgb2101010:
+    case shm_format::xbgr2101010:
+    case shm_format::rgbx1010102:
+    case shm_format::bgrx1010102:
+    case shm_format::argb2101010:
+    case shm_format::abgr2101010:
+    case shm_format::rgba1010102:
+    case shm_format::bgra1010102:
+      return 4;
+    default:
+      return 0;
+    }
+}
+
+shm_buffer_t::shm_buffer_t(std::shared_ptr<shm_buffer_data_t> d)
+  : data(std::move(d))
+{
+}
+
+buffer_t &shm_buffer_t::buffer() const
+{
+  if(!data)
+    throw std::invalid_argument("shm buffer is NULL");
+  return data->buffer;
+}
+
+void *shm_buffer_t::pixels() const
+{
+  if(!data)
+    throw std::invalid_argument("shm buffer is NULL");
+  return data->pool->base() + data->offset;
+}
+
+int32_t shm_buffer_t::width() const
+{
+  return data ? data->width : 0;
+}
+
+int32_t shm_buffer_t::height() const
+{
+  return data ? data->height : 0;
+}
+
+int32_t shm_buffer_t::stride() const
+{
+  return data ? data->stride : 0;
+}
+
+shm_format shm_buffer_t::format() const
+{
+  if(!data)
+    throw std::invalid_argument("shm buffer is NULL");
+  return data->format;
+}
+
+std::size_t shm_buffer_t::size() const
+{
+  return data ? static_cast<std::size_t>(data->stride) * static_cast<std::size_t>(data->height) : 0;
+}
+
+void shm_buffer_t::attach(surface_t &surface, int32_t x, int32_t y)
+{
+  surface.attach(buffer(), x, y);
+  mark_busy();
+}
+
+void shm_buffer_t::mark_busy()
+{
+  if(!data)
+    throw std::invalid_argument("shm buffer is NULL");
+  data->busy = true;
+}
+
+bool shm_buffer_t::busy() const
+{
+  return data && data->busy;
+}
+
+std::function<void()> &shm_buffer_t::on_release()
+{
+  if(!data)
+    throw std::invalid_argument("shm buffer is NULL");
+  return data->on_release;
+}
+
+shm_buffer_t::operator bool() const
+{
+  return static_cast<bool>(data);
+}
+
+bool shm_buffer_t::operator==(const shm_buffer_t &right) const
+{
+  return data == right.data;
+}
+
+bool shm_buffer_t::operator!=(const shm_buffer_t &right) const
+{
+  return !(*this == right);
+}
+
+constexpr std::size_t shm_allocator_t::default_reserve_size;
+constexpr std::size_t shm_allocator_t::alignment;
+
+shm_allocator_t::shm_allocator_t(const shm_t &shm, std::size_t initial_size, std::size_t reserve_size,
+                                 const shm_backing_options_t &options)
+  : data(std::make_shared<shm_allocator_data_t>())
+{
+  data->shm = shm;
+  data->reserve_size = reserve_size;
+  data->options = options;
+  if(initial_size)
+    data->pools.push_back(std::make_shared<shm_pool_data_t>(data->shm, initial_size, reserve_size, options));
+}
+
+shm_buffer_t shm_allocator_t::allocate(int32_t width, int32_t height, shm_format format, int32_t stride)
+{
+  if(!data)
+    throw std::invalid_argument("shm allocator is NULL");
+  if(width <= 0 || height <= 0)
+    throw std::invalid_argument("Invalid shm buffer size.");
+  if(stride == 0)
+    {
+      unsigned int bpp = shm_format_bytes_per_pixel(format);
+      if(bpp == 0)
+        throw std::invalid_argument("Can not derive the stride of the shm format.");
+      if(static_cast<std::size_t>(width) > static_cast<std::size_t>(std::numeric_limits<int32_t>::max()) / bpp)
+        throw std::invalid_argument("Invalid shm buffer size.");
+      stride = width * static_cast<int32_t>(bpp);
+    }
+  if(stride < 0)
+    throw std::invalid_argument("Invalid shm buffer stride.");
+
+  std::shared_ptr<shm_buffer_data_t> buffer = data->find_cached(width, height, stride, format);
+  if(!buffer)
+    {
+      data->evict(data->cache_size);
+
+      buffer = std::make_shared<shm_buffer_data_t>();
+      buffer->length = align_up(static_cast<std::size_t>(stride) * static_cast<std::size_t>(height), alignment);
+      data->place(buffer->length, buffer->pool, buffer->offset);
+      buffer->allocator = data;
+      buffer->width = width;
+      buffer->height = height;
+      buffer->stride = stride;
+      buffer->format = format;
+      buffer->buffer = buffer->pool->pool.create_buffer(static_cast<int32_t>(buffer->offset), width, height, stride, format);
+      data->allocated += buffer->length;
+
+      std::weak_ptr<shm_buffer_data_t> weak = buffer;
+      buffer->buffer.on_release() = [weak]()
+        {
+          auto buffer = weak.lock();
+          if(!buffer)
+            return;
+          buffer->busy = false;
+          if(buffer->on_release)
+            buffer->on_release();
+          if(buffer->orphaned)
+            {
+              auto allocator = buffer->allocator.lock();
+              if(allocator)
+                allocator->recycle(buffer);
+            }
+        };
+    }
+
+  // The handle keeps the buffer alive and hands it back once the last
+  // copy is gone.
+  shm_buffer_data_t *ptr = buffer.get();
+  return shm_buffer_t(std::shared_ptr<shm_buffer_data_t>(ptr, [buffer](shm_buffer_data_t* /*unused*/) mutable
+    {
+      auto allocator = buffer->allocator.lock();
+      if(allocator)
+        allocator->recycle(buffer);
+      else if(buffer->busy)
+        {
+          // Keep the buffer alive until the compositor is done with it.
+          auto self = std::make_shared<std::shared_ptr<shm_buffer_data_t>>(buffer);
+          buffer->buffer.on_release() = [self]() { self->reset(); };
+        }
+    }));
+}
+
+void shm_allocator_t::set_cache_size(std::size_t size)
+{
+  if(!data)
+    throw std::invalid_argument("shm allocator is NULL");
+  data->cache_size = size;
+  data->evict(size);
+}
+
+void shm_allocator_t::trim()
+{
+  if(!data)
+    throw std::invalid_argument("shm allocator is NULL");
+  data->evict(0);
+}
+
+std::size_t shm_allocator_t::pool_size() const
+{
+  std::size_t size = 0;
+  if(data)
+    for(auto &p : data->pools)
+      size += p->size;
+  return size;
+}
+
+std::size_t shm_allocator_t::allocated_size() const
+{
+  return data ? data->allocated : 0;
+}
+
+std::size_t shm_allocator_t::pool_count() const
+{
+  return data ? data->pools.size() : 0;
+}
+
+shm_allocator_t::operator bool() const
+{
+  return static_cast<bool>(data);
+}
+
+constexpr unsigned int swapchain_t::min_buffers;
+constexpr unsigned int swapchain_t::max_buffers;
+
+swapchain_t::swapchain_t(display_t &display, const surface_t &surface, const shm_allocator_t &allocator,
+                         unsigned int buffers)
+  : data(std::make_shared<swapchain_data_t>(static_cast<wl_display*>(display)))
+{
+  if(buffers < min_buffers || buffers > max_buffers)
+    throw std::invalid_argument("Invalid number of swapchain buffers.");
+  data->surface = surface;
+  data->allocator = allocator;
+  data->count = buffers;
+  data->buffers.reserve(buffers);
+}
+
+void swapchain_t::resize(int32_t width, int32_t height, shm_format format)
+{
+  if(!data)
+    throw std::invalid_argument("swapchain is NULL");
+  if(width == data->width && height == data->height && format == data->format)
+    return;
+  data->width = width;
+  data->height = height;
+  data->format = format;
+  data->buffers.clear();
+  data->current = shm_buffer_t();
+  data->generation++;
+}
+
+shm_buffer_t swapchain_t::acquire()
+{
+  if(!data)
+    throw std::invalid_argument("swapchain is NULL");
+  if(data->current)
+    return data->current;
+
+  auto find_free = [this] ()
+    {
+      for(auto &b : data->buffers)
+        if(!b.busy())
+          return b;
+      return shm_buffer_t();
+    };
+
+  shm_buffer_t buffer = find_free();
+  bool starved = false;
+  auto start = std::chrono::steady_clock::now();
+  while(!buffer)
+    {
+      if(data->buffers.size() < data->count)
+        {
+          if(data->width <= 0 || data->height <= 0)
+            throw std::logic_error("Swapchain has no size.");
+          buffer = data->allocator.allocate(data->width, data->height, data->format);
+          data->buffers.push_back(buffer);
+          break;
+        }
+      if(!starved)
+        {
+          data->stats.starved++;
+          starved = true;
+        }
+      // the release events arrive on the queue of the buffers
+      event_queue_t queue = data->buffers.front().buffer().get_queue();
+      uint64_t generation = data->generation;
+      if(queue)
+        data->display.dispatch_queue(queue);
+      else
+        data->display.dispatch();
+      data->stats.wait_dispatches++;
+      // a handler may have acquired a buffer itself
+      if(data->current)
+        break;
+      // or resized the swapchain, which dropped the buffers waited for, so
+      // go back to allocating new ones
+      if(data->generation != generation)
+        continue;
+      buffer = find_free();
+    }
+  if(starved)
+    data->stats.wait_time += std::chrono::steady_clock::now() - start;
+  if(data->current)
+    return data->current;
+
+  data->stats.acquired++;
+  data->current = buffer;
+  return buffer;
+}
+
+void swapchain_t::present(const shm_buffer_t &buffer, bool frame)
+{
+  if(!data)
+    throw std::invalid_argument("swapchain is NULL");
+  shm_buffer_t b = buffer;
+  b.attach(data->surface, 0, 0);
+  if(data->surface.can_damage_buffer())
+    data->surface.damage_buffer(0, 0, b.width(), b.height());
+  else
+    data->surface.damage(0, 0, std::numeric_limits<int32_t>::max(), std::numeric_limits<int32_t>::max());
+  commit(b, frame);
+}
+
+void swapchain_t::present(const shm_buffer_t &buffer, damage_tracker_t &damage, bool frame)
+{
+  if(!data)
+    throw std::invalid_argument("swapchain is NULL");
+  shm_buffer_t b = buffer;
+  b.attach(data->surface, 0, 0);
+  damage.apply(data->surface);
+  commit(b, frame);
+}
+
+void swapchain_t::commit(const shm_buffer_t &buffer, bool frame)
+{
+  if(frame)
+    {
+      data->frame_cb = data->surface.frame();
+      std::weak_ptr<swapchain_data_t> weak = data;
+      data->frame_cb.on_done() = [weak] (uint32_t time)
+        {
+          auto data = weak.lock();
+          if(!data)
+            return;
+          data->frame_cb.proxy_release();
+          if(data->on_frame)
+            data->on_frame(time);
+        };
+    }
+  data->surface.commit();
+  data->stats.presented++;
+  if(buffer == data->current)
+    data->current = shm_buffer_t();
+}
+
+std::function<void(uint32_t)> &swapchain_t::on_frame()
+{
+  if(!data)
+    throw std::invalid_argument("swapchain is NULL");
+  return data->on_frame;
+}
+
+bool swapchain_t::frame_pending() const
+{
+  return data && data->frame_cb;
+}
+
+unsigned int swapchain_t::buffer_count() const
+{
+  return data ? data->count : 0;
+}
+
+swapchain_stats_t swapchain_t::stats() const
+{
+  return data ? data->stats : swapchain_stats_t();
+}
+
+swapchain_t::operator bool() const
+{
+  return static_cast<bool>(data);
+}
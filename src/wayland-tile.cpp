@@ -0,0 +1,365 @@
+/*
+ * Copyright (c) 2014-2019, Nils Christopher Brause, Philipp Kerling
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <list>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include <wayland-tile.hpp>
+
+using namespace wayland;
+using namespace wayland::detail;
+
+namespace
+{
+  // Up to date state of the tiles of one buffer
+  struct buffer_state_t
+  {
+    const void *pixels = nullptr;
+    int32_t width = 0;
+    int32_t height = 0;
+    int32_t stride = 0;
+    shm_format format = shm_format::argb8888;
+    std::vector<bool> dirty;
+  };
+
+  // Maximum number of buffers whose state is remembered
+  const std::size_t max_buffers = 8;
+}
+
+namespace wayland
+{
+  namespace detail
+  {
+    struct tile_renderer_data_t
+    {
+      int32_t tile_width = 0;
+      int32_t tile_height = 0;
+
+      // most recently used first
+      std::list<buffer_state_t> buffers;
+      // changed since the last frame
+      std::vector<rect_t> changed;
+      bool all_changed = true;
+      int32_t last_width = 0;
+      int32_t last_height = 0;
+
+      // thread pool
+      std::vector<std::thread> workers;
+      std::mutex mutex;
+      std::condition_variable work_cond;
+      std::condition_variable done_cond;
+      uint64_t generation = 0;
+      unsigned int active = 0;
+      bool stop = false;
+
+      // current batch
+      const std::vector<rect_t> *tiles = nullptr;
+      const tile_renderer_t::render_func_t *func = nullptr;
+      tile_t target;
+      std::atomic<std::size_t> next{0};
+      std::exception_ptr error;
+
+      tile_renderer_data_t(unsigned int threads, int32_t tile_width, int32_t tile_height)
+        : tile_width(tile_width), tile_height(tile_height)
+      {
+        workers.reserve(threads - 1);
+        try
+          {
+            for(unsigned int c = 1; c < threads; c++)
+              workers.emplace_back(&tile_renderer_data_t::worker, this);
+          }
+        catch(...)
+          {
+            shutdown();
+            throw;
+          }
+      }
+
+      tile_renderer_data_t(const tile_renderer_data_t&) = delete;
+      tile_renderer_data_t &operator=(const tile_renderer_data_t&) = delete;
+
+      ~tile_renderer_data_t()
+      {
+        shutdown();
+      }
+
+      void shutdown()
+      {
+        {
+          std::lock_guard<std::mutex> lock(mutex);
+          stop = true;
+        }
+        work_cond.notify_all();
+        for(auto &t : workers)
+          t.join();
+        workers.clear();
+      }
+
+      void worker()
+      {
+        uint64_t seen = 0;
+        while(true)
+          {
+            {
+              std::unique_lock<std::mutex> lock(mutex);
+              work_cond.wait(lock, [&] () { return stop || generation != seen; });
+              if(stop)
+                return;
+              seen = generation;
+            }
+            work();
+            {
+              std::lock_guard<std::mutex> lock(mutex);
+              if(--active == 0)
+                done_cond.notify_one();
+            }
+          }
+      }
+
+      void work()
+      {
+        std::size_t count = tiles->size();
+        std::size_t i;
+        while((i = next.fetch_add(1, std::memory_order_relaxed)) < count)
+          {
+            const rect_t &r = (*tiles)[i];
+            tile_t tile = target;
+            tile.rect = r;
+            tile.data += static_cast<std::ptrdiff_t>(target.stride) * r.y
+              + static_cast<std::ptrdiff_t>(r.x) * shm_format_bytes_per_pixel(target.format);
+            try
+              {
+                (*func)(tile);
+              }
+            catch(...)
+              {
+                std::lock_guard<std::mutex> lock(mutex);
+                if(!error)
+                  error = std::current_exception();
+                next.store(count, std::memory_order_relaxed);
+              }
+          }
+      }
+
+      void run(const std::vector<rect_t> &batch, const tile_renderer_t::render_func_t &f, const tile_t &t)
+      {
+        {
+          std::lock_guard<std::mutex> lock(mutex);
+          tiles = &batch;
+          func = &f;
+          target = t;
+          next.store(0, std::memory_order_relaxed);
+          active = static_cast<unsigned int>(workers.size());
+          generation++;
+        }
+        work_cond.notify_all();
+        work();
+        std::exception_ptr e;
+        {
+          std::unique_lock<std::mutex> lock(mutex);
+          done_cond.wait(lock, [&] () { return active == 0; });
+          std::swap(e, error);
+        }
+        if(e)
+          std::rethrow_exception(e);
+      }
+
+      int32_t columns(const buffer_state_t &state) const
+      {
+        return (state.width + tile_width - 1) / tile_width;
+      }
+
+      int32_t rows(const buffer_state_t &state) const
+      {
+        return (state.height + tile_height - 1) / tile_height;
+      }
+
+      void mark(buffer_state_t &state, const rect_t &rect)
+      {
+        rect_t r = rect.intersected(rect_t(0, 0, state.width, state.height));
+        if(r.empty())
+          return;
+        int32_t cols = columns(state);
+        for(int32_t y = r.y / tile_height; y <= (r.y + r.height - 1) / tile_height; y++)
+          for(int32_t x = r.x / tile_width; x <= (r.x + r.width - 1) / tile_width; x++)
+            state.dirty[static_cast<std::size_t>(y * cols + x)] = true;
+      }
+
+      rect_t tile_rect(const buffer_state_t &state, int32_t x, int32_t y) const
+      {
+        return rect_t(x * tile_width, y * tile_height, tile_width, tile_height)
+          .intersected(rect_t(0, 0, state.width, state.height));
+      }
+
+      buffer_state_t &state_for(void *pixels, int32_t width, int32_t height, int32_t stride, shm_format format)
+      {
+        for(auto it = buffers.begin(); it != buffers.end(); ++it)
+          if(it->pixels == pixels && it->width == width && it->height == height
+             && it->stride == stride && it->format == format)
+            {
+              buffers.splice(buffers.begin(), buffers, it);
+              return buffers.front();
+            }
+
+        // unknown buffers have undefined contents
+        buffer_state_t state;
+        state.pixels = pixels;
+        state.width = width;
+        state.height = height;
+        state.stride = stride;
+        state.format = format;
+        state.dirty.assign(static_cast<std::size_t>(columns(state) * rows(state)), true);
+        buffers.push_front(std::move(state));
+        if(buffers.size() > max_buffers)
+          buffers.pop_back();
+        return buffers.front();
+      }
+    };
+  }
+}
+
+constexpr int32_t tile_renderer_t::default_tile_width;
+constexpr int32_t tile_renderer_t::default_tile_height;
+
+tile_renderer_t::tile_renderer_t(unsigned int threads, int32_t tile_width, int32_t tile_height)
+{
+  if(tile_width <= 0 || tile_height <= 0)
+    throw std::invalid_argument("Invalid tile size.");
+  if(threads == 0)
+    threads = std::max(std::thread::hardware_concurrency(), 1u);
+  data = std::make_shared<tile_renderer_data_t>(threads, tile_width, tile_height);
+}
+
+void tile_renderer_t::invalidate(const rect_t &rect)
+{
+  if(!data)
+    throw std::invalid_argument("tile renderer is NULL");
+  if(rect.empty())
+    return;
+  for(auto &state : data->buffers)
+    data->mark(state, rect);
+  data->changed.push_back(rect);
+}
+
+void tile_renderer_t::invalidate_all()
+{
+  if(!data)
+    throw std::invalid_argument("tile renderer is NULL");
+  for(auto &state : data->buffers)
+    state.dirty.assign(state.dirty.size(), true);
+  data->changed.clear();
+  data->all_changed = true;
+}
+
+std::size_t tile_renderer_t::render(const shm_buffer_t &buffer, const render_func_t &func, damage_tracker_t &damage)
+{
+  return render(buffer.pixels(), buffer.width(), buffer.height(), buffer.stride(), buffer.format(), func, &damage);
+}
+
+std::size_t tile_renderer_t::render(const shm_buffer_t &buffer, const render_func_t &func)
+{
+  return render(buffer.pixels(), buffer.width(), buffer.height(), buffer.stride(), buffer.format(), func, nullptr);
+}
+
+std::size_t tile_renderer_t::render(void *pixels, int32_t width, int32_t height, int32_t stride, shm_format format,
+                                    const render_func_t &func, damage_tracker_t *damage)
+{
+  if(!data)
+    throw std::invalid_argument("tile renderer is NULL");
+  if(shm_format_bytes_per_pixel(format) == 0)
+    throw std::invalid_argument("Unsupported pixel format.");
+  if(width <= 0 || height <= 0)
+    return 0;
+
+  buffer_state_t &state = data->state_for(pixels, width, height, stride, format);
+
+  std::vector<rect_t> tiles;
+  int32_t cols = data->columns(state);
+  int32_t rows = data->rows(state);
+  for(int32_t y = 0; y < rows; y++)
+    for(int32_t x = 0; x < cols; x++)
+      if(state.dirty[static_cast<std::size_t>(y * cols + x)])
+        tiles.push_back(data->tile_rect(state, x, y));
+
+  tile_t target;
+  target.data = static_cast<uint8_t*>(pixels);
+  target.stride = stride;
+  target.format = format;
+  if(!tiles.empty())
+    {
+      try
+        {
+          data->run(tiles, func, target);
+        }
+      catch(...)
+        {
+          // the contents of the buffer are unknown now
+          data->buffers.pop_front();
+          throw;
+        }
+    }
+  state.dirty.assign(state.dirty.size(), false);
+
+  if(damage)
+    {
+      damage->set_bounds(width, height);
+      if(data->all_changed || width != data->last_width || height != data->last_height)
+        damage->add_all();
+      else
+        {
+          // damage whole tiles, they have been redrawn anyway
+          buffer_state_t changed = state;
+          changed.dirty.assign(state.dirty.size(), false);
+          for(auto &r : data->changed)
+            data->mark(changed, r);
+          for(int32_t y = 0; y < rows; y++)
+            for(int32_t x = 0; x < cols; x++)
+              if(changed.dirty[static_cast<std::size_t>(y * cols + x)])
+                damage->add(data->tile_rect(changed, x, y));
+        }
+    }
+  data->changed.clear();
+  data->all_changed = false;
+  data->last_width = width;
+  data->last_height = height;
+
+  return tiles.size();
+}
+
+unsigned int tile_renderer_t::thread_count() const
+{
+  return data ? static_cast<unsigned int>(data->workers.size()) + 1 : 0;
+}
+
+tile_renderer_t::operator bool() const
+{
+  return static_cast<bool>(data);
+}
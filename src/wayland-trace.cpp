@@ -0,0 +1,481 @@
+/*
+ * Copyright (c) 2014-2019, Nils Christopher Brause, Philipp Kerling
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <wayland-client-core.h>
+#include <wayland-trace.hpp>
+
+using namespace wayland;
+using namespace wayland::detail;
+
+std::atomic<bool> wayland::detail::trace_enabled{false};
+
+constexpr std::size_t tracer_t::default_file_size;
+constexpr std::size_t tracer_t::default_ring_size;
+
+namespace
+{
+  const std::size_t header_size = sizeof(trace::record_t);
+
+  uint64_t now()
+  {
+    timespec ts = {0, 0};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + static_cast<uint64_t>(ts.tv_nsec);
+  }
+
+  std::size_t pad(std::size_t size, std::size_t alignment)
+  {
+    return (size + alignment - 1) & ~(alignment - 1);
+  }
+
+  // Single producer, single consumer ring of records. Records are never
+  // split at the end of the buffer. If the space left at the end is too
+  // small, it is skipped with a padding record, or implicitly if not even
+  // a record header fits.
+  struct ring_t
+  {
+    std::vector<uint64_t> storage;
+    char *buffer = nullptr;
+    std::size_t size = 0;
+    std::atomic<uint64_t> head{0};
+    std::atomic<uint64_t> tail{0};
+    uint16_t thread = 0;
+    std::atomic<bool> dead{false};
+
+    ring_t(std::size_t s, uint16_t t)
+      : storage(s / sizeof(uint64_t)), buffer(reinterpret_cast<char*>(storage.data())), size(s), thread(t)
+    {
+    }
+
+    // returns nullptr if there is no space
+    char *reserve(std::size_t n, uint64_t &pos)
+    {
+      uint64_t h = head.load(std::memory_order_relaxed);
+      uint64_t t = tail.load(std::memory_order_acquire);
+      std::size_t offset = h & (size - 1);
+      std::size_t contiguous = size - offset;
+      std::size_t skip = contiguous < n ? contiguous : 0;
+      if(size - (h - t) < n + skip)
+        return nullptr;
+      if(skip >= header_size)
+        {
+          trace::record_t padding = {};
+          padding.size = static_cast<uint32_t>(skip);
+          padding.type = trace::record_type::padding;
+          std::memcpy(buffer + offset, &padding, header_size);
+        }
+      pos = h + skip;
+      return buffer + (pos & (size - 1));
+    }
+
+    void commit(uint64_t pos, std::size_t n)
+    {
+      head.store(pos + n, std::memory_order_release);
+    }
+  };
+
+  struct thread_ring_t
+  {
+    std::shared_ptr<ring_t> ring;
+
+    ~thread_ring_t()
+    {
+      if(ring)
+        ring->dead = true;
+    }
+  };
+
+  std::mutex tracer_mutex;
+  std::condition_variable drain_cond;
+  std::thread drain_thread;
+  bool draining = false;
+
+  // state of the trace file, only touched by the drain thread while
+  // tracing is active
+  int file_fd = -1;
+  char *file_mem = nullptr;
+  std::size_t file_size = 0;
+  std::size_t file_pos = 0;
+  std::size_t interfaces_written = 0;
+
+  std::size_t ring_size = tracer_t::default_ring_size;
+  uint32_t max_payload = 256;
+
+  std::mutex rings_mutex;
+  std::vector<std::shared_ptr<ring_t>> rings;
+  uint16_t thread_count = 0;
+
+  std::mutex interfaces_mutex;
+  std::vector<std::string> interface_names;
+  std::map<std::string, uint16_t> interface_ids;
+
+  std::atomic<uint64_t> records{0};
+  std::atomic<uint64_t> dropped{0};
+  std::atomic<uint64_t> bytes{0};
+
+  thread_local thread_ring_t thread_ring;
+  thread_local std::unordered_map<const char*, uint16_t> thread_interfaces;
+
+  ring_t *get_ring()
+  {
+    if(!thread_ring.ring)
+      {
+        std::lock_guard<std::mutex> lock(rings_mutex);
+        thread_ring.ring = std::make_shared<ring_t>(ring_size, thread_count++);
+        rings.push_back(thread_ring.ring);
+      }
+    return thread_ring.ring.get();
+  }
+
+  uint16_t get_interface(const char *name)
+  {
+    auto it = thread_interfaces.find(name);
+    if(it != thread_interfaces.end())
+      return it->second;
+    std::lock_guard<std::mutex> lock(interfaces_mutex);
+    auto id = interface_ids.find(name);
+    uint16_t result = 0;
+    if(id != interface_ids.end())
+      result = id->second;
+    else
+      {
+        result = static_cast<uint16_t>(interface_names.size());
+        interface_names.emplace_back(name);
+        interface_ids[name] = result;
+      }
+    thread_interfaces[name] = result;
+    return result;
+  }
+
+  uint32_t object_id(const void *object)
+  {
+    return object ? wl_proxy_get_id(reinterpret_cast<wl_proxy*>(const_cast<void*>(object))) : 0;
+  }
+
+  bool file_write(const void *data, std::size_t size)
+  {
+    if(file_pos + size > file_size)
+      return false;
+    std::memcpy(file_mem + file_pos, data, size);
+    file_pos += size;
+    bytes += size;
+    return true;
+  }
+
+  // write definitions of interfaces that were registered since the last
+  // call, so they precede the records using them
+  void write_interfaces()
+  {
+    std::vector<std::string> names;
+    {
+      std::lock_guard<std::mutex> lock(interfaces_mutex);
+      names.assign(interface_names.begin() + static_cast<std::ptrdiff_t>(interfaces_written), interface_names.end());
+    }
+    for(auto &name : names)
+      {
+        std::vector<char> record(pad(header_size + name.size() + 1, 8), 0);
+        trace::record_t header = {};
+        header.time = now();
+        header.size = static_cast<uint32_t>(record.size());
+        header.type = trace::record_type::interface;
+        header.interface = static_cast<uint16_t>(interfaces_written);
+        std::memcpy(record.data(), &header, header_size);
+        std::memcpy(record.data() + header_size, name.c_str(), name.size() + 1);
+        if(!file_write(record.data(), record.size()))
+          return;
+        interfaces_written++;
+      }
+  }
+
+  void drain_ring(ring_t &ring)
+  {
+    uint64_t t = ring.tail.load(std::memory_order_relaxed);
+    uint64_t h = ring.head.load(std::memory_order_acquire);
+    while(t < h)
+      {
+        std::size_t offset = t & (ring.size - 1);
+        if(ring.size - offset < header_size)
+          {
+            t += ring.size - offset;
+            continue;
+          }
+        trace::record_t header;
+        std::memcpy(&header, ring.buffer + offset, header_size);
+        if(header.type != trace::record_type::padding)
+          {
+            // the interface may have been registered after the last
+            // call of write_interfaces()
+            if(header.interface >= interfaces_written)
+              write_interfaces();
+            if(file_write(ring.buffer + offset, header.size))
+              records++;
+            else
+              dropped++;
+          }
+        t += header.size;
+      }
+    ring.tail.store(t, std::memory_order_release);
+  }
+
+  void drain()
+  {
+    write_interfaces();
+    std::vector<std::shared_ptr<ring_t>> current;
+    {
+      std::lock_guard<std::mutex> lock(rings_mutex);
+      // rings of threads that have exited can go once they are empty
+      rings.erase(std::remove_if(rings.begin(), rings.end(), [] (const std::shared_ptr<ring_t> &r)
+                                 {
+                                   return r->dead && r->head.load() == r->tail.load();
+                                 }), rings.end());
+      current = rings;
+    }
+    for(auto &ring : current)
+      drain_ring(*ring);
+  }
+
+  void drain_loop()
+  {
+    std::unique_lock<std::mutex> lock(tracer_mutex);
+    while(draining)
+      {
+        drain_cond.wait_for(lock, std::chrono::milliseconds(10));
+        drain();
+      }
+    drain();
+  }
+}
+
+void wayland::detail::trace_message(trace::record_type type, void *proxy, const char *interface, uint32_t opcode,
+                                    const char *signature, const wl_argument *args)
+{
+  // size of the arguments
+  std::size_t size = header_size;
+  const wl_argument *a = args;
+  for(const char *s = signature; s && *s; s++)
+    switch(*s)
+      {
+      case 'i': case 'u': case 'f': case 'h': case 'o': case 'n':
+        size += 4;
+        a++;
+        break;
+      case 's':
+        size += 4 + pad(a->s ? std::min<std::size_t>(std::strlen(a->s) + 1, max_payload) : 0, 4);
+        a++;
+        break;
+      case 'a':
+        size += 4 + pad(a->a ? std::min<std::size_t>(a->a->size, max_payload) : 0, 4);
+        a++;
+        break;
+      default:
+        break;
+      }
+  size = pad(size, 8);
+
+  ring_t *ring = get_ring();
+  uint64_t pos = 0;
+  char *record = size <= ring->size / 4 ? ring->reserve(size, pos) : nullptr;
+  if(!record)
+    {
+      dropped++;
+      return;
+    }
+
+  trace::record_t header = {};
+  header.time = now();
+  header.size = static_cast<uint32_t>(size);
+  header.type = type;
+  header.opcode = static_cast<uint16_t>(opcode);
+  header.object = object_id(proxy);
+  header.interface = get_interface(interface ? interface : "");
+  header.thread = ring->thread;
+  std::memcpy(record, &header, header_size);
+
+  char *p = record + header_size;
+  auto put = [&p] (uint32_t v)
+    {
+      std::memcpy(p, &v, 4);
+      p += 4;
+    };
+  for(const char *s = signature; s && *s; s++)
+    {
+      switch(*s)
+        {
+        case 'i':
+          put(static_cast<uint32_t>(args->i));
+          break;
+        case 'u':
+          put(args->u);
+          break;
+        case 'f':
+          put(static_cast<uint32_t>(args->f));
+          break;
+        case 'h':
+          put(static_cast<uint32_t>(args->h));
+          break;
+        case 'o':
+        case 'n':
+          put(object_id(args->o));
+          break;
+        case 's':
+          {
+            std::size_t len = args->s ? std::strlen(args->s) + 1 : 0;
+            std::size_t n = std::min<std::size_t>(len, max_payload);
+            put(static_cast<uint32_t>(len));
+            std::memcpy(p, args->s, n);
+            std::memset(p + n, 0, pad(n, 4) - n);
+            p += pad(n, 4);
+          }
+          break;
+        case 'a':
+          {
+            std::size_t len = args->a ? args->a->size : 0;
+            std::size_t n = std::min<std::size_t>(len, max_payload);
+            put(static_cast<uint32_t>(len));
+            if(n)
+              std::memcpy(p, args->a->data, n);
+            std::memset(p + n, 0, pad(n, 4) - n);
+            p += pad(n, 4);
+          }
+          break;
+        default:
+          continue;
+        }
+      args++;
+    }
+  std::memset(p, 0, static_cast<std::size_t>(record + size - p));
+  ring->commit(pos, size);
+}
+
+void tracer_t::start(const std::string &path, std::size_t size, std::size_t ring_bytes, uint32_t payload)
+{
+  std::lock_guard<std::mutex> lock(tracer_mutex);
+  if(draining)
+    throw std::logic_error("Tracing is already active.");
+  if(size < sizeof(trace::file_header_t) || ring_bytes < 1024)
+    throw std::invalid_argument("Invalid trace buffer size.");
+
+  int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if(fd < 0)
+    throw std::system_error(errno, std::generic_category(), "open");
+  if(ftruncate(fd, static_cast<off_t>(size)) < 0)
+    {
+      int err = errno;
+      close(fd);
+      throw std::system_error(err, std::generic_category(), "ftruncate");
+    }
+  void *mem = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if(mem == MAP_FAILED)
+    {
+      int err = errno;
+      close(fd);
+      throw std::system_error(err, std::generic_category(), "mmap");
+    }
+
+  file_fd = fd;
+  file_mem = static_cast<char*>(mem);
+  file_size = size;
+  file_pos = sizeof(trace::file_header_t);
+  interfaces_written = 0;
+  max_payload = payload;
+  records = 0;
+  dropped = 0;
+  bytes = 0;
+
+  trace::file_header_t header = {};
+  std::memcpy(header.magic, trace::magic, sizeof(header.magic));
+  header.version = trace::version;
+  header.max_payload = max_payload;
+  header.start_time = now();
+  std::memcpy(file_mem, &header, sizeof(header));
+
+  {
+    std::lock_guard<std::mutex> rlock(rings_mutex);
+    ring_size = std::size_t(1) << 10;
+    while(ring_size < ring_bytes)
+      ring_size <<= 1;
+    // rings are only consumed by the drain thread, which is not running,
+    // so left overs of the last trace can be discarded here
+    for(auto &ring : rings)
+      ring->tail.store(ring->head.load());
+  }
+
+  draining = true;
+  drain_thread = std::thread(drain_loop);
+  trace_enabled = true;
+}
+
+void tracer_t::stop()
+{
+  {
+    std::lock_guard<std::mutex> lock(tracer_mutex);
+    if(!draining)
+      return;
+    trace_enabled = false;
+    draining = false;
+  }
+  drain_cond.notify_all();
+  drain_thread.join();
+
+  std::lock_guard<std::mutex> lock(tracer_mutex);
+  trace::file_header_t header;
+  std::memcpy(&header, file_mem, sizeof(header));
+  header.size = file_pos - sizeof(header);
+  std::memcpy(file_mem, &header, sizeof(header));
+  munmap(file_mem, file_size);
+  // if this fails, the file keeps its full size and the header tells
+  // the real one
+  int ret = ftruncate(file_fd, static_cast<off_t>(file_pos));
+  static_cast<void>(ret);
+  close(file_fd);
+  file_fd = -1;
+  file_mem = nullptr;
+}
+
+trace_stats_t tracer_t::stats()
+{
+  trace_stats_t result;
+  result.records = records;
+  result.dropped = dropped;
+  result.bytes = bytes;
+  return result;
+}
@@ -0,0 +1,534 @@
+/*
+ * Copyright (c) 2014-2019, Nils Christopher Brause, Philipp Kerling
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <map>
+#include <stdexcept>
+#include <vector>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/sendfile.h>
+#include <wayland-transfer.hpp>
+
+using namespace wayland;
+using namespace wayland::detail;
+
+namespace wayland
+{
+  namespace detail
+  {
+    struct transfer_data_t
+    {
+      enum class kind_t { receive, receive_fd, send_fd, send_buffer };
+      // how data is moved between two file descriptors, from fastest to
+      // most compatible
+      enum class method_t { splice, sendfile, copy };
+
+      kind_t kind = kind_t::receive;
+      method_t method = method_t::splice;
+      // pipe end, owned
+      int fd = -1;
+      // duplicate of the source of send_fd, owned
+      int source = -1;
+      // destination of receive_fd, not owned
+      int destination = -1;
+      // duplicate of the destination, watched instead of the pipe while
+      // the destination is full, owned
+      int destination_watch = -1;
+      bool waiting_output = false;
+      off_t offset = 0;
+      std::size_t remaining = transfer_engine_t::all;
+      // data of send_buffer, or the part of a chunk that the destination
+      // of receive_fd did not take yet
+      std::string payload;
+      std::size_t pos = 0;
+      uint64_t bytes = 0;
+      bool finished = false;
+      std::function<void(const char*, std::size_t)> data;
+      std::function<void(std::error_code)> done;
+      std::weak_ptr<transfer_engine_data_t> engine;
+
+      void close_fds()
+      {
+        if(fd >= 0)
+          close(fd);
+        if(source >= 0)
+          close(source);
+        if(destination_watch >= 0)
+          close(destination_watch);
+        fd = source = destination_watch = -1;
+        finished = true;
+      }
+    };
+
+    struct transfer_engine_data_t
+    {
+      int epfd = -1;
+      std::size_t chunk_size = 64 * 1024;
+      std::map<int, std::shared_ptr<transfer_data_t>> transfers;
+      std::vector<char> buffer;
+
+      ~transfer_engine_data_t()
+      {
+        for(auto &t : transfers)
+          t.second->close_fds();
+        if(epfd >= 0)
+          close(epfd);
+      }
+
+      void remove(transfer_data_t &transfer)
+      {
+        if(transfer.finished)
+          return;
+        epoll_ctl(epfd, EPOLL_CTL_DEL, transfer.fd, nullptr);
+        if(transfer.destination_watch >= 0)
+          epoll_ctl(epfd, EPOLL_CTL_DEL, transfer.destination_watch, nullptr);
+        // keep the transfer alive until it is closed
+        std::shared_ptr<transfer_data_t> keep;
+        auto it = transfers.find(transfer.fd);
+        if(it != transfers.end())
+          {
+            keep = it->second;
+            transfers.erase(it);
+          }
+        transfer.close_fds();
+      }
+    };
+  }
+}
+
+namespace
+{
+  // Writing to a pipe whose reader has gone raises SIGPIPE, which would
+  // terminate most clients. Block it while transfers are progressed and
+  // discard a SIGPIPE raised in the meantime; the failed call reports
+  // EPIPE anyway.
+  class sigpipe_guard_t
+  {
+  private:
+    sigset_t set;
+    sigset_t old;
+    bool was_pending = false;
+
+  public:
+    sigpipe_guard_t()
+    {
+      sigemptyset(&set);
+      sigaddset(&set, SIGPIPE);
+      sigset_t pending;
+      sigpending(&pending);
+      was_pending = sigismember(&pending, SIGPIPE);
+      pthread_sigmask(SIG_BLOCK, &set, &old);
+    }
+
+    ~sigpipe_guard_t()
+    {
+      sigset_t pending;
+      sigpending(&pending);
+      if(!was_pending && sigismember(&pending, SIGPIPE))
+        {
+          timespec zero = {0, 0};
+          sigtimedwait(&set, nullptr, &zero);
+        }
+      pthread_sigmask(SIG_SETMASK, &old, nullptr);
+    }
+
+    sigpipe_guard_t(const sigpipe_guard_t&) = delete;
+    sigpipe_guard_t &operator=(const sigpipe_guard_t&) = delete;
+  };
+
+  bool would_block()
+  {
+    return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+  }
+
+  // Wait for the destination of a receive_fd transfer to become writable
+  // instead of for the pipe to become readable, or the other way round.
+  // The events still carry the pipe, so the transfer is found as usual.
+  bool watch_destination(transfer_data_t &t, transfer_engine_data_t &engine, bool output)
+  {
+    epoll_event event = {};
+    event.data.fd = t.fd;
+    if(output)
+      {
+        if(t.destination_watch < 0)
+          t.destination_watch = fcntl(t.destination, F_DUPFD_CLOEXEC, 0);
+        event.events = EPOLLOUT;
+        return t.destination_watch >= 0
+          && epoll_ctl(engine.epfd, EPOLL_CTL_DEL, t.fd, nullptr) == 0
+          && epoll_ctl(engine.epfd, EPOLL_CTL_ADD, t.destination_watch, &event) == 0;
+      }
+    event.events = EPOLLIN;
+    return epoll_ctl(engine.epfd, EPOLL_CTL_DEL, t.destination_watch, nullptr) == 0
+      && epoll_ctl(engine.epfd, EPOLL_CTL_ADD, t.fd, &event) == 0;
+  }
+
+  // Write the pending part of a chunk to the destination of a receive_fd
+  // transfer. If the destination is full, the rest is kept and written
+  // once it becomes writable again. Returns true if the transfer failed.
+  bool write_pending(transfer_data_t &t, transfer_engine_data_t &engine, std::error_code &error)
+  {
+    while(t.pos < t.payload.size())
+      {
+        ssize_t n = write(t.destination, t.payload.data() + t.pos, t.payload.size() - t.pos);
+        if(n < 0 && errno == EINTR)
+          continue;
+        if(n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+          {
+            if(!t.waiting_output && !watch_destination(t, engine, true))
+              {
+                error = std::error_code(errno, std::generic_category());
+                return true;
+              }
+            t.waiting_output = true;
+            return false;
+          }
+        if(n < 0)
+          {
+            error = std::error_code(errno, std::generic_category());
+            return true;
+          }
+        t.pos += static_cast<std::size_t>(n);
+        t.bytes += static_cast<uint64_t>(n);
+      }
+    if(t.waiting_output)
+      {
+        if(!watch_destination(t, engine, false))
+          {
+            error = std::error_code(errno, std::generic_category());
+            return true;
+          }
+        t.waiting_output = false;
+      }
+    return false;
+  }
+
+  // Move at most one chunk. Returns true when the transfer has finished,
+  // error is set if it failed.
+  bool step(transfer_data_t &t, transfer_engine_data_t &engine, std::error_code &error)
+  {
+    std::size_t chunk = engine.chunk_size;
+    std::size_t splice_chunk = chunk * 16;
+    ssize_t n = 0;
+
+    switch(t.kind)
+      {
+      case transfer_data_t::kind_t::receive:
+        engine.buffer.resize(chunk);
+        n = read(t.fd, engine.buffer.data(), chunk);
+        if(n > 0)
+          {
+            t.bytes += static_cast<uint64_t>(n);
+            if(t.data)
+              t.data(engine.buffer.data(), static_cast<std::size_t>(n));
+          }
+        break;
+
+      case transfer_data_t::kind_t::receive_fd:
+        if(t.method == transfer_data_t::method_t::splice)
+          {
+            n = splice(t.fd, nullptr, t.destination, nullptr, splice_chunk, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            if(n < 0 && errno == EINVAL)
+              t.method = transfer_data_t::method_t::copy;
+          }
+        if(t.method != transfer_data_t::method_t::splice)
+          {
+            // nothing is read while a part of the last chunk is pending
+            if(t.pos == t.payload.size())
+              {
+                engine.buffer.resize(chunk);
+                n = read(t.fd, engine.buffer.data(), chunk);
+                if(n <= 0)
+                  break;
+                t.payload.assign(engine.buffer.data(), static_cast<std::size_t>(n));
+                t.pos = 0;
+              }
+            return write_pending(t, engine, error);
+          }
+        if(n > 0)
+          t.bytes += static_cast<uint64_t>(n);
+        break;
+
+      case transfer_data_t::kind_t::send_fd:
+        {
+          std::size_t count = std::min(t.remaining, splice_chunk);
+          if(t.method == transfer_data_t::method_t::splice)
+            {
+              loff_t offset = t.offset;
+              n = splice(t.source, &offset, t.fd, nullptr, count, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+              if(n < 0 && errno == EINVAL)
+                t.method = transfer_data_t::method_t::sendfile;
+            }
+          if(t.method == transfer_data_t::method_t::sendfile)
+            {
+              off_t offset = t.offset;
+              n = sendfile(t.fd, t.source, &offset, count);
+              if(n < 0 && (errno == EINVAL || errno == ENOSYS))
+                t.method = transfer_data_t::method_t::copy;
+            }
+          if(t.method == transfer_data_t::method_t::copy)
+            {
+              engine.buffer.resize(chunk);
+              n = pread(t.source, engine.buffer.data(), std::min(count, chunk), t.offset);
+              // a short write only advances the offset, the rest is read
+              // again next time
+              if(n > 0)
+                n = write(t.fd, engine.buffer.data(), static_cast<std::size_t>(n));
+            }
+          if(n > 0)
+            {
+              t.offset += n;
+              t.bytes += static_cast<uint64_t>(n);
+              if(t.remaining != transfer_engine_t::all)
+                t.remaining -= static_cast<std::size_t>(n);
+              if(t.remaining == 0)
+                return true;
+            }
+        }
+        break;
+
+      case transfer_data_t::kind_t::send_buffer:
+        if(t.pos == t.payload.size())
+          return true;
+        n = write(t.fd, t.payload.data() + t.pos, std::min(t.payload.size() - t.pos, chunk));
+        if(n > 0)
+          {
+            t.pos += static_cast<std::size_t>(n);
+            t.bytes += static_cast<uint64_t>(n);
+            if(t.pos == t.payload.size())
+              return true;
+          }
+        break;
+      }
+
+    if(n == 0)
+      return true;
+    if(n < 0 && !would_block())
+      {
+        error = std::error_code(errno, std::generic_category());
+        return true;
+      }
+    return false;
+  }
+}
+
+constexpr std::size_t transfer_engine_t::all;
+
+transfer_t::transfer_t(std::shared_ptr<transfer_data_t> d)
+  : data(std::move(d))
+{
+}
+
+std::function<void(const char*, std::size_t)> &transfer_t::on_data()
+{
+  if(!data)
+    throw std::invalid_argument("transfer is NULL");
+  return data->data;
+}
+
+std::function<void(std::error_code)> &transfer_t::on_done()
+{
+  if(!data)
+    throw std::invalid_argument("transfer is NULL");
+  return data->done;
+}
+
+void transfer_t::cancel()
+{
+  if(!data)
+    throw std::invalid_argument("transfer is NULL");
+  std::shared_ptr<transfer_engine_data_t> engine = data->engine.lock();
+  if(engine)
+    engine->remove(*data);
+  else
+    data->close_fds();
+}
+
+bool transfer_t::done() const
+{
+  return !data || data->finished;
+}
+
+uint64_t transfer_t::bytes() const
+{
+  return data ? data->bytes : 0;
+}
+
+transfer_t::operator bool() const
+{
+  return static_cast<bool>(data);
+}
+
+transfer_engine_t::transfer_engine_t()
+  : data(std::make_shared<transfer_engine_data_t>())
+{
+  data->epfd = epoll_create1(EPOLL_CLOEXEC);
+  if(data->epfd < 0)
+    throw std::system_error(errno, std::generic_category(), "epoll_create1");
+}
+
+transfer_t transfer_engine_t::add(int fd, std::shared_ptr<transfer_data_t> transfer, bool output)
+{
+  transfer->fd = fd;
+  transfer->engine = data;
+
+  int flags = fcntl(fd, F_GETFL);
+  if(flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0)
+    {
+      int err = errno;
+      transfer->close_fds();
+      throw std::system_error(err, std::generic_category(), "fcntl");
+    }
+
+  epoll_event event = {};
+  event.events = output ? EPOLLOUT : EPOLLIN;
+  event.data.fd = fd;
+  if(epoll_ctl(data->epfd, EPOLL_CTL_ADD, fd, &event) < 0)
+    {
+      int err = errno;
+      transfer->close_fds();
+      throw std::system_error(err, std::generic_category(), "epoll_ctl");
+    }
+
+  data->transfers[fd] = transfer;
+  return transfer_t(transfer);
+}
+
+void transfer_engine_t::set_chunk_size(std::size_t size)
+{
+  if(size == 0)
+    throw std::invalid_argument("Invalid chunk size.");
+  data->chunk_size = size;
+}
+
+transfer_t transfer_engine_t::receive(const std::function<void(int)> &request)
+{
+  return receive(request, -1);
+}
+
+transfer_t transfer_engine_t::receive(const std::function<void(int)> &request, int destination)
+{
+  int fds[2];
+  if(pipe2(fds, O_CLOEXEC | O_NONBLOCK) < 0)
+    throw std::system_error(errno, std::generic_category(), "pipe2");
+  try
+    {
+      // the fd is duplicated when the request is marshalled
+      request(fds[1]);
+    }
+  catch(...)
+    {
+      close(fds[0]);
+      close(fds[1]);
+      throw;
+    }
+  close(fds[1]);
+
+  auto transfer = std::make_shared<transfer_data_t>();
+  if(destination >= 0)
+    {
+      transfer->kind = transfer_data_t::kind_t::receive_fd;
+      transfer->destination = destination;
+    }
+  return add(fds[0], transfer, false);
+}
+
+transfer_t transfer_engine_t::send(int fd, int source, off_t offset, std::size_t length)
+{
+  auto transfer = std::make_shared<transfer_data_t>();
+  transfer->kind = transfer_data_t::kind_t::send_fd;
+  transfer->source = fcntl(source, F_DUPFD_CLOEXEC, 0);
+  if(transfer->source < 0)
+    {
+      int err = errno;
+      close(fd);
+      throw std::system_error(err, std::generic_category(), "fcntl");
+    }
+  transfer->offset = offset;
+  transfer->remaining = length;
+  return add(fd, transfer, true);
+}
+
+transfer_t transfer_engine_t::send(int fd, std::string payload)
+{
+  auto transfer = std::make_shared<transfer_data_t>();
+  transfer->kind = transfer_data_t::kind_t::send_buffer;
+  transfer->payload = std::move(payload);
+  return add(fd, transfer, true);
+}
+
+int transfer_engine_t::get_fd() const
+{
+  return data->epfd;
+}
+
+std::size_t transfer_engine_t::dispatch(int timeout)
+{
+  // handlers may destroy the engine
+  std::shared_ptr<transfer_engine_data_t> engine = data;
+
+  epoll_event events[32];
+  int count = epoll_wait(engine->epfd, events, 32, timeout);
+  if(count < 0)
+    {
+      if(errno == EINTR)
+        return 0;
+      throw std::system_error(errno, std::generic_category(), "epoll_wait");
+    }
+
+  sigpipe_guard_t guard;
+  std::size_t progressed = 0;
+  for(int c = 0; c < count; c++)
+    {
+      // an earlier handler may have cancelled the transfer
+      auto it = engine->transfers.find(events[c].data.fd);
+      if(it == engine->transfers.end())
+        continue;
+      std::shared_ptr<transfer_data_t> transfer = it->second;
+
+      std::error_code error;
+      uint64_t bytes = transfer->bytes;
+      bool finished = step(*transfer, *engine, error);
+      if(transfer->finished)
+        continue;
+      if(finished || transfer->bytes != bytes)
+        progressed++;
+      if(finished)
+        {
+          engine->remove(*transfer);
+          if(transfer->done)
+            transfer->done(error);
+        }
+    }
+  return progressed;
+}
+
+std::size_t transfer_engine_t::pending() const
+{
+  return data->transfers.size();
+}
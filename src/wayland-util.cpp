@@ -25,17 +25,88 @@
 
 #include <wayland-util.hpp>
 
+#include <array>
+#include <atomic>
 #include <cerrno>
+#include <iomanip>
 #include <limits>
+#include <sstream>
 #include <system_error>
 
 using namespace wayland;
 using namespace wayland::detail;
 
+namespace
+{
+  struct category_counters_t
+  {
+    std::atomic<uint64_t> allocations{0};
+    std::atomic<uint64_t> deallocations{0};
+    std::atomic<uint64_t> bytes{0};
+    std::atomic<uint64_t> freed_bytes{0};
+  };
+
+  // wayland-util++ is the only library defining these, so the client and
+  // server libraries share one allocator and one set of counters
+  std::array<category_counters_t, allocation_category_count> allocation_counters;
+  std::atomic<allocator_t*> custom_allocator{nullptr};
+}
+
+void wayland::set_allocator(allocator_t *allocator)
+{
+  custom_allocator = allocator;
+}
+
+allocation_counters_t wayland::get_allocation_counters(allocation_category category)
+{
+  category_counters_t &c = allocation_counters.at(static_cast<std::size_t>(category));
+  allocation_counters_t result;
+  result.allocations = c.allocations.load(std::memory_order_relaxed);
+  result.deallocations = c.deallocations.load(std::memory_order_relaxed);
+  result.bytes = c.bytes.load(std::memory_order_relaxed);
+  uint64_t freed = c.freed_bytes.load(std::memory_order_relaxed);
+  result.live_bytes = result.bytes > freed ? result.bytes - freed : 0;
+  return result;
+}
+
+void wayland::reset_allocation_counters()
+{
+  for(auto &c : allocation_counters)
+    {
+      c.allocations = 0;
+      c.deallocations = 0;
+      c.bytes = 0;
+      c.freed_bytes = 0;
+    }
+}
+
 namespace wayland
 {
   namespace detail
   {
+    void *allocate(std::size_t size, allocation_category category)
+    {
+      allocator_t *allocator = custom_allocator.load(std::memory_order_acquire);
+      void *ptr = allocator ? allocator->allocate(size, category) : ::operator new(size);
+      // only counted once the allocation succeeded
+      category_counters_t &c = allocation_counters[static_cast<std::size_t>(category)];
+      c.allocations.fetch_add(1, std::memory_order_relaxed);
+      c.bytes.fetch_add(size, std::memory_order_relaxed);
+      return ptr;
+    }
+
+    void deallocate(void *ptr, std::size_t size, allocation_category category) noexcept
+    {
+      category_counters_t &c = allocation_counters[static_cast<std::size_t>(category)];
+      c.deallocations.fetch_add(1, std::memory_order_relaxed);
+      c.freed_bytes.fetch_add(size, std::memory_order_relaxed);
+      allocator_t *allocator = custom_allocator.load(std::memory_order_acquire);
+      if(allocator)
+        allocator->deallocate(ptr, size, category);
+      else
+        ::operator delete(ptr);
+    }
+
     int check_return_value(int return_value, const std::string &function_name)
     {
       if(return_value < 0)
@@ -45,6 +116,160 @@ namespace wayland
   }
 }
 
+namespace
+{
+  // values below this are counted exactly
+  constexpr unsigned int linear_buckets = 32;
+  // every further power of two is divided into this many buckets
+  constexpr unsigned int sub_buckets = linear_buckets / 2;
+  constexpr unsigned int sub_bucket_bits = 4;
+  constexpr std::size_t bucket_count = linear_buckets + (64 - sub_bucket_bits - 1) * sub_buckets;
+
+  std::size_t bucket_index(uint64_t value)
+  {
+    if(value < linear_buckets)
+      return value;
+    unsigned int shift = 63 - __builtin_clzll(value) - sub_bucket_bits;
+    return linear_buckets + (shift - 1) * sub_buckets + ((value >> shift) - sub_buckets);
+  }
+
+  // largest value counted in a bucket
+  uint64_t bucket_upper_bound(std::size_t index)
+  {
+    if(index < linear_buckets)
+      return index;
+    unsigned int shift = (index - linear_buckets) / sub_buckets + 1;
+    uint64_t sub = (index - linear_buckets) % sub_buckets + sub_buckets;
+    return ((sub + 1) << shift) - 1;
+  }
+}
+
+namespace wayland
+{
+  namespace detail
+  {
+    struct latency_histogram_data_t
+    {
+      std::array<std::atomic<uint64_t>, bucket_count> buckets;
+      std::atomic<uint64_t> count{0};
+      std::atomic<uint64_t> sum{0};
+      std::atomic<uint64_t> min{std::numeric_limits<uint64_t>::max()};
+      std::atomic<uint64_t> max{0};
+
+      latency_histogram_data_t()
+      {
+        for(auto &b : buckets)
+          b.store(0, std::memory_order_relaxed);
+      }
+    };
+  }
+}
+
+latency_histogram_t::latency_histogram_t()
+  : data(std::make_shared<latency_histogram_data_t>())
+{
+}
+
+void latency_histogram_t::record(std::chrono::nanoseconds latency)
+{
+  uint64_t value = latency.count() > 0 ? static_cast<uint64_t>(latency.count()) : 0;
+  data->buckets[bucket_index(value)].fetch_add(1, std::memory_order_relaxed);
+  data->sum.fetch_add(value, std::memory_order_relaxed);
+
+  uint64_t min = data->min.load(std::memory_order_relaxed);
+  while(value < min && !data->min.compare_exchange_weak(min, value, std::memory_order_relaxed))
+    ;
+  uint64_t max = data->max.load(std::memory_order_relaxed);
+  while(value > max && !data->max.compare_exchange_weak(max, value, std::memory_order_relaxed))
+    ;
+
+  data->count.fetch_add(1, std::memory_order_release);
+}
+
+uint64_t latency_histogram_t::count() const
+{
+  return data->count.load(std::memory_order_acquire);
+}
+
+std::chrono::nanoseconds latency_histogram_t::min() const
+{
+  if(!count())
+    return std::chrono::nanoseconds(0);
+  return std::chrono::nanoseconds(data->min.load(std::memory_order_relaxed));
+}
+
+std::chrono::nanoseconds latency_histogram_t::max() const
+{
+  return std::chrono::nanoseconds(data->max.load(std::memory_order_relaxed));
+}
+
+std::chrono::nanoseconds latency_histogram_t::mean() const
+{
+  uint64_t n = count();
+  if(!n)
+    return std::chrono::nanoseconds(0);
+  return std::chrono::nanoseconds(data->sum.load(std::memory_order_relaxed) / n);
+}
+
+std::chrono::nanoseconds latency_histogram_t::percentile(double percentile) const
+{
+  uint64_t n = count();
+  if(!n)
+    return std::chrono::nanoseconds(0);
+
+  percentile = std::min(std::max(percentile, 0.0), 100.0);
+  auto rank = static_cast<uint64_t>(percentile / 100.0 * static_cast<double>(n) + 0.5);
+  rank = std::max<uint64_t>(rank, 1);
+  uint64_t max = data->max.load(std::memory_order_relaxed);
+  uint64_t seen = 0;
+  for(std::size_t c = 0; c < bucket_count; c++)
+    {
+      seen += data->buckets[c].load(std::memory_order_relaxed);
+      if(seen >= rank)
+        return std::chrono::nanoseconds(std::min(bucket_upper_bound(c), max));
+    }
+  return std::chrono::nanoseconds(max);
+}
+
+void latency_histogram_t::reset()
+{
+  for(auto &b : data->buckets)
+    b.store(0, std::memory_order_relaxed);
+  data->sum = 0;
+  data->min = std::numeric_limits<uint64_t>::max();
+  data->max = 0;
+  data->count = 0;
+}
+
+std::string latency_histogram_t::to_string() const
+{
+  auto us = [] (std::chrono::nanoseconds ns) { return static_cast<double>(ns.count()) / 1000.0; };
+
+  uint64_t n = count();
+  std::ostringstream out;
+  out << std::fixed << std::setprecision(3)
+      << "# count " << n << " min_us " << us(min()) << " mean_us " << us(mean())
+      << " p50_us " << us(percentile(50)) << " p99_us " << us(percentile(99))
+      << " p99.9_us " << us(percentile(99.9)) << " max_us " << us(max()) << std::endl
+      << "# value_us percentile count" << std::endl;
+  if(!n)
+    return out.str();
+
+  uint64_t max = data->max.load(std::memory_order_relaxed);
+  uint64_t seen = 0;
+  for(std::size_t c = 0; c < bucket_count && seen < n; c++)
+    {
+      uint64_t b = data->buckets[c].load(std::memory_order_relaxed);
+      if(!b)
+        continue;
+      seen += b;
+      out << std::setprecision(3) << us(std::chrono::nanoseconds(std::min(bucket_upper_bound(c), max))) << " "
+          << std::setprecision(6) << 100.0 * static_cast<double>(seen) / static_cast<double>(n) << " "
+          << seen << std::endl;
+    }
+  return out.str();
+}
+
 argument_t::argument_t(const argument_t &arg)
 {
   operator=(arg);
@@ -77,6 +302,20 @@ argument_t &argument_t::operator=(const argument_t &arg)
   return *this;
 }
 
+argument_t::argument_t(argument_t &&arg) noexcept
+  : argument(arg.argument), is_array(arg.is_array)
+{
+  // the array is owned by the new argument now
+  arg.is_array = false;
+}
+
+argument_t &argument_t::operator=(argument_t &&arg) noexcept
+{
+  std::swap(argument, arg.argument);
+  std::swap(is_array, arg.is_array);
+  return *this;
+}
+
 argument_t::~argument_t() noexcept
 {
   if(is_array)
@@ -101,6 +340,11 @@ argument_t::argument_t(double f)
   argument.f = wl_fixed_from_double(f);
 }
 
+argument_t::argument_t(fixed_t f)
+{
+  argument.f = f.raw();
+}
+
 argument_t::argument_t(const std::string &s)
 {
   argument.s = s.c_str();